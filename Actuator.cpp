@@ -0,0 +1,93 @@
+//
+//  Actuator.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "app.h"
+#include "Actuator.hpp"
+#include "Navigator.hpp"
+#include <string.h>
+
+static const char* const motorName[ACT_MOTORS] = { "left", "right", "tail", "arm" };
+
+Actuator::Actuator(Motor* lm, Motor* rm, Motor* tm, Motor* am) {
+    _debug(syslog(LOG_NOTICE, "%08u, Actuator constructor", clock->now()));
+    motor[ACT_LEFT]  = lm;
+    motor[ACT_RIGHT] = rm;
+    motor[ACT_TAIL]  = tm;
+    motor[ACT_ARM]   = am;
+    for (int i = 0; i < ACT_MOTORS; i++) {
+        owner[i] = NULL;
+        pwm[i] = 0;
+        known[i] = false;
+    }
+    memset(stats, 0, sizeof(stats));
+}
+
+void Actuator::claim(uint8_t id, const void* src) {
+    owner[id] = src;
+}
+
+bool Actuator::setPWM(uint8_t id, int value, const void* src) {
+    struct actStats& s = stats[id];
+    uint32_t now = clock->now();
+    if (s.cmds == 0) s.first = now;
+    s.last = now;
+    s.cmds++;
+    const void* o = (owner[id] == NULL) ? (const void*)activeNavigator : owner[id];
+    if (src != ACT_SYSTEM && src != o) {
+        s.denied++;
+        return false;
+    }
+    if (value >= ACT_PWM_MAX || value <= -ACT_PWM_MAX) {
+        value = (value > 0) ? ACT_PWM_MAX : -ACT_PWM_MAX;
+        s.saturated++;
+    }
+    if (!known[id] || pwm[id] != value) {
+        motor[id]->setPWM(value);
+        pwm[id] = value;
+        known[id] = true;
+        s.writes++;
+    }
+    return true;
+}
+
+void Actuator::drive(const void* src, int pwmL, int pwmR) {
+    setPWM(ACT_LEFT, pwmL, src);
+    setPWM(ACT_RIGHT, pwmR, src);
+}
+
+void Actuator::stop() {
+    drive(ACT_SYSTEM, 0, 0);
+}
+
+void Actuator::reset(uint8_t id) {
+    motor[id]->reset();
+    pwm[id] = 0;
+    known[id] = false;
+}
+
+int8_t Actuator::getPWM(uint8_t id) {
+    return pwm[id];
+}
+
+const struct actStats& Actuator::getStats(uint8_t id) {
+    return stats[id];
+}
+
+void Actuator::report() {
+    for (int i = 0; i < ACT_MOTORS; i++) {
+        const struct actStats& s = stats[i];
+        if (s.cmds == 0) continue;
+        uint32_t span = s.last - s.first;
+        syslog(LOG_NOTICE, "%08u, actuator: %-5s %6u cmds at %3u/s, %6u to the driver, %3u%% saturated, %u denied",
+               clock->now(), motorName[i], s.cmds, (span > 0) ? s.cmds * 1000 / span : 0,
+               s.writes, s.saturated * 100 / s.cmds, s.denied);
+    }
+}
+
+Actuator::~Actuator() {
+    _debug(syslog(LOG_NOTICE, "%08u, Actuator destructor", clock->now()));
+}
@@ -0,0 +1,60 @@
+//
+//  Actuator.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef Actuator_hpp
+#define Actuator_hpp
+
+#include "aflac_common.hpp"
+
+#define ACT_LEFT        0
+#define ACT_RIGHT       1
+#define ACT_TAIL        2
+#define ACT_ARM         3
+#define ACT_MOTORS      4
+#define ACT_PWM_MAX   100   // the driver clamps to this, commands at or beyond it count as saturated
+#define ACT_SYSTEM   NULL   // source of the commands from StateMachine, which always get through
+
+// what a motor was commanded since the Actuator was constructed
+struct actStats {
+    uint32_t cmds;          // commands given
+    uint32_t writes;        // of them passed on to the driver
+    uint32_t saturated;     // at ACT_PWM_MAX either way
+    uint32_t denied;        // from other than the owner, dropped
+    uint32_t first, last;   // clock->now() of the first and the latest command
+};
+
+/*
+ * The only writer to the motors. The driver holds the power by itself, so a command repeating
+ * the one last passed on is only counted; resetting the count stops the motor, and the command
+ * after it always goes through. getPWM() answers from the same cache without calling the driver.
+ * The wheels take commands from activeNavigator and the other motors from whoever claim()ed them,
+ * ACT_SYSTEM overrides both, and commands from anyone else are dropped.
+ */
+class Actuator {
+private:
+    Motor*      motor[ACT_MOTORS];
+    const void* owner[ACT_MOTORS];  // NULL for activeNavigator
+    int8_t      pwm[ACT_MOTORS];    // last passed on to the driver
+    bool        known[ACT_MOTORS];  // false until the first command after construction or reset()
+    struct actStats stats[ACT_MOTORS];
+protected:
+public:
+    Actuator(Motor* lm, Motor* rm, Motor* tm, Motor* am);
+    void claim(uint8_t id, const void* src);
+    bool setPWM(uint8_t id, int value, const void* src); // false when dropped
+    void drive(const void* src, int pwmL, int pwmR);
+    void stop();                    // both wheels to 0 as ACT_SYSTEM
+    void reset(uint8_t id);         // stop the motor and zero its count
+    int8_t getPWM(uint8_t id);
+    const struct actStats& getStats(uint8_t id);
+    void report();                  // print the statistics to syslog, at exit and on CMD_REPORT
+    ~Actuator();
+};
+
+extern Actuator*    actuator;
+
+#endif /* Actuator_hpp */
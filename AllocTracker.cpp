@@ -0,0 +1,183 @@
+//
+//  AllocTracker.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "AllocTracker.hpp"
+#include "aflac_common.hpp"
+#include <stdlib.h>
+#include <string.h>
+#if defined(MAKE_HOST)
+#include <stdio.h>
+#define ALLOC_LOG(level, fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__)
+#else
+#include "app.h"
+#define ALLOC_LOG(level, fmt, ...) syslog(level, "%08u, " fmt, (clock != NULL) ? clock->now() : 0, ##__VA_ARGS__)
+#endif
+
+#define NUM_STATES (int)(sizeof(stateName) / sizeof(stateName[0]))
+static_assert(NUM_STATES <= ALLOC_MAX_STATES, "raise ALLOC_MAX_STATES");
+
+// all of the following are zero-initialized, hence usable before any constructor runs
+static struct allocStats byTask[ALLOC_MAX_TASKS], byState[ALLOC_MAX_STATES], byModule[ALLOC_MAX_MODULES];
+static const char*    moduleName[ALLOC_MAX_MODULES];
+static int            curModule;
+static int            taskId[ALLOC_MAX_TASKS]; // of the slot, from 1 up to numTasks
+static const char*    taskName[ALLOC_MAX_TASKS];
+static int            numTasks = 1;
+static const char*    guardWhere[ALLOC_MAX_TASKS];
+static bool           guardFatal[ALLOC_MAX_TASKS];
+static const uint8_t* watchedState;
+static const uint8_t* poolBegin;
+static const uint8_t* poolEnd;
+static uint32_t       violations;
+static bool           locked;
+
+// each heap block is prefixed by this to account its size on delete
+struct allocHeader {
+    uint32_t size;
+    uint8_t  task, state, module, reserved;
+};
+
+static int current_task() {
+#if defined(MAKE_HOST)
+    return 0;
+#else
+    ID tid;
+    if (get_tid(&tid) != E_OK) return 0;
+    for (int i = 1; i < numTasks; i++) {
+        if (taskId[i] == tid) return i;
+    }
+    return 0;
+#endif
+}
+
+static int current_state() {
+    if (watchedState == NULL || *watchedState >= NUM_STATES) return 0;
+    return *watchedState;
+}
+
+NoAllocGuard::NoAllocGuard(const char* where, bool fatal) {
+    int task = current_task();
+    prevWhere = guardWhere[task];
+    prevFatal = guardFatal[task];
+    guardWhere[task] = where;
+    guardFatal[task] = fatal;
+}
+
+NoAllocGuard::~NoAllocGuard() {
+    int task = current_task();
+    guardWhere[task] = prevWhere;
+    guardFatal[task] = prevFatal;
+}
+
+void* operator new(size_t size) {
+    int task = current_task(), st = current_state();
+    if (locked || guardWhere[task] != NULL) {
+        violations++;
+        ALLOC_LOG(LOG_EMERG, "%u bytes allocated by task %s in %s, state %s, module %s", (uint32_t)size,
+                  (task > 0) ? taskName[task] : "others", locked ? "the run" : guardWhere[task], stateName[st],
+                  (curModule > 0) ? moduleName[curModule] : "others");
+        assert(!(locked || guardFatal[task]));
+    }
+    struct allocHeader* h = (struct allocHeader*)malloc(sizeof(struct allocHeader) + size);
+    assert(h != NULL);
+    h->size   = size;
+    h->task   = task;
+    h->state  = st;
+    h->module = curModule;
+    struct allocStats* s[3] = { &byTask[task], &byState[st], &byModule[curModule] };
+    for (int i = 0; i < 3; i++) {
+        s[i]->count++;
+        s[i]->bytes += size;
+        s[i]->live  += size;
+    }
+    return h + 1;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    if (p == NULL) return;
+    if ((const uint8_t*)p >= poolBegin && (const uint8_t*)p < poolEnd) return; // never freed
+    struct allocHeader* h = (struct allocHeader*)p - 1;
+    byTask[h->task].live     -= h->size;
+    byState[h->state].live   -= h->size;
+    byModule[h->module].live -= h->size;
+    free(h);
+}
+
+void operator delete[](void* p) noexcept {
+    operator delete(p);
+}
+
+bool alloc_name_task(int tid, const char* name) {
+    if (numTasks >= ALLOC_MAX_TASKS) {
+        ALLOC_LOG(LOG_NOTICE, "alloc: task %s charged to others, raise ALLOC_MAX_TASKS", name);
+        return false;
+    }
+    taskId[numTasks] = tid;
+    taskName[numTasks] = name;
+    numTasks++;
+    return true;
+}
+
+int alloc_module_index(const char* module) {
+    int i;
+    for (i = 1; i < ALLOC_MAX_MODULES && moduleName[i] != NULL; i++) {
+        if (moduleName[i] == module || strcmp(moduleName[i], module) == 0) return i;
+    }
+    if (i == ALLOC_MAX_MODULES) return 0; // too many modules, charged to "others"
+    moduleName[i] = module;
+    return i;
+}
+
+void alloc_set_module(const char* module) {
+    curModule = alloc_module_index(module);
+}
+
+const char* alloc_module_name(int index) {
+    return (index > 0) ? moduleName[index] : "others";
+}
+
+const struct allocStats& alloc_module_stats(int index) {
+    return byModule[index];
+}
+
+void alloc_register_pool(const void* begin, size_t size) {
+    poolBegin = (const uint8_t*)begin;
+    poolEnd   = poolBegin + size;
+}
+
+void alloc_watch_state(const uint8_t* state) {
+    watchedState = state;
+}
+
+void alloc_lock() {
+    locked = true;
+}
+
+void alloc_unlock() {
+    locked = false;
+}
+
+uint32_t alloc_violations() {
+    return violations;
+}
+
+void alloc_report() {
+    for (int i = 0; i < ALLOC_MAX_TASKS; i++) {
+        if (byTask[i].count == 0) continue;
+        ALLOC_LOG(LOG_NOTICE, "alloc: task %-9s %6u times, %7u bytes, %6u live", (i > 0) ? taskName[i] : "others",
+                  byTask[i].count, byTask[i].bytes, byTask[i].live);
+    }
+    for (int i = 0; i < NUM_STATES; i++) {
+        if (byState[i].count == 0) continue;
+        ALLOC_LOG(LOG_NOTICE, "alloc: %-14s %6u times, %7u bytes, %6u live", stateName[i], byState[i].count, byState[i].bytes, byState[i].live);
+    }
+    ALLOC_LOG(LOG_NOTICE, "alloc: %u violations", violations);
+}
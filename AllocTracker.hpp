@@ -0,0 +1,56 @@
+//
+//  AllocTracker.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef AllocTracker_hpp
+#define AllocTracker_hpp
+
+// Note: this header is shared with the host tools and must not depend on ev3api
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Instrumentation of the global operator new/delete.
+ * Allocations are counted by task, by machine state and by module, see alloc_report().
+ * Tasks are told apart only once alloc_name_task() has mapped their ID to a slot, since
+ * the IDs the configurator gives the application tasks follow those of the platform;
+ * all other tasks share slot 0. On the host every allocation is charged to slot 0 and,
+ * unless alloc_watch_state() is called, to state 0.
+ */
+#define ALLOC_MAX_TASKS     8   // slots, 0 for the tasks not named
+#define ALLOC_MAX_STATES    16
+#define ALLOC_MAX_MODULES   16  // module 0 is for allocations before any alloc_set_module()
+
+struct allocStats {
+    uint32_t count; // number of allocations
+    uint32_t bytes; // total bytes allocated
+    uint32_t live;  // bytes not yet freed
+};
+
+// scope in which the current task must not allocate, e.g. a periodic handler.
+// a violation is logged and counted, then asserted when fatal
+class NoAllocGuard {
+private:
+    const char* prevWhere;
+    bool        prevFatal;
+public:
+    NoAllocGuard(const char* where, bool fatal = false);
+    ~NoAllocGuard();
+};
+
+bool alloc_name_task(int tid, const char* name); // before the task runs, false when out of slots
+void alloc_set_module(const char* module); // subsequent heap allocations are charged to module
+int alloc_module_index(const char* module);
+const char* alloc_module_name(int index);
+const struct allocStats& alloc_module_stats(int index);
+void alloc_register_pool(const void* begin, size_t size); // delete of a pointer in the pool is ignored
+void alloc_watch_state(const uint8_t* state);
+void alloc_lock();   // no allocation at all by any task, always fatal
+void alloc_unlock();
+uint32_t alloc_violations();
+void alloc_report(); // print the counters by task and by state
+
+#endif /* AllocTracker_hpp */
@@ -9,16 +9,30 @@
 #include "BlindRunner.hpp"
 #include "Observer.hpp"
 #include "StateMachine.hpp"
+#include "ParamStore.hpp"
+#include "Actuator.hpp"
 #include <string.h>
 #include <stdlib.h>
 
+static const int32_t& speedNorm    = paramInt(PRM_SPEED_NORM);
+static const int32_t& speedSlow    = paramInt(PRM_SPEED_SLOW);
+static const int32_t& speedRecover = paramInt(PRM_SPEED_RECOVER);
+static const int32_t& speedBlind   = paramInt(PRM_SPEED_BLIND);
+static const int32_t& gsLost       = paramInt(PRM_GS_LOST);
+static const int32_t& accMax       = paramInt(PRM_PLAN_ACC_MAX);
+static const int32_t& decMax       = paramInt(PRM_PLAN_DEC_MAX);
+static const int32_t& latAccMax    = paramInt(PRM_PLAN_LAT_ACC_MAX);
+
 BlindRunner::BlindRunner(Motor* lm, Motor* rm, Motor* tm) : LineTracer(lm, rm, tm) {
-#if defined(MAKE_SIM)
-    _debug(syslog(LOG_NOTICE, "%08lu, BlindRunner attempts to read profile in simulator environment", clock->now()));
-	readPropFile("BlindRunner_prop.txt");
-#else
-	readPropFile("/ev3rt/res/BlindRunner_prop.txt");
-#endif
+	// the course file, learned or converted from CSV, takes precedence over the compiled map
+	courseMapSize = loadCourseFile(COURSE_FILE);
+	if (courseMapSize > 0) {
+		course = loadedMap;
+		_debug(syslog(LOG_NOTICE, "%08lu, BlindRunner uses %d sections from %s", clock->now(), courseMapSize, COURSE_FILE));
+	} else {
+		course = courseMap;
+		courseMapSize = sizeof(courseMap) / sizeof(*courseMap);
+	}
 	leftMotor  = lm;
 	rightMotor = rm;
 	tailMotor  = tm;
@@ -29,24 +43,26 @@ BlindRunner::BlindRunner(Motor* lm, Motor* rm, Motor* tm) : LineTracer(lm, rm, t
 void BlindRunner::haveControl() {
     activeNavigator = this;
     // private変数の初期化
-	courseMapSize = sizeof(courseMap) / sizeof(*courseMap);
 	currentSection = 0;
 	speedChgCnt = 0;
 	forward = speed;
 	turn = 0;
+	speedProfile->reset((actuator->getPWM(ACT_LEFT) + actuator->getPWM(ACT_RIGHT)) / 2);
+	resetVelocity();
 	stopping = false;
+	planSpeed(observer->getCourseDistance(), LineTracer::getSpeed());
     // ログ出力
     syslog(LOG_NOTICE, "%08lu, BlindRunner has control", clock->now());
-	syslog(LOG_NOTICE, "%08lu, section %s entered", clock->now(), courseMap[currentSection].id);
+	syslog(LOG_NOTICE, "%08lu, section %s entered", clock->now(), course[currentSection].id);
 	ev3_led_set_color(LED_GREEN);
 }
 
 void BlindRunner::operate() {
-	int32_t d = observer->getDistance();
-	if (currentSection < courseMapSize - 1 && d >= courseMap[currentSection].sectionEnd) {
+	int32_t d = observer->getCourseDistance(); // corrected by the landmarks the course file has
+	if (currentSection < courseMapSize - 1 && d >= course[currentSection].sectionEnd) {
 		currentSection++;
-		syslog(LOG_NOTICE, "%08lu, section %s entered", clock->now(), courseMap[currentSection].id);
-	} else if (currentSection == courseMapSize  - 1 && d >= courseMap[currentSection].sectionEnd) {
+		syslog(LOG_NOTICE, "%08lu, section %s entered", clock->now(), course[currentSection].id);
+	} else if (currentSection == courseMapSize  - 1 && d >= course[currentSection].sectionEnd) {
 		if (!stopping) {
 			stopping = true;
 			_debug(syslog(LOG_NOTICE, "%08lu, BlindRunner course map exhausted", clock->now()));
@@ -54,103 +70,118 @@ void BlindRunner::operate() {
 		}
 	}
 
-	if (courseMap[currentSection].id[0] == 'L') {
+	if (course[currentSection].id[0] == 'L') {
 		if (++speedChgCnt * PERIOD_NAV_TSK >= PERIOD_SPEED_CHG) {
 			speedChgCnt = 0;
 			int s = LineTracer::getSpeed();
-			if (s < SPEED_NORM) {
+			if (s < speedNorm) {
 				LineTracer::setSpeed(++s);
-			} else if (s > SPEED_NORM) {
+			} else if (s > speedNorm) {
 				LineTracer::setSpeed(--s);
 			}
 		}
 		LineTracer::operate();
 	} else {
-		if (courseMap[currentSection].id[0] == 'B') {
-			forward = SPEED_BLIND;
-		} else if (courseMap[currentSection].id[0] == 'R') {
-			LineTracer::setSpeed(SPEED_SLOW);
-			forward = SPEED_SLOW;
-			if (g_grayScale <= GS_LOST) { // line found
-				LineTracer::setSpeed(SPEED_RECOVER);
+		int idx = d / PLAN_SEG_LEN;
+		if (idx >= planSize) idx = planSize - 1;
+		if (course[currentSection].id[0] == 'B') {
+			forward = speedTable[idx];
+		} else if (course[currentSection].id[0] == 'R') {
+			LineTracer::setSpeed(speedSlow);
+			forward = speedTable[idx];
+			if (g_grayScale <= gsLost) { // line found
+				LineTracer::setSpeed(speedRecover);
 				currentSection++;  // switch to LineTracer entry
-				syslog(LOG_NOTICE, "%08lu, section %s entered", clock->now(), courseMap[currentSection].id);
+				syslog(LOG_NOTICE, "%08lu, section %s entered", clock->now(), course[currentSection].id);
 			}
 		} else {
 			_debug(syslog(LOG_NOTICE, "%08lu, illegal course map id", clock->now()));
 			stateMachine->sendTrigger(EVT_cmdStop);				
 		}
-		turn = _EDGE * forward * courseMap[currentSection].curvature / 2;
+		turn = _EDGE * forward * course[currentSection].curvature / 2;
+		speedProfile->reset(forward); // the planned speed is ramped already, LineTracer goes on from it
+		// acceleration along the plan, v dv/ds, for the speed loops to feed forward
+		int32_t acc = 0;
+		if (idx + 1 < planSize) {
+			acc = (speedTable[idx + 1] * speedTable[idx + 1] - speedTable[idx] * speedTable[idx]) * MMPS_PER_PWM * MMPS_PER_PWM / (2 * PLAN_SEG_LEN);
+		}
 		/* 左右モータでロボットのステアリング操作を行う */
-    	pwm_L = forward - turn;
-    	pwm_R = forward + turn;
-
-    	leftMotor->setPWM(pwm_L);
-    	rightMotor->setPWM(pwm_R);
+		driveLR((forward - turn) * MMPS_PER_PWM, (forward + turn) * MMPS_PER_PWM, acc);
 	}
 }
 
-int BlindRunner::readLine( FILE* file, char* dst, size_t len ){
-    int c = 0;
-    unsigned int i = 0;
-
-    while ((c = fgetc(file)) != EOF) {
-      if (c < 0) {
-        return c;        // error handling
-      }
-      if ( i + 1 == len ) {  // reached end of buffer
-        dst[i] = '\0';
-        break;
-      }
-      if (c == '\n') {   // reached end of line
-        dst[i] = '\0';
-        break;
-      }
-      dst[i] = (char)c;
-      i++;
-    }
-    return i;
-}
+// plan the speed table along the course map with a forward pass under accMax and a backward pass under decMax.
+// the passes work on squared speed, which a constant acceleration increases by the same amount in every segment.
+void BlindRunner::planSpeed( int32_t startDist, int32_t startSpeed ){
+	planSize = course[courseMapSize - 1].sectionEnd / PLAN_SEG_LEN + 1;
+	if (planSize > PLAN_MAX_SEGS) planSize = PLAN_MAX_SEGS;
 
-void BlindRunner::readPropFile( const char* filename ){
-	FILE* prop_file = NULL;
-	prop_file = fopen( filename, "r" );
-	if( prop_file==NULL){
-		_debug(syslog(LOG_NOTICE, "%08lu, BlindRunner readProfile() file not found", clock->now()));
-		return;
+	// upper limit given by the section type and the lateral acceleration in curves
+	int sec = -1;
+	int32_t cap = 0;
+	for (int i = 0; i < planSize; i++) {
+		if (sec < 0 || (sec < courseMapSize - 1 && i * PLAN_SEG_LEN >= course[sec].sectionEnd)) {
+			while (++sec < courseMapSize - 1 && i * PLAN_SEG_LEN >= course[sec].sectionEnd);
+			int32_t v;
+			if (course[sec].id[0] == 'B') {
+				v = speedBlind * MMPS_PER_PWM;
+			} else if (course[sec].id[0] == 'R') {
+				v = speedSlow * MMPS_PER_PWM;
+			} else {
+				v = speedNorm * MMPS_PER_PWM;
+			}
+			cap = v * v;
+			// curvature c in courseMap gives the radius WHEEL_TREAD / c
+			double c = fabs(course[sec].curvature);
+			if (c > 0.0 && latAccMax * WHEEL_TREAD / c < cap) {
+				cap = (int32_t)(latAccMax * WHEEL_TREAD / c);
+			}
+		}
+		speedTable[i] = cap;
 	}
 
-	memset( &props, 0, sizeof(struct property) * NUM_PROPS );
-
-	int retval = 0;
-	int i = 0;
-	char buf[256];
-	memset( &buf, 0, sizeof(buf) );
-
-	while( ( retval = readLine(prop_file, buf, 256)) > 0 ){
-		char* comptr = strstr( buf, "," );
-		if( i < NUM_PROPS && NULL != comptr ){
-			*comptr = '\0';
-			strcpy( props[i].name, buf );
-			props[i].value = atoi(comptr+1);
-			i++;
-		}else
-			break;
+	int first = startDist / PLAN_SEG_LEN;
+	if (first < 0) first = 0;
+	if (first >= planSize) first = planSize - 1;
+	int32_t v0 = startSpeed * MMPS_PER_PWM;
+	if (speedTable[first] > v0 * v0) speedTable[first] = v0 * v0;
+	for (int i = first + 1; i < planSize; i++) {
+		int32_t reach = speedTable[i - 1] + 2 * accMax * PLAN_SEG_LEN;
+		if (speedTable[i] > reach) speedTable[i] = reach;
 	}
-	fclose( prop_file );
+	for (int i = planSize - 2; i >= first; i--) {
+		int32_t reach = speedTable[i + 1] + 2 * decMax * PLAN_SEG_LEN;
+		if (speedTable[i] > reach) speedTable[i] = reach;
+	}
+	for (int i = 0; i < planSize; i++) {
+		speedTable[i] = own_isqrt(speedTable[i]) / MMPS_PER_PWM;
+	}
+	_debug(syslog(LOG_NOTICE, "%08lu, BlindRunner planned %d segments from %d mm", clock->now(), planSize, startDist));
 }
 
-int BlindRunner::getProp( const char* propname ){
-	if( props == NULL ){
+// load sections from the binary course file, its parameters are applied by ParamStore
+// and its landmarks handed to Observer. returns the number of sections loaded, or 0 when the file is missing or corrupted
+int BlindRunner::loadCourseFile( const char* filename ){
+	CourseFile* file = new CourseFile();
+	if( !file->load( filename ) ){
+		_debug(syslog(LOG_NOTICE, "%08lu, BlindRunner %s not found or corrupted", clock->now(), filename));
+		delete file;
 		return 0;
 	}
 
-	for ( int i = 0; i < NUM_PROPS; i++ ){
-		if( strcmp( propname, props[i].name ) == 0 ){
-			return props[i].value;
-		}
+	int n = file->getNumSections();
+	for ( int i = 0; i < n; i++ ){
+		const struct cfSection* sec = file->getSection(i);
+		memcpy( loadedMap[i].id, sec->id, sizeof(loadedMap[i].id) );
+		loadedMap[i].id[sizeof(loadedMap[i].id) - 1] = '\0';
+		loadedMap[i].sectionEnd = sec->sectionEnd;
+		loadedMap[i].curvature = (double)sec->curvature / CF_CURV_SCALE;
+	}
+	if ( n > 0 && file->getNumFeatures() > 0 ){
+		observer->setLandmarks( file->getFeature(0), file->getNumFeatures(), loadedMap[n - 1].sectionEnd );
 	}
-	return 0;
+	delete file;
+	return n;
 }
 
 BlindRunner::~BlindRunner() {
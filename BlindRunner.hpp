@@ -10,10 +10,11 @@
 
 #include "aflac_common.hpp"
 #include "LineTracer.hpp"
+#include "CourseFile.hpp"
 
 #define PERIOD_SPEED_CHG 200 * 1000 // Trace message in every 200 ms
-#define PROP_NAME_LEN	48	// プロパティー名の最大長
-#define NUM_PROPS	13	// プロパティーの個数
+#define PLAN_MAX_SEGS	1200	// maximum number of speed table segments (PLAN_SEG_LEN each)
+#define MAX_COURSE_SECTIONS	CF_MAX_SECTIONS	// maximum number of sections in a course file
 
 struct courseSection {
 	char	id[6];
@@ -55,18 +56,15 @@ private:
     Motor*	leftMotor;
     Motor*  rightMotor;
     Motor*	tailMotor;
+	const struct courseSection* course; // courseMap or loadedMap
+	struct courseSection loadedMap[MAX_COURSE_SECTIONS];
 	int		courseMapSize, currentSection, speedChgCnt;
 	bool	stopping;
+	int32_t	speedTable[PLAN_MAX_SEGS]; // planned speed per segment, mm^2/s^2 while planning and PWM after
+	int		planSize;
 
-	struct property{
-		char name[PROP_NAME_LEN];
-		int value;
-	};
-	struct property props[NUM_PROPS];
-
-	int readLine( FILE* file, char* dst, size_t len );
-	void readPropFile( const char* filename );
-	int getProp( const char* propname );
+	int loadCourseFile( const char* filename );
+	void planSpeed( int32_t startDist, int32_t startSpeed );
 protected:
 public:
     BlindRunner();
@@ -0,0 +1,171 @@
+//
+//  Calibrator.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "app.h"
+#include "Calibrator.hpp"
+#include "Observer.hpp"
+#include "ParamStore.hpp"
+#include "Actuator.hpp"
+#include <string.h>
+
+#define CAL_RIGHT   0
+#define CAL_LEFT    1
+#define CAL_CENTER  2
+#define CAL_DONE    3
+
+// raw RGB can go beyond what a centroid holds
+#define CAL_CLAMP(v) ((v) > 255 ? 255 : (v))
+
+Calibrator::Calibrator(Motor* lm, Motor* rm) {
+    _debug(syslog(LOG_NOTICE, "%08u, Calibrator constructor", clock->now()));
+    leftMotor  = lm;
+    rightMotor = rm;
+    phase = CAL_DONE;
+}
+
+void Calibrator::haveControl() {
+    memset(hist, 0, sizeof(hist));
+    startCountL = leftMotor->getCount();
+    startCountR = rightMotor->getCount();
+    startTime = clock->now();
+    phase = CAL_RIGHT;
+    activeNavigator = this;
+    syslog(LOG_NOTICE, "%08u, Calibrator has control", clock->now());
+}
+
+// wheel rotation in degree since haveControl(), positive when pivoted clockwise
+int32_t Calibrator::getPivot() {
+    return ((leftMotor->getCount() - startCountL) - (rightMotor->getCount() - startCountR)) / 2;
+}
+
+void Calibrator::sample() {
+    int16_t bl = g_grayScaleBlueless;
+    if (bl < 0) bl = 0;
+    if (bl > 255) bl = 255;
+    struct calBin& h = hist[bl >> CAL_BIN_SHIFT];
+    if (h.n == UINT16_MAX) return; // the sweep cannot be that long, but never wrap
+    h.n++;
+    h.bl += bl;
+    h.gs += g_grayScale;
+    h.r  += g_rgb.r;
+    h.g  += g_rgb.g;
+    h.b  += g_rgb.b;
+}
+
+void Calibrator::operate() {
+    if (phase == CAL_DONE) return;
+    sample();
+
+    int32_t pivot = getPivot();
+    if (clock->now() - startTime > CAL_TIMEOUT) {
+        syslog(LOG_NOTICE, "%08u, Calibrator timed out at pivot %d", clock->now(), pivot);
+        phase = CAL_DONE;
+    } else if (phase == CAL_RIGHT && pivot >= CAL_SWEEP_DEG) {
+        phase = CAL_LEFT;
+    } else if (phase == CAL_LEFT && pivot <= -CAL_SWEEP_DEG) {
+        phase = CAL_CENTER;
+    } else if (phase == CAL_CENTER && pivot >= 0) {
+        phase = CAL_DONE;
+    }
+
+    if (phase == CAL_DONE) {
+        pwm_L = pwm_R = 0;
+    } else if (phase == CAL_LEFT) {
+        pwm_L = -CAL_PWM;
+        pwm_R =  CAL_PWM;
+    } else {
+        pwm_L =  CAL_PWM;
+        pwm_R = -CAL_PWM;
+    }
+    actuator->drive(this, pwm_L, pwm_R);
+}
+
+bool Calibrator::isDone() {
+    return (phase == CAL_DONE);
+}
+
+void Calibrator::summarize(int from, int to, struct calCluster& c) {
+    uint32_t bl = 0, gs = 0, r = 0, g = 0, b = 0;
+    c.n = 0;
+    for (int i = from; i < to; i++) {
+        c.n += hist[i].n;
+        bl += hist[i].bl;
+        gs += hist[i].gs;
+        r  += hist[i].r;
+        g  += hist[i].g;
+        b  += hist[i].b;
+    }
+    if (c.n == 0) {
+        c.bl = c.gs = c.r = c.g = c.b = 0;
+        return;
+    }
+    c.bl = bl / c.n;
+    c.gs = gs / c.n;
+    c.r  = CAL_CLAMP(r / c.n);
+    c.g  = CAL_CLAMP(g / c.n);
+    c.b  = CAL_CLAMP(b / c.n);
+}
+
+bool Calibrator::publish() {
+    // Otsu's method: the split that maximizes the variance between the line and the background
+    uint32_t total = 0;
+    double sumAll = 0.0;
+    for (int i = 0; i < CAL_BINS; i++) {
+        total  += hist[i].n;
+        sumAll += hist[i].bl;
+    }
+    int split = 0;
+    double best = 0.0, sumLow = 0.0;
+    uint32_t nLow = 0;
+    for (int i = 1; i < CAL_BINS; i++) {
+        nLow   += hist[i - 1].n;
+        sumLow += hist[i - 1].bl;
+        if (nLow == 0 || nLow == total) continue;
+        double m0 = sumLow / nLow;
+        double m1 = (sumAll - sumLow) / (total - nLow);
+        double var = (double)nLow * (total - nLow) * (m1 - m0) * (m1 - m0);
+        if (var > best) {
+            best  = var;
+            split = i;
+        }
+    }
+
+    struct calCluster black, white;
+    summarize(0, split, black);
+    summarize(split, CAL_BINS, white);
+    syslog(LOG_NOTICE, "%08u, Calibrator: %u samples, black %u at gs %d, white %u at gs %d", clock->now(),
+        total, black.n, black.bl, white.n, white.bl);
+    if (split == 0 ||
+        black.n * 100 < total * CAL_MIN_SHARE || white.n * 100 < total * CAL_MIN_SHARE ||
+        white.bl - black.bl < CAL_MIN_CONTRAST) {
+        syslog(LOG_NOTICE, "%08u, Calibrator found no clear line, parameters unchanged", clock->now());
+        return false;
+    }
+
+    int32_t gsTarget = black.bl + (white.bl - black.bl) * CAL_TARGET_RATIO / 100;
+    int32_t gsLost   = black.gs + (white.gs - black.gs) * CAL_LOST_RATIO / 100;
+    if (!paramStore->check(PRM_GS_TARGET, gsTarget) || !paramStore->check(PRM_GS_LOST, gsLost)) {
+        syslog(LOG_NOTICE, "%08u, Calibrator: GS_TARGET = %d, GS_LOST = %d out of bounds, parameters unchanged", clock->now(),
+            gsTarget, gsLost);
+        return false;
+    }
+    paramStore->set(PRM_GS_TARGET, gsTarget);
+    paramStore->set(PRM_GS_LOST, gsLost);
+    paramStore->set(PRM_CLR_BLACK, CLR_RGB(black.r, black.g, black.b));
+    paramStore->set(PRM_CLR_WHITE, CLR_RGB(white.r, white.g, white.b));
+    paramStore->set(PRM_CLR_GRAY, CLR_RGB((black.r + white.r) / 2, (black.g + white.g) / 2, (black.b + white.b) / 2));
+    paramStore->set(PRM_RGB_BLACK, CLR_RGB(black.r, black.g, black.b));
+    paramStore->set(PRM_RGB_WHITE, CLR_RGB(white.r, white.g, white.b));
+    syslog(LOG_NOTICE, "%08u, Calibrator: GS_TARGET = %d, GS_LOST = %d", clock->now(), gsTarget, gsLost);
+    syslog(LOG_NOTICE, "%08u, Calibrator: black = (%d, %d, %d), white = (%d, %d, %d)", clock->now(),
+        black.r, black.g, black.b, white.r, white.g, white.b);
+    return true;
+}
+
+Calibrator::~Calibrator() {
+    _debug(syslog(LOG_NOTICE, "%08u, Calibrator destructor", clock->now()));
+}
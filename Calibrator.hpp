@@ -0,0 +1,57 @@
+//
+//  Calibrator.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef Calibrator_hpp
+#define Calibrator_hpp
+
+#include "aflac_common.hpp"
+#include "Navigator.hpp"
+
+// blueless gray scale is clamped to 0-255 and binned by CAL_BIN_SHIFT bits
+#define CAL_BIN_SHIFT   2
+#define CAL_BINS        (256 >> CAL_BIN_SHIFT)
+
+// running sums of the samples that fell into one gray scale bin
+struct calBin {
+    uint16_t n;
+    uint32_t bl, gs, r, g, b;
+};
+
+// mean of the samples on one side of the line edge
+struct calCluster {
+    uint32_t n;
+    int16_t  bl, gs, r, g, b;
+};
+
+/*
+ * Pivots on the spot to sweep the color sensor over the line and the background,
+ * then splits the gray scale histogram by Otsu's method to publish GS_TARGET, GS_LOST
+ * the centroids CLR_BLACK, CLR_GRAY and CLR_WHITE and the levels RGB_BLACK and RGB_WHITE
+ * of the brightness model into the runtime parameters.
+ * The sweep gives up after CAL_TIMEOUT and leaves the parameters untouched.
+ */
+class Calibrator : public Navigator {
+private:
+    struct calBin hist[CAL_BINS];
+    int     phase;
+    int32_t startCountL, startCountR;
+    uint32_t startTime;
+
+    void sample();
+    int32_t getPivot();
+    void summarize(int from, int to, struct calCluster& c);
+protected:
+public:
+    Calibrator(Motor* lm, Motor* rm);
+    void haveControl();
+    void operate(); // method to invoke from the cyclic handler
+    bool isDone();
+    bool publish(); // derive the thresholds and publish them, false when the samples are not trustworthy
+    ~Calibrator();
+};
+
+#endif /* Calibrator_hpp */
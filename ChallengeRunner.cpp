@@ -7,6 +7,64 @@
 
 #include "app.h"
 #include "ChallengeRunner.hpp"
+#include "Observer.hpp"
+#include "StateMachine.hpp"
+#include "ColorClassifier.hpp"
+#include "StaticArena.hpp"
+#include "Actuator.hpp"
+
+// the slalom steps from 21 to 30 go on by the completion of the primitives
+static void slalomTurned(int8_t result) {
+    g_challenge_stepNo = 23;
+    stateMachine->sendTrigger(EVT_slalom_challenge);
+}
+
+static void slalomShifted(int8_t result) {
+    g_challenge_stepNo = 24;
+    stateMachine->sendTrigger(EVT_slalom_challenge);
+}
+
+static void slalomAligned(int8_t result) {
+    g_challenge_stepNo = 30;
+    stateMachine->sendTrigger(EVT_slalom_challenge);
+    g_challenge_stepNo = 40;
+}
+
+static void slalomCleared(int8_t result) {
+    g_challenge_stepNo = 80; // Observer drives on past the third obstacle
+}
+
+// so do the steps of the block area that turned until Observer saw an angle
+static void blackFound(int8_t result) {
+    g_challenge_stepNo = 192;
+    stateMachine->sendTrigger(EVT_block_challenge);
+}
+
+static void blackFaced(int8_t result) {
+    g_challenge_stepNo = 193; // Observer hands over to LineTracer
+}
+
+static void redCircled(int8_t result) {
+    g_challenge_stepNo = 201;
+    stateMachine->sendTrigger(EVT_block_challenge);
+    g_challenge_stepNo = 250;
+}
+
+static void yellowFaced(int8_t result) {
+    g_challenge_stepNo = 231; // Observer drives on to the block
+}
+
+static void garageFaced(int8_t result) {
+    g_challenge_stepNo = 286;
+    stateMachine->sendTrigger(EVT_block_challenge);
+    g_challenge_stepNo = 290;
+}
+
+static void garageTurned(int8_t result) {
+    g_challenge_stepNo = 261;
+    stateMachine->sendTrigger(EVT_block_challenge);
+    g_challenge_stepNo = 262;
+}
 
 ChallengeRunner::ChallengeRunner(Motor* lm, Motor* rm, Motor* tm, Motor* am) : LineTracer(lm, rm, tm){
     _debug(syslog(LOG_NOTICE, "%08u, ChallengeRunner constructor", clock->now()));
@@ -15,11 +73,14 @@ ChallengeRunner::ChallengeRunner(Motor* lm, Motor* rm, Motor* tm, Motor* am) : L
     armMotor =am;
     pwm_L = 20;
     pwm_R = 20;
-    pwmMode = 1;
-    count = 0;
-    procCount = 1;
+    profileL = new (arena("ChallengeRunner")) MotionProfile(PRF_ACC);
+    profileR = new (arena("ChallengeRunner")) MotionProfile(PRF_ACC);
+    profileL->reset(pwm_L);
+    profileR->reset(pwm_R);
     traceCnt = 0;
     frozen = false;
+    motion = new (arena("ChallengeRunner")) MotionPrimitive();
+    mpDone = NULL;
 }
 
 void ChallengeRunner::haveControl() {
@@ -33,49 +94,17 @@ void ChallengeRunner::operate() {
         //printf("Stop");
         pwm_L = 0;
         pwm_R = 0;
+        profileL->reset(0);
+        profileR->reset(0);
 
+    }else if (motion->isActive()){
+        runPrimitive();
     }else{
-        if (pwmMode != Mode_speed_constant){
-            if (++count && count == procCount){
-                switch (pwmMode) {
-                    case Mode_speed_increaseL:
-                        ++pwm_L;
-                        break;
-                    case Mode_speed_decreaseL:
-                        --pwm_L;
-                        break;
-                    case Mode_speed_increaseR:
-                        ++pwm_R;
-                        break;
-                    case Mode_speed_decreaseR:
-                        --pwm_R;
-                        break;
-                    case Mode_speed_increaseLR:
-                        ++pwm_L;
-                        ++pwm_R;
-                        break;
-                    case Mode_speed_decreaseLR:
-                        --pwm_L;
-                        --pwm_R;
-                        break;
-                    case Mode_speed_incrsLdcrsR:
-                        ++pwm_L;
-                        --pwm_R;
-                        break;
-                    case Mode_speed_incrsRdcrsL:
-                        --pwm_L;
-                        ++pwm_R;
-                        break;
-                    default:
-                        break;
-                }
-                count = 0; //初期化
-            }
-        }
+        pwm_L = profileL->update(PERIOD_NAV_TSK / 1000);
+        pwm_R = profileR->update(PERIOD_NAV_TSK / 1000);
     }
     
-    leftMotor->setPWM(pwm_L);
-    rightMotor->setPWM(pwm_R);
+    actuator->drive(this, pwm_L, pwm_R);
 
     // if (++traceCnt && traceCnt > 50) {
     //     printf(",pwm_L=%d, pwm_R=%d, count=%d, procCount=%d\n", pwm_L,pwm_R,count,procCount);
@@ -120,23 +149,19 @@ void ChallengeRunner::runChallenge() {
             setPwmLR(15,3,Mode_speed_constant,1);
             break;
         case 21:
-            rest(300);
-            setPwmLR(-10,10,Mode_speed_constant,1);
+            turnTo(-45, 10, slalomTurned);
             break;
         case 22:
-            rest(300);
-            setPwmLR(10,-10,Mode_speed_constant,1);
+            turnTo(-55, 10, slalomTurned);
             break;  
         case 23:
-            rest(300);
-            setPwmLR(30,30,Mode_speed_constant,1);
+            // across to the side by 120 or 127 mm at -45 or -55 degree
+            driveDistance((observer->getRoute() == 1) ? 170 : 155, 30, slalomShifted);
             break; 
         case 24:
-            rest(300);
-            setPwmLR(10,-10,Mode_speed_constant,1);
+            turnTo(observer->getLatchedDegree() + ((observer->getRoute() == 1) ? -2 : 2), 10, slalomAligned);
             break;
         case 30:
-            rest(300);
             setPwmLR(30,30,Mode_speed_constant,1);
             break;
         case 40:
@@ -170,13 +195,8 @@ void ChallengeRunner::runChallenge() {
             break;
         case 71:
             rest(300);
-            if (_LEFT == 1){
-                setPwmLR(-12,18,Mode_speed_constant,1);
-                clock->sleep(1000);
-            }else{
-                setPwmLR(18,-12,Mode_speed_constant,1);
-                clock->sleep(1000);
-            }
+            // the pivot of PWM 12 and 18 until Observer saw 65 degree
+            turnTo(observer->getAzimuth() - _EDGE * 65, 15, slalomCleared);
             break;
         case 80:
             if (_LEFT == 1){
@@ -236,21 +256,17 @@ void ChallengeRunner::runChallenge() {
             break;
         case 190:
             rest(900);
-            if (_LEFT == 1){
-                setPwmLR(50,-50,Mode_speed_constant,1);
-            }else{
-                setPwmLR(-50,50,Mode_speed_constant,1);
-            }
-            //clock->sleep(680);
-            //rest(900);
+            // off the black line the robot stands on and onto the one that leads down, by 80 degree at most
+            stopOnColor(CLS_BLACK, 40);
+            turnTo(observer->getAzimuth() + _EDGE * 80, 50, blackFound);
+            break;
+        case 192:
+            turnTo(observer->getAzimuth() + _EDGE * 25, 50, blackFaced);
             break;
         case 200:
             rest(600);
-            if (_LEFT == 1){
-                setPwmLR(10,0,Mode_speed_constant,1);
-            }else{
-                setPwmLR(0,10,Mode_speed_constant,1);
-            }
+            // pivot on the inner wheel by 93 degree
+            arc(_EDGE * (int32_t)(WHEEL_TREAD / 2), 93, 10, redCircled);
             break;
         case 201:
             setPwmLR(30,30,Mode_speed_constant,1);
@@ -267,14 +283,10 @@ void ChallengeRunner::runChallenge() {
             break;
         case 230:
             rest(300);
-            if (_LEFT == 1){
-                setPwmLR(-9,30,Mode_speed_constant,1);
-            }else{
-                setPwmLR(30,-9,Mode_speed_constant,1);
-            }
+            // toward the block, 93 degree off the heading the black line was left at
+            turnTo(observer->getLatchedDegree() - _EDGE * 93, 30, yellowFaced);
             break;
         case 231:
-            rest(300);
             setPwmLR(30,30,Mode_speed_constant,1);
             break;
         case 240:
@@ -288,11 +300,8 @@ void ChallengeRunner::runChallenge() {
             }
             break;
         case 260:
-            if (_LEFT == 1){
-                setPwmLR(4,30,Mode_speed_constant,1);
-            }else{
-                setPwmLR(30,4,Mode_speed_constant,1);
-            }
+            // the circle PWM 4 and 30 drove, by 140 degree from the red circle and 100 from the others
+            arc(-_EDGE * 98, (observer->getRoute() == 2) ? 140 : 100, 30, garageTurned);
             break;
          case 261:
             if (_LEFT == 1){
@@ -319,6 +328,10 @@ void ChallengeRunner::runChallenge() {
                 setPwmLR(-7,7,Mode_speed_constant,1);
             }
             break;
+        case 285:
+            // on with the pivot by 27 degree once the sonar sees the back of the garage
+            turnTo(observer->getAzimuth() + _EDGE * 27, 7, garageFaced);
+            break;
         case 286:
             setPwmLR(18,18,Mode_speed_constant,1);
             break;
@@ -333,11 +346,72 @@ void ChallengeRunner::runChallenge() {
 
 //　左右の車輪に駆動にそれぞれ値を指定する
 void ChallengeRunner::setPwmLR(int p_L,int p_R,int mode,int proc_count) {
+    motion->cancel(); // open-loop from here, without calling back
     pwm_L = p_L;
     pwm_R = p_R;
-    pwmMode = mode;
-    procCount = proc_count;
-    count = 0;
+    // the ramping modes gain or lose a PWM every proc_count cycles for as long as the step lasts
+    int8_t dirL = 0, dirR = 0;
+    switch (mode) {
+        case Mode_speed_increaseL:  dirL =  1;            break;
+        case Mode_speed_decreaseL:  dirL = -1;            break;
+        case Mode_speed_increaseR:  dirR =  1;            break;
+        case Mode_speed_decreaseR:  dirR = -1;            break;
+        case Mode_speed_increaseLR: dirL =  1; dirR =  1; break;
+        case Mode_speed_decreaseLR: dirL = -1; dirR = -1; break;
+        case Mode_speed_incrsLdcrsR: dirL =  1; dirR = -1; break;
+        case Mode_speed_incrsRdcrsL: dirL = -1; dirR =  1; break;
+        default: break;
+    }
+    profileL->reset(p_L);
+    profileR->reset(p_R);
+    profileL->setRate(1, proc_count * PERIOD_NAV_TSK / 1000);
+    profileR->setRate(1, proc_count * PERIOD_NAV_TSK / 1000);
+    if (dirL != 0) profileL->setTarget(dirL * 100);
+    if (dirR != 0) profileR->setTarget(dirR * 100);
+}
+
+void ChallengeRunner::driveDistance(int32_t mm, int8_t pwm, motionCallback cb) {
+    mpDone = cb;
+    motion->drive(mm, pwm, observer->getDistance(), observer->getAzimuth());
+    _debug(syslog(LOG_NOTICE, "%08u, ChallengeRunner drives %d mm", clock->now(), mm));
+}
+
+void ChallengeRunner::turnTo(int16_t degree, int8_t pwm, motionCallback cb) {
+    mpDone = cb;
+    motion->turnTo(degree, pwm, observer->getAzimuth());
+    _debug(syslog(LOG_NOTICE, "%08u, ChallengeRunner turns to %d degree", clock->now(), degree));
+}
+
+void ChallengeRunner::arc(int32_t radius, int16_t degree, int8_t pwm, motionCallback cb) {
+    mpDone = cb;
+    motion->arc(radius, degree, pwm, observer->getAzimuth());
+    _debug(syslog(LOG_NOTICE, "%08u, ChallengeRunner follows an arc of %d mm by %d degree", clock->now(), radius, degree));
+}
+
+// after is in milimeter for driveDistance() and in degree for turnTo() and arc()
+void ChallengeRunner::stopOnColor(uint8_t cls, int32_t after) {
+    motion->stopOnColor(cls, after);
+}
+
+bool ChallengeRunner::isMoving() {
+    return motion->isActive();
+}
+
+// stop where the primitive ended, the callback may start the next one right away
+void ChallengeRunner::runPrimitive() {
+    int16_t l, r;
+    if (motion->step(observer->getDistance(), observer->getAzimuth(), g_color, l, r)) {
+        pwm_L = l;
+        pwm_R = r;
+        return;
+    }
+    pwm_L = pwm_R = 0;
+    profileL->reset(0);
+    profileR->reset(0);
+    _debug(syslog(LOG_NOTICE, "%08u, ChallengeRunner primitive ended with %d", clock->now(), motion->getResult()));
+    motionCallback cb = mpDone;
+    mpDone = NULL;
+    if (cb != NULL) cb(motion->getResult());
 }
 
 // rest for a while
@@ -10,12 +10,20 @@
 
 #include "aflac_common.hpp"
 #include "LineTracer.hpp"
+#include "MotionPrimitive.hpp"
+
+// invoked from the cyclic handler once a primitive has ended, with MP_DONE or MP_COLOR
+typedef void (*motionCallback)(int8_t result);
 
 class ChallengeRunner : public LineTracer {
 private:
-    int8_t pwmMode;
-    int16_t count, procCount, traceCnt;
+    int16_t traceCnt;
+    MotionProfile* profileL;    // open-loop ramps of each wheel by setPwmLR
+    MotionProfile* profileR;
     Motor* armMotor;
+    MotionPrimitive* motion;
+    motionCallback mpDone;
+    void runPrimitive();
 protected:
 public:
     ChallengeRunner();
@@ -24,6 +32,12 @@ public:
     void operate(); // method to invoke from the cyclic handler
     void runChallenge();
     void setPwmLR(int p_L,int p_R,int mode, int proc_count);
+    // closed-loop primitives, slowing down toward the target and stopping there
+    void driveDistance(int32_t mm, int8_t pwm, motionCallback cb = NULL); // backward if mm < 0
+    void turnTo(int16_t degree, int8_t pwm, motionCallback cb = NULL);    // pivot to an absolute heading
+    void arc(int32_t radius, int16_t degree, int8_t pwm, motionCallback cb = NULL); // radius > 0 to the right
+    void stopOnColor(uint8_t cls, int32_t after = 0); // end the next primitive early on this colour class
+    bool isMoving();
     void rest(int16_t rest_time);
     int8_t getPwmL();
     int8_t getPwmR();
@@ -0,0 +1,57 @@
+//
+//  ColorClassifier.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "ColorClassifier.hpp"
+#include "ParamStore.hpp"
+#include <stdint.h>
+#include <string.h>
+
+static_assert(PRM_CLR_GREEN - PRM_CLR_BLACK == NUM_CLASSES - 1, "CLR_ centroids must follow the order of CLS_");
+
+int32_t clr_distance(int r, int g, int b, uint32_t centroid) {
+    int cr = CLR_GET_R(centroid), cg = CLR_GET_G(centroid), cb = CLR_GET_B(centroid);
+    int32_t dl  = (r + g + b) - (cr + cg + cb);
+    int32_t do1 = (r - g) - (cr - cg);
+    int32_t do2 = (r + g - 2 * b) - (cr + cg - 2 * cb);
+    return dl * dl + CLR_CHROMA_WEIGHT * (do1 * do1 + do2 * do2);
+}
+
+ColorClassifier::ColorClassifier() {
+    memset(lut, CLS_UNKNOWN, sizeof(lut));
+}
+
+// label every cell by its nearest centroid, CLS_UNKNOWN when farther than reject (0 for no limit).
+// 32768 cells by NUM_CLASSES, so call this at startup or after calibration rather than in the cyclic handlers
+void ColorClassifier::build(const uint32_t* centroids, int32_t reject) {
+    const int half = 1 << CLR_LUT_SHIFT >> 1; // the center of a cell
+    for (int qr = 0; qr < CLR_LUT_SIZE; qr++) {
+        for (int qg = 0; qg < CLR_LUT_SIZE; qg++) {
+            for (int qb = 0; qb < CLR_LUT_SIZE; qb++) {
+                int r = (qr << CLR_LUT_SHIFT) + half, g = (qg << CLR_LUT_SHIFT) + half, b = (qb << CLR_LUT_SHIFT) + half;
+                uint8_t cls = CLS_UNKNOWN;
+                int32_t best = INT32_MAX;
+                for (int i = 0; i < NUM_CLASSES; i++) {
+                    int32_t d = clr_distance(r, g, b, centroids[i]);
+                    if (d < best) {
+                        best = d;
+                        cls = i;
+                    }
+                }
+                lut[qr][qg][qb] = (reject > 0 && best > reject) ? CLS_UNKNOWN : cls;
+            }
+        }
+    }
+}
+
+void ColorClassifier::build() {
+    uint32_t centroids[NUM_CLASSES];
+    for (int i = 0; i < NUM_CLASSES; i++) centroids[i] = paramInt(PRM_CLR_BLACK + i);
+    build(centroids, paramInt(PRM_CLR_REJECT));
+}
+
+ColorClassifier::~ColorClassifier() {
+}
@@ -0,0 +1,73 @@
+//
+//  ColorClassifier.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef ColorClassifier_hpp
+#define ColorClassifier_hpp
+
+// Note: this header is shared with the host tools and must not depend on ev3api
+#include "aflac_common.hpp"
+
+// colour classes, in the order of their centroids CLR_BLACK to CLR_GREEN in PARAM_LIST
+#define CLS_BLACK       0
+#define CLS_GRAY        1  // edge of a line, or anything dim
+#define CLS_WHITE       2
+#define CLS_BLUE        3
+#define CLS_RED         4
+#define CLS_YELLOW      5
+#define CLS_GREEN       6
+#define NUM_CLASSES     7
+#define CLS_UNKNOWN     0xFF // farther than CLR_REJECT from every centroid
+
+#define CLS_NAME_LEN    12
+const char className[][CLS_NAME_LEN] = {
+    "black",
+    "gray",
+    "white",
+    "blue",
+    "red",
+    "yellow",
+    "green"
+};
+
+// FIR-filtered raw RGB is clamped to 0-255 and quantized by CLR_LUT_SHIFT bits
+#define CLR_LUT_BITS    5
+#define CLR_LUT_SIZE    (1 << CLR_LUT_BITS)
+#define CLR_LUT_SHIFT   (8 - CLR_LUT_BITS)
+
+#define CLR_GET_R(c)    ((c) & 0xFF)
+#define CLR_GET_G(c)    (((c) >> 8) & 0xFF)
+#define CLR_GET_B(c)    (((c) >> 16) & 0xFF)
+
+inline int clr_quantize(uint16_t v) {
+    return ((v > 255) ? 255 : v) >> CLR_LUT_SHIFT;
+}
+
+// squared distance in the opponent colour space L = r+g+b, O1 = r-g, O2 = r+g-2b,
+// where the chromatic axes weigh CLR_CHROMA_WEIGHT times as much as the lightness
+// as the lightness changes with the distance of the sensor from the mat
+#define CLR_CHROMA_WEIGHT 4
+int32_t clr_distance(int r, int g, int b, uint32_t centroid);
+
+class ColorClassifier {
+private:
+    uint8_t lut[CLR_LUT_SIZE][CLR_LUT_SIZE][CLR_LUT_SIZE];
+protected:
+public:
+    ColorClassifier();
+    void build(const uint32_t* centroids, int32_t reject);
+    void build(); // from the parameters CLR_BLACK to CLR_GREEN and CLR_REJECT
+    // one memory load per call
+    inline uint8_t classify(const rgb_raw_t& c) const {
+        return lut[clr_quantize(c.r)][clr_quantize(c.g)][clr_quantize(c.b)];
+    }
+    inline uint8_t getCell(int qr, int qg, int qb) const {
+        return lut[qr][qg][qb];
+    }
+    ~ColorClassifier();
+};
+
+#endif /* ColorClassifier_hpp */
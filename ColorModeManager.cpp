@@ -0,0 +1,100 @@
+//
+//  ColorModeManager.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "app.h"
+#include "ColorModeManager.hpp"
+#include "ParamStore.hpp"
+
+ColorModeManager::ColorModeManager(ColorSensor* cs, int8_t m) {
+    _debug(syslog(LOG_NOTICE, "%08u, ColorModeManager constructor", clock->now()));
+    sensor = cs;
+    mode = m;
+    hwMode = CSM_NONE;
+    rgb.r = rgb.g = rgb.b = 0;
+    brightness = 0;
+    switches = switchUs = 0;
+    calibrate();
+}
+
+int32_t ColorModeManager::weigh(const rgb_raw_t& c) {
+    return (c.r * BRT_W_R + c.g * BRT_W_G + c.b * BRT_W_B) / (BRT_W_R + BRT_W_G + BRT_W_B);
+}
+
+void ColorModeManager::calibrate() {
+    paramsVersion = g_paramsVersion;
+    int32_t k = paramInt(PRM_RGB_BLACK);
+    black.r = k & 0xFF;
+    black.g = (k >> 8) & 0xFF;
+    black.b = (k >> 16) & 0xFF;
+    k = paramInt(PRM_RGB_WHITE);
+    white.r = k & 0xFF;
+    white.g = (k >> 8) & 0xFF;
+    white.b = (k >> 16) & 0xFF;
+    blackW = weigh(black);
+    whiteW = weigh(white);
+    if (whiteW <= blackW) whiteW = blackW + 1;
+    lightBlack = paramInt(PRM_LIGHT_BLACK);
+    lightWhite = paramInt(PRM_LIGHT_WHITE);
+    if (lightWhite <= lightBlack) lightWhite = lightBlack + 1;
+}
+
+void ColorModeManager::setMode(int8_t m) {
+    mode = m;
+}
+
+void ColorModeManager::sample() {
+    if (paramsVersion != g_paramsVersion) calibrate();
+    SYSUTM start = 0, end = 0;
+    bool switching = (hwMode != mode);
+    if (switching) get_utm(&start);
+
+    if (mode == CSM_RGB) {
+        sensor->getRawColor(rgb);
+        int32_t b = lightBlack + (weigh(rgb) - blackW) * (lightWhite - lightBlack) / (whiteW - blackW);
+        brightness = (b < 0) ? 0 : (b > 100) ? 100 : b;
+    } else {
+        brightness = sensor->getBrightness();
+        int32_t t = brightness - lightBlack, span = lightWhite - lightBlack;
+        int32_t r = black.r + (white.r - black.r) * t / span;
+        int32_t g = black.g + (white.g - black.g) * t / span;
+        int32_t b = black.b + (white.b - black.b) * t / span;
+        rgb.r = (r < 0) ? 0 : r;
+        rgb.g = (g < 0) ? 0 : g;
+        rgb.b = (b < 0) ? 0 : b;
+    }
+
+    if (switching) {
+        get_utm(&end);
+        if (hwMode != CSM_NONE) {
+            switches++;
+            switchUs += end - start;
+            _debug(syslog(LOG_NOTICE, "%08u, ColorModeManager switched to mode %d in %u us", clock->now(), mode, end - start));
+        }
+        hwMode = mode;
+    }
+}
+
+void ColorModeManager::getRawColor(rgb_raw_t& c) {
+    c = rgb;
+}
+
+int16_t ColorModeManager::getBrightness() {
+    return brightness;
+}
+
+uint32_t ColorModeManager::getSwitches() {
+    return switches;
+}
+
+void ColorModeManager::report() {
+    syslog(LOG_NOTICE, "%08u, ColorModeManager: %u mode switches after the first read, %u us in them",
+           clock->now(), switches, switchUs);
+}
+
+ColorModeManager::~ColorModeManager() {
+    _debug(syslog(LOG_NOTICE, "%08u, ColorModeManager destructor", clock->now()));
+}
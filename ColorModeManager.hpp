@@ -0,0 +1,52 @@
+//
+//  ColorModeManager.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef ColorModeManager_hpp
+#define ColorModeManager_hpp
+
+#include "aflac_common.hpp"
+
+#define CSM_NONE        -1  // before the first read
+#define CSM_RGB         0   // raw RGB is read, the reflected light derived from it
+#define CSM_REFLECT     1   // the reflected light is read, raw RGB derived from it as a gray
+
+/*
+ * The one reader of the colour sensor. Each read from a mode other than the one the sensor is in
+ * makes the driver switch modes, which takes tens of miliseconds and stalls the observer, so
+ * sample() reads once a cycle in the mode set by setMode() and the getters answer from that read.
+ * The other quantity comes from a linear model through the black and white levels of the
+ * parameters, RGB_BLACK and RGB_WHITE in raw RGB taken to LIGHT_BLACK and LIGHT_WHITE in
+ * reflected light, with the raw channels weighted by BRT_W_R, BRT_W_G and BRT_W_B.
+ * The model follows the parameters, so the startup calibration carries over to it; without it the
+ * model stays on the raw RGB defaults, which are kept apart from the centroids of ColorClassifier.
+ */
+class ColorModeManager {
+private:
+    ColorSensor* sensor;
+    int8_t      mode, hwMode;       // asked for and in effect
+    rgb_raw_t   rgb;
+    int16_t     brightness;
+    rgb_raw_t   black, white;
+    int32_t     blackW, whiteW, lightBlack, lightWhite;
+    uint32_t    paramsVersion;
+    uint32_t    switches, switchUs; // mode changes after the first read and the time they took
+
+    int32_t weigh(const rgb_raw_t& c);
+    void calibrate();
+protected:
+public:
+    ColorModeManager(ColorSensor* cs, int8_t m = CSM_RGB);
+    void setMode(int8_t m);     // takes effect on the next sample()
+    void sample();              // read once at the top of every observer cycle
+    void getRawColor(rgb_raw_t& c);
+    int16_t getBrightness();    // 0 to 100 as ColorSensor::getBrightness()
+    uint32_t getSwitches();
+    void report();
+    ~ColorModeManager();
+};
+
+#endif /* ColorModeManager_hpp */
@@ -0,0 +1,190 @@
+//
+//  CommandParser.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "CommandParser.hpp"
+#include "ParamStore.hpp"
+
+#define PH_SYNC     0
+#define PH_SEQ      1
+#define PH_CMD      2
+#define PH_LEN      3
+#define PH_PAYLOAD  4
+#define PH_CRC      5
+
+static uint32_t get_u32(const uint8_t* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+CommandParser::CommandParser() {
+    errors = 0;
+    framed = false;
+    reset();
+}
+
+void CommandParser::reset() {
+    phase = PH_SYNC;
+    index = 0;
+    crc = 0;
+    legacy = false;
+}
+
+// feed one byte, returns true when a frame is complete and valid.
+// never blocks nor allocates, a broken frame is dropped and the parser resyncs on the next CMD_SYNC
+// without taking the bytes in between as single-byte commands
+bool CommandParser::push(uint8_t c) {
+    switch (phase) {
+        case PH_SYNC:
+            legacy = false;
+            if (c == CMD_SYNC) {
+                phase = PH_SEQ;
+                crc = 0;
+                framed = true;
+            } else if (!framed && (c == CMD_START_R || c == CMD_START_r || c == CMD_START_L || c == CMD_START_l ||
+                       c == CMD_STOP_S || c == CMD_STOP_s)) {
+                frame.seq = 0;
+                frame.cmd = c;
+                frame.len = 0;
+                legacy = true;
+                return true;
+            }
+            break;
+        case PH_SEQ:
+            frame.seq = c;
+            crc = crc8(crc, c);
+            phase = PH_CMD;
+            break;
+        case PH_CMD:
+            frame.cmd = c;
+            crc = crc8(crc, c);
+            phase = PH_LEN;
+            break;
+        case PH_LEN:
+            if (c > CMD_MAX_PAYLOAD) {
+                errors++;
+                reset();
+                break;
+            }
+            frame.len = c;
+            crc = crc8(crc, c);
+            index = 0;
+            phase = (c == 0) ? PH_CRC : PH_PAYLOAD;
+            break;
+        case PH_PAYLOAD:
+            frame.payload[index++] = c;
+            crc = crc8(crc, c);
+            if (index == frame.len) phase = PH_CRC;
+            break;
+        case PH_CRC:
+            phase = PH_SYNC;
+            if (c == crc) return true;
+            errors++;
+            break;
+        default:
+            reset();
+            break;
+    }
+    return false;
+}
+
+const struct cmdFrame& CommandParser::getFrame() {
+    return frame;
+}
+
+bool CommandParser::isLegacy() {
+    return legacy;
+}
+
+uint32_t CommandParser::getErrors() {
+    return errors;
+}
+
+uint8_t CommandParser::crc8(uint8_t crc, uint8_t c) {
+    crc ^= c;
+    for (int i = 0; i < 8; i++) {
+        crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+// buf must hold CMD_MAX_FRAME bytes, returns the number of bytes encoded
+int CommandParser::encode(const struct cmdFrame& f, uint8_t* buf) {
+    int n = 0;
+    uint8_t crc = 0;
+    buf[n++] = CMD_SYNC;
+    buf[n++] = f.seq;
+    buf[n++] = f.cmd;
+    buf[n++] = f.len;
+    for (int i = 0; i < f.len; i++) buf[n++] = f.payload[i];
+    for (int i = 1; i < n; i++) crc = crc8(crc, buf[i]);
+    buf[n++] = crc;
+    return n;
+}
+
+// execute a command and build its acknowledgement.
+// returns the event for the state machine to receive, or -1 if none
+int cmd_execute(const struct cmdFrame& req, struct cmdFrame& ack) {
+    int event = -1, id;
+    uint8_t status = CMD_STS_OK;
+    uint32_t value = 0;
+
+    switch (req.cmd) {
+        case CMD_START_R:
+        case CMD_START_r:
+            event = EVT_cmdStart_R;
+            break;
+        case CMD_START_L:
+        case CMD_START_l:
+            event = EVT_cmdStart_L;
+            break;
+        case CMD_STOP_S:
+        case CMD_STOP_s:
+            event = EVT_cmdStop;
+            break;
+        case CMD_GET_PARAM:
+            if (req.len != 4) {
+                status = CMD_STS_BAD_LENGTH;
+            } else if ((id = paramStore->find(get_u32(req.payload))) < 0) {
+                status = CMD_STS_UNKNOWN_KEY;
+            } else {
+                value = paramStore->get(id);
+            }
+            break;
+        case CMD_SET_PARAM:
+            if (req.len != 8) {
+                status = CMD_STS_BAD_LENGTH;
+            } else if ((id = paramStore->find(get_u32(req.payload))) < 0) {
+                status = CMD_STS_UNKNOWN_KEY;
+            } else if (!paramStore->check(id, get_u32(req.payload + 4))) {
+                status = CMD_STS_BAD_VALUE;
+                value = paramStore->get(id);
+            } else {
+                paramStore->set(id, get_u32(req.payload + 4));
+                value = paramStore->get(id);
+            }
+            break;
+        case CMD_REPORT:
+            if (req.len != 0) status = CMD_STS_BAD_LENGTH; // the report itself is the job of the caller
+            break;
+        default:
+            status = CMD_STS_BAD_COMMAND;
+            break;
+    }
+    ack.seq = req.seq;
+    ack.cmd = CMD_ACK;
+    ack.len = 6;
+    ack.payload[0] = req.cmd;
+    ack.payload[1] = status;
+    put_u32(ack.payload + 2, value);
+    return event;
+}
@@ -0,0 +1,67 @@
+//
+//  CommandParser.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef CommandParser_hpp
+#define CommandParser_hpp
+
+// Note: this header is shared with the host tools and must not depend on ev3api
+#include "aflac_common.hpp"
+
+/**
+ * Binary command protocol over the Bluetooth serial port
+ *   SYNC(0xA5) seq cmd len payload[len] crc
+ * crc is CRC-8 (polynomial 0x07) of seq, cmd, len and payload.
+ * Every frame is acknowledged by CMD_ACK with the same seq and the payload
+ *   command status value(4)
+ * Multi-byte values are little endian. The single bytes CMD_START_* and CMD_STOP_*
+ * outside a frame are accepted as commands without acknowledgement, until the first CMD_SYNC;
+ * from then on they are only taken as the cmd of a frame, so that the rest of a broken frame
+ * is never mistaken for one.
+ */
+#define CMD_SYNC            0xA5
+#define CMD_MAX_PAYLOAD     8
+#define CMD_MAX_FRAME       (CMD_MAX_PAYLOAD + 5)
+#define CMD_GET_PARAM       'G' // payload: key(4), value returned in the ack
+#define CMD_SET_PARAM       'P' // payload: key(4) value(4)
+#define CMD_REPORT          'M' // no payload, the stack usage and the motor commands are printed to syslog
+#define CMD_ACK             'A'
+
+#define CMD_STS_OK          0
+#define CMD_STS_UNKNOWN_KEY 1
+#define CMD_STS_BAD_COMMAND 2
+#define CMD_STS_BAD_LENGTH  3
+#define CMD_STS_BAD_VALUE   4   // outside the bounds of the parameter, or not a number of its type
+#define CMD_STS_BUSY        5   // the events of the previous commands are still to be dispatched
+
+struct cmdFrame {
+    uint8_t seq;
+    uint8_t cmd;
+    uint8_t len;
+    uint8_t payload[CMD_MAX_PAYLOAD];
+};
+
+class CommandParser {
+private:
+    uint8_t  phase, index, crc;
+    uint32_t errors;
+    struct cmdFrame frame;
+    bool     legacy;
+    bool     framed; // a CMD_SYNC has been seen, single bytes are no longer commands
+public:
+    CommandParser();
+    void reset();
+    bool push(uint8_t c);
+    const struct cmdFrame& getFrame();
+    bool isLegacy();
+    uint32_t getErrors();
+    static uint8_t crc8(uint8_t crc, uint8_t c);
+    static int encode(const struct cmdFrame& f, uint8_t* buf);
+};
+
+int cmd_execute(const struct cmdFrame& req, struct cmdFrame& ack);
+
+#endif /* CommandParser_hpp */
@@ -0,0 +1,187 @@
+//
+//  CourseFile.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "CourseFile.hpp"
+#include <stdio.h>
+#include <string.h>
+#if defined(MAKE_HOST)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+// CRC-32 (IEEE 802.3) with a 16 entry table to keep both the table and the loop small.
+// pass the previous result as crc to continue over another block
+uint32_t cf_crc32(const void* data, size_t len, uint32_t crc) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    };
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) {
+        crc = table[(crc ^ p[i]) & 0x0F] ^ (crc >> 4);
+        crc = table[(crc ^ (p[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+// FNV-1a, the key of a parameter name
+uint32_t cf_hash(const char* name) {
+    uint32_t h = 2166136261UL;
+    while (*name) {
+        h ^= (uint8_t)*name++;
+        h *= 16777619UL;
+    }
+    return h;
+}
+
+CourseFile::CourseFile() {
+    data = NULL;
+    size = 0;
+    sections = NULL;
+    params = NULL;
+    features = NULL;
+    numSections = numParams = numFeatures = 0;
+}
+
+// the whole file is read by a single fread, or mapped on the host
+bool CourseFile::load(const char* filename) {
+    unload();
+#if defined(MAKE_HOST)
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return false;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return false;
+    data = (const uint8_t*)map;
+    size = st.st_size;
+#else
+    FILE* fp = fopen(filename, "rb");
+    if (fp == NULL) return false;
+    size = fread(image.bytes, 1, sizeof(image.bytes), fp);
+    fclose(fp);
+    data = image.bytes;
+#endif
+    if (!validate()) {
+        unload();
+        return false;
+    }
+    return true;
+}
+
+bool CourseFile::validate() {
+    if (size < sizeof(struct cfHeader)) return false;
+    const struct cfHeader* h = (const struct cfHeader*)data;
+    if (h->magic != CF_MAGIC || h->version < 1 || h->version > CF_VERSION) return false;
+    int nf = (h->version >= 2) ? h->numFeatures : 0;
+    if (h->numSections > CF_MAX_SECTIONS || h->numParams > CF_MAX_PARAMS || nf > CF_MAX_FEATURES) return false;
+    size_t payload = h->numSections * sizeof(struct cfSection) + h->numParams * sizeof(struct cfParam) +
+                     nf * sizeof(struct cfFeature);
+    if (size != sizeof(struct cfHeader) + payload) return false;
+    if (cf_crc32(data + sizeof(struct cfHeader), payload) != h->crc) return false;
+    sections = (const struct cfSection*)(data + sizeof(struct cfHeader));
+    params = (const struct cfParam*)(sections + h->numSections);
+    features = (const struct cfFeature*)(params + h->numParams);
+    numSections = h->numSections;
+    numParams = h->numParams;
+    numFeatures = nf;
+    return true;
+}
+
+void CourseFile::unload() {
+#if defined(MAKE_HOST)
+    if (data != NULL) munmap((void*)data, size);
+#endif
+    data = NULL;
+    size = 0;
+    sections = NULL;
+    params = NULL;
+    features = NULL;
+    numSections = numParams = numFeatures = 0;
+}
+
+int CourseFile::getNumSections() {
+    return numSections;
+}
+
+const struct cfSection* CourseFile::getSection(int index) {
+    return (index >= 0 && index < numSections) ? &sections[index] : NULL;
+}
+
+int CourseFile::getNumParams() {
+    return numParams;
+}
+
+const struct cfParam* CourseFile::getParam(int index) {
+    return (index >= 0 && index < numParams) ? &params[index] : NULL;
+}
+
+// binary search on the sorted keys
+bool CourseFile::getParam(uint32_t key, int32_t& value) {
+    int lo = 0, hi = numParams - 1;
+    while (lo <= hi) {
+        int mid = (lo + hi) / 2;
+        if (params[mid].key == key) {
+            value = params[mid].value;
+            return true;
+        } else if (params[mid].key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return false;
+}
+
+int32_t CourseFile::getParam(const char* name, int32_t defaultValue) {
+    int32_t value;
+    return getParam(cf_hash(name), value) ? value : defaultValue;
+}
+
+int CourseFile::getNumFeatures() {
+    return numFeatures;
+}
+
+const struct cfFeature* CourseFile::getFeature(int index) {
+    return (index >= 0 && index < numFeatures) ? &features[index] : NULL;
+}
+
+// params must be sorted by key, features by start
+bool CourseFile::write(const char* filename, const struct cfSection* s, int ns, const struct cfParam* p, int np,
+                       const struct cfFeature* f, int nf) {
+    if (ns > CF_MAX_SECTIONS || np > CF_MAX_PARAMS || nf > CF_MAX_FEATURES) return false;
+    struct cfHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = CF_MAGIC;
+    h.version = CF_VERSION;
+    h.numSections = ns;
+    h.numParams = np;
+    h.numFeatures = nf;
+    h.crc = cf_crc32(s, ns * sizeof(struct cfSection));
+    h.crc = cf_crc32(p, np * sizeof(struct cfParam), h.crc);
+    h.crc = cf_crc32(f, nf * sizeof(struct cfFeature), h.crc);
+
+    FILE* fp = fopen(filename, "wb");
+    if (fp == NULL) return false;
+    bool ok = fwrite(&h, sizeof(h), 1, fp) == 1;
+    if (ns > 0) ok = ok && fwrite(s, sizeof(struct cfSection), ns, fp) == (size_t)ns;
+    if (np > 0) ok = ok && fwrite(p, sizeof(struct cfParam), np, fp) == (size_t)np;
+    if (nf > 0) ok = ok && fwrite(f, sizeof(struct cfFeature), nf, fp) == (size_t)nf;
+    fclose(fp);
+    return ok;
+}
+
+CourseFile::~CourseFile() {
+    unload();
+}
@@ -0,0 +1,100 @@
+//
+//  CourseFile.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef CourseFile_hpp
+#define CourseFile_hpp
+
+// Note: this header is shared with the host tools and must not depend on ev3api
+#include <stdint.h>
+#include <stddef.h>
+
+#define CF_MAGIC        0x4D434641  // "AFCM" in little endian
+#define CF_VERSION      2           // 2 adds the features, files of version 1 are still read
+#define CF_MAX_SECTIONS 40
+#define CF_MAX_PARAMS   64
+#define CF_MAX_FEATURES 16
+#define CF_CURV_SCALE   10000       // curvature is stored multiplied by this
+
+#if defined(MAKE_SIM) || defined(MAKE_HOST)
+#define COURSE_FILE     "course.bin"
+#else
+#define COURSE_FILE     "/ev3rt/res/course.bin"
+#endif
+
+// file layout: cfHeader, numSections * cfSection, numParams * cfParam, numFeatures * cfFeature,
+// all little endian
+struct cfHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t numSections;
+    uint16_t numParams;
+    uint16_t numFeatures; // reserved and 0 in version 1
+    uint32_t crc;       // CRC-32 of everything following the header
+};
+
+struct cfSection {
+    char     id[6];     // starts with B, R or L as courseMap
+    uint16_t reserved;
+    int32_t  sectionEnd;
+    int32_t  curvature; // multiplied by CF_CURV_SCALE
+};
+
+struct cfParam {
+    uint32_t key;       // cf_hash() of the parameter name, sorted ascending
+    int32_t  value;
+};
+
+// stretch of the course where the line is of a colour the sensor can tell, a landmark for Localizer
+struct cfFeature {
+    int32_t  start;     // distance from the start in milimeter
+    int32_t  end;
+    uint8_t  color;     // CLS_ of ColorClassifier
+    uint8_t  reserved[3];
+};
+
+// curvature as stored, rounded to the nearest, for the learned and the converted maps to agree
+inline int32_t cf_curvature(double c) {
+    return (int32_t)(c * CF_CURV_SCALE + (c >= 0.0 ? 0.5 : -0.5));
+}
+
+#define CF_MAX_SIZE (sizeof(struct cfHeader) + CF_MAX_SECTIONS * sizeof(struct cfSection) + \
+                     CF_MAX_PARAMS * sizeof(struct cfParam) + CF_MAX_FEATURES * sizeof(struct cfFeature))
+
+uint32_t cf_crc32(const void* data, size_t len, uint32_t crc = 0);
+uint32_t cf_hash(const char* name);
+
+class CourseFile {
+private:
+    union {
+        uint32_t align;
+        uint8_t  bytes[CF_MAX_SIZE];
+    } image;
+    const uint8_t*          data;
+    size_t                  size;
+    const struct cfSection* sections;
+    const struct cfParam*   params;
+    const struct cfFeature* features;
+    int                     numSections, numParams, numFeatures;
+    bool validate();
+    void unload();
+public:
+    CourseFile();
+    bool load(const char* filename);
+    int getNumSections();
+    const struct cfSection* getSection(int index);
+    int getNumParams();
+    const struct cfParam* getParam(int index);
+    bool getParam(uint32_t key, int32_t& value);
+    int32_t getParam(const char* name, int32_t defaultValue);
+    int getNumFeatures();
+    const struct cfFeature* getFeature(int index);
+    static bool write(const char* filename, const struct cfSection* s, int ns, const struct cfParam* p, int np,
+                      const struct cfFeature* f = NULL, int nf = 0);
+    ~CourseFile();
+};
+
+#endif /* CourseFile_hpp */
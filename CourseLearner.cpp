@@ -0,0 +1,185 @@
+//
+//  CourseLearner.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "app.h"
+#include "CourseLearner.hpp"
+#include "CourseFile.hpp"
+#include "ColorClassifier.hpp"
+#include <string.h>
+
+CourseLearner::CourseLearner() {
+    _debug(syslog(LOG_NOTICE, "%08u, CourseLearner constructor", clock->now()));
+    reset();
+}
+
+void CourseLearner::reset() {
+    numSections = 0;
+    finished = false;
+    sampleDL = sampleDR = 0.0;
+    secStart = secSum = 0.0;
+    secCnt = 0;
+    cusumPos = cusumNeg = 0.0;
+    posStart = posSum = negStart = negSum = 0.0;
+    posCnt = negCnt = 0;
+    numFeatures = 0;
+    runColor = pendColor = CLS_UNKNOWN;
+    runStart = pendStart = 0.0;
+    pendCnt = 0;
+}
+
+// to be invoked from Observer::operate() with the wheel increments of the tick
+void CourseLearner::update(double deltaDistL, double deltaDistR, double distance) {
+    if (finished) return;
+    sampleDL += deltaDistL;
+    sampleDR += deltaDistR;
+    double ds = (sampleDL + sampleDR) / 2.0;
+    if (ds < CL_SAMPLE_LEN) return;
+    // same definition as courseMap: pwm_R - pwm_L = forward * curvature on the left course
+    double c = _EDGE * (sampleDR - sampleDL) / ds;
+    sampleDL = sampleDR = 0.0;
+    addSample(c, distance);
+}
+
+// to be invoked from Observer::operate() with the classified colour of the tick.
+// a colour counts once it has held for LOC_CONFIRM samples, from where it was first seen
+void CourseLearner::mark(uint8_t color, double distance) {
+    if (finished) return;
+    uint8_t c = (color == CLS_BLUE || color == CLS_RED || color == CLS_YELLOW || color == CLS_GREEN) ? color : CLS_UNKNOWN;
+    if (c == runColor) {
+        pendCnt = 0;
+        return;
+    }
+    if (pendCnt == 0 || c != pendColor) {
+        pendColor = c;
+        pendStart = distance;
+        pendCnt = 0;
+    }
+    if (++pendCnt < LOC_CONFIRM) return;
+    closeRun(pendStart);
+    runColor = pendColor;
+    runStart = pendStart;
+    pendCnt = 0;
+}
+
+void CourseLearner::closeRun(double end) {
+    if (runColor == CLS_UNKNOWN || end - runStart < LOC_MIN_FEATURE) return;
+    if (numFeatures >= CF_MAX_FEATURES) {
+        _debug(syslog(LOG_NOTICE, "%08u, CourseLearner too many landmarks", clock->now()));
+        return;
+    }
+    struct cfFeature* f = &features[numFeatures++];
+    memset(f, 0, sizeof(*f));
+    f->start = (int32_t)runStart;
+    f->end = (int32_t)end;
+    f->color = runColor;
+}
+
+void CourseLearner::addSample(double c, double distance) {
+    if (secCnt == 0) {
+        secSum = c;
+        secCnt = 1;
+        return;
+    }
+    double mean = secSum / secCnt;
+    secSum += c;
+    secCnt++;
+
+    if (cusumPos == 0.0) { posStart = distance - CL_SAMPLE_LEN; posSum = 0.0; posCnt = 0; }
+    if (cusumNeg == 0.0) { negStart = distance - CL_SAMPLE_LEN; negSum = 0.0; negCnt = 0; }
+    cusumPos += c - mean - CL_CUSUM_DRIFT;
+    cusumNeg += mean - c - CL_CUSUM_DRIFT;
+    if (cusumPos < 0.0) cusumPos = 0.0;
+    if (cusumNeg < 0.0) cusumNeg = 0.0;
+    posSum += c; posCnt++;
+    negSum += c; negCnt++;
+
+    // the change started where the alarming statistic left zero:
+    // close the section there and carry the samples since then over to the new one
+    if (cusumPos > CL_CUSUM_THRESH) {
+        closeSection(posStart, secSum - posSum, secCnt - posCnt);
+        secStart = posStart; secSum = posSum; secCnt = posCnt;
+        cusumPos = cusumNeg = 0.0;
+    } else if (cusumNeg > CL_CUSUM_THRESH) {
+        closeSection(negStart, secSum - negSum, secCnt - negCnt);
+        secStart = negStart; secSum = negSum; secCnt = negCnt;
+        cusumPos = cusumNeg = 0.0;
+    }
+}
+
+void CourseLearner::closeSection(double end, double sum, int32_t cnt) {
+    double c = (cnt > 0) ? sum / cnt : 0.0;
+    if (fabs(c) < CL_STRAIGHT_MAX) c = 0.0;
+    if (numSections > 0) {
+        struct courseSection* prev = &sections[numSections - 1];
+        int32_t prevStart = (numSections > 1) ? sections[numSections - 2].sectionEnd : 0;
+        double prevLen = prev->sectionEnd - prevStart;
+        double len = end - prev->sectionEnd;
+        // merge short transients and consecutive straights into the previous section
+        if (len < CL_MIN_SECTION || (c == 0.0 && prev->curvature == 0.0)) {
+            prev->curvature = (prev->curvature * prevLen + c * len) / (prevLen + len);
+            if (fabs(prev->curvature) < CL_STRAIGHT_MAX) prev->curvature = 0.0;
+            prev->sectionEnd = (int32_t)end;
+            return;
+        }
+    }
+    if (numSections >= CL_MAX_SECTIONS) {
+        _debug(syslog(LOG_NOTICE, "%08u, CourseLearner too many sections", clock->now()));
+        return;
+    }
+    struct courseSection* sec = &sections[numSections];
+    snprintf(sec->id, sizeof(sec->id), "B%s%02d", (c == 0.0) ? "st" : "cv", numSections % 100);
+    sec->sectionEnd = (int32_t)end;
+    sec->curvature = c;
+    numSections++;
+}
+
+void CourseLearner::finish(double distance) {
+    if (finished) return;
+    closeSection(distance, secSum, secCnt);
+    closeRun(distance);
+    finished = true;
+    syslog(LOG_NOTICE, "%08u, CourseLearner learned %d sections and %d landmarks over %d mm", clock->now(),
+        numSections, numFeatures, (int32_t)distance);
+}
+
+// write the learned map and landmarks to the course file, keeping the parameters it already has.
+// the last section is written twice, as 'R' to search for the line and as 'L' to give control back.
+bool CourseLearner::save(const char* filename) {
+    if (!finished || numSections == 0) return false;
+    struct cfSection* out = new struct cfSection[numSections + 1];
+    memset(out, 0, sizeof(struct cfSection) * (numSections + 1));
+    for (int i = 0; i < numSections; i++) {
+        memcpy(out[i].id, sections[i].id, sizeof(out[i].id));
+        out[i].sectionEnd = sections[i].sectionEnd;
+        out[i].curvature = cf_curvature(sections[i].curvature);
+    }
+    out[numSections] = out[numSections - 1];
+    out[numSections - 1].id[0] = 'R';
+    out[numSections].id[0] = 'L';
+
+    CourseFile* file = new CourseFile();
+    int np = file->load(filename) ? file->getNumParams() : 0;
+    struct cfParam* params = new struct cfParam[np > 0 ? np : 1];
+    for (int i = 0; i < np; i++) params[i] = *file->getParam(i);
+    delete file; // the image of the file must be released before it is overwritten
+
+    bool result = CourseFile::write(filename, out, numSections + 1, params, np, features, numFeatures);
+    if (!result) {
+        _debug(syslog(LOG_NOTICE, "%08u, CourseLearner::save(): cannot write %s", clock->now(), filename));
+    }
+    delete[] params;
+    delete[] out;
+    return result;
+}
+
+int CourseLearner::getSize() {
+    return numSections;
+}
+
+CourseLearner::~CourseLearner() {
+    _debug(syslog(LOG_NOTICE, "%08u, CourseLearner destructor", clock->now()));
+}
@@ -0,0 +1,56 @@
+//
+//  CourseLearner.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef CourseLearner_hpp
+#define CourseLearner_hpp
+
+#include "aflac_common.hpp"
+#include "BlindRunner.hpp"
+#include "CourseFile.hpp"
+
+#define CL_MAX_SECTIONS   (MAX_COURSE_SECTIONS - 1) // maximum number of sections to learn, one is kept for 'L'
+#define CL_SAMPLE_LEN      20.0  // distance in milimeter to integrate a curvature sample over
+#define CL_CUSUM_DRIFT     0.04  // curvature deviation tolerated as noise
+#define CL_CUSUM_THRESH    0.6   // accumulated deviation to declare a change point
+#define CL_MIN_SECTION    100.0  // sections shorter than this are merged into the previous one
+#define CL_STRAIGHT_MAX    0.05  // sections below this absolute curvature are straight
+
+// Learns a course map from the wheel increments of a traced lap.
+// Curvature is sampled every CL_SAMPLE_LEN and segmented by a two-sided CUSUM
+// against the mean of the current section. Runs of a line colour other than black,
+// like the blue section, are recorded as landmarks for Localizer.
+class CourseLearner {
+private:
+    struct courseSection sections[CL_MAX_SECTIONS];
+    int     numSections;
+    bool    finished;
+    double  sampleDL, sampleDR;           // wheel travel accumulated for the current sample
+    double  secStart, secSum;             // current section start and sum of its samples
+    int32_t secCnt;
+    double  cusumPos, cusumNeg;           // CUSUM statistics
+    double  posStart, posSum, negStart, negSum; // where each statistic left zero and samples since then
+    int32_t posCnt, negCnt;
+    struct cfFeature features[CF_MAX_FEATURES];
+    int     numFeatures;
+    uint8_t runColor, pendColor;          // landmark colour run confirmed and candidate, CLS_UNKNOWN for none
+    double  runStart, pendStart;
+    int8_t  pendCnt;
+    void closeRun(double end);
+    void addSample(double c, double distance);
+    void closeSection(double end, double sum, int32_t cnt);
+public:
+    CourseLearner();
+    void reset();
+    void update(double deltaDistL, double deltaDistR, double distance);
+    void mark(uint8_t color, double distance);
+    void finish(double distance);
+    bool save(const char* filename);
+    int getSize();
+    ~CourseLearner();
+};
+
+#endif /* CourseLearner_hpp */
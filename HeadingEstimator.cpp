@@ -0,0 +1,92 @@
+//
+//  HeadingEstimator.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "HeadingEstimator.hpp"
+
+// yaw in millidegree per degree of wheel rotation difference is TIRE_DIAMETER * 500 / WHEEL_TREAD
+static const int32_t hdgNum = (int32_t)(TIRE_DIAMETER * 500.0F);
+static const int32_t hdgDen = (int32_t)WHEEL_TREAD;
+
+HeadingEstimator::HeadingEstimator(int16_t weight) {
+    gyroWeight = weight;
+    diffCnt = 0;
+    bias.clear();
+    reset();
+}
+
+void HeadingEstimator::reset(int32_t mdeg) {
+    encBase = (int32_t)((int64_t)diffCnt * hdgNum / hdgDen) - mdeg;
+    encYaw = mdeg;
+    fused = mdeg;
+    gyroRem = mixRem = 0;
+    stillCnt = 0;
+}
+
+void HeadingEstimator::update(int32_t deltaCntL, int32_t deltaCntR, int16_t gyroRate, int16_t dt) {
+    diffCnt += deltaCntL - deltaCntR;
+    int32_t prevEnc = encYaw;
+    encYaw = (int32_t)((int64_t)diffCnt * hdgNum / hdgDen) - encBase;
+    int32_t encInc = encYaw - prevEnc;
+
+    // the gyro rate at rest is its bias
+    if (deltaCntL == 0 && deltaCntR == 0) {
+        if (stillCnt < HDG_STILL_CYCLES) {
+            stillCnt++;
+        } else {
+            bias.add(gyroRate * 1000);
+        }
+    } else {
+        stillCnt = 0;
+    }
+
+    if (gyroWeight == 0) {
+        fused += encInc;
+        return;
+    }
+    int32_t gyroInc = 0;
+    if (stillCnt < HDG_STILL_CYCLES) { // otherwise the bias is being learned from this very rate
+        int32_t num = (gyroRate * 1000 - bias.mean()) * dt + gyroRem;
+        gyroInc = num / 1000;
+        gyroRem = num - gyroInc * 1000;
+    }
+    int32_t gap = gyroInc - encInc;
+    if (gap > HDG_SLIP || gap < -HDG_SLIP) {
+        fused += gyroInc;
+    } else {
+        int32_t num = gap * gyroWeight + mixRem;
+        fused += encInc + num / 256;
+        mixRem = num - num / 256 * 256;
+    }
+}
+
+int32_t HeadingEstimator::get() {
+    int32_t h = fused % HDG_FULL_TURN;
+    return (h < 0) ? h + HDG_FULL_TURN : h;
+}
+
+int32_t HeadingEstimator::getUnwrapped() {
+    return fused;
+}
+
+int32_t HeadingEstimator::getEncoderOnly() {
+    return encYaw;
+}
+
+int32_t HeadingEstimator::getBias() {
+    return bias.mean();
+}
+
+int16_t HeadingEstimator::getDegree() {
+    return get() / 1000;
+}
+
+double HeadingEstimator::getRadian() {
+    return M_2PI * get() / HDG_FULL_TURN;
+}
+
+HeadingEstimator::~HeadingEstimator() {
+}
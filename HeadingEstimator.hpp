@@ -0,0 +1,50 @@
+//
+//  HeadingEstimator.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef HeadingEstimator_hpp
+#define HeadingEstimator_hpp
+
+// Note: this header is shared with the host tools and must not depend on ev3api
+#include "aflac_common.hpp"
+#include "utility.hpp"
+
+// heading is in millidegree, clockwise from the direction at reset()
+#define HDG_FULL_TURN   360000
+
+/*
+ * Fixed point heading from the wheel encoders, optionally fused with the yaw rate of the gyro.
+ * The encoder yaw follows from the total count difference of the wheels, so it accumulates no
+ * rounding; each increment of the fused heading moves from it toward the gyro by weight/256,
+ * and all the way when they disagree by more than HDG_SLIP as the wheels must be slipping.
+ * The gyro bias is learned while the wheels have stood still for HDG_STILL_CYCLES.
+ */
+class HeadingEstimator {
+private:
+    int16_t gyroWeight; // share of the gyro in an increment out of 256, 0 for the encoders only
+    int32_t diffCnt;    // left minus right wheel rotation in degree since reset()
+    int32_t encBase;    // encoder yaw at reset()
+    int32_t encYaw;     // unwrapped, from diffCnt
+    int32_t fused;      // unwrapped
+    int32_t gyroRem, mixRem; // remainders of the divisions carried over to the next update
+    int16_t stillCnt;
+    RunningStats<int32_t, int64_t> bias; // gyro rate at rest in millidegree per second
+protected:
+public:
+    HeadingEstimator(int16_t weight);
+    void reset(int32_t mdeg = 0);
+    // wheel rotation in degree and gyro rate in degree per second (clockwise) over dt miliseconds
+    void update(int32_t deltaCntL, int32_t deltaCntR, int16_t gyroRate, int16_t dt);
+    int32_t get();              // 0 to HDG_FULL_TURN - 1
+    int32_t getUnwrapped();
+    int32_t getEncoderOnly();   // unwrapped
+    int32_t getBias();          // millidegree per second
+    int16_t getDegree();        // 0 to 359
+    double  getRadian();        // 0 to 2 pi
+    ~HeadingEstimator();
+};
+
+#endif /* HeadingEstimator_hpp */
@@ -8,31 +8,112 @@
 #include "app.h"
 #include "LineTracer.hpp"
 #include "Observer.hpp"
+#include "StateMachine.hpp"
+#include "ParamStore.hpp"
+#include "Actuator.hpp"
+#include "StaticArena.hpp"
+
+static const int32_t& gsTarget = paramInt(PRM_GS_TARGET);
+
+// global variable to pass the PID output to the telemetry
+int16_t g_turn;
 
 LineTracer::LineTracer(Motor* lm, Motor* rm, Motor* tm) {
     _debug(syslog(LOG_NOTICE, "%08u, LineTracer constructor", clock->now()));
     leftMotor   = lm;
     rightMotor  = rm;
     trace_pwmLR = 0;
-    speed       = SPEED_NORM;
+    speed       = paramInt(PRM_SPEED_NORM);
+    loadedSpeedNorm = speed;
     frozen      = false;
+    // the experiments run after arena_lock(), so what they need is placed beforehand
+#if defined(MAKE_AUTOTUNE)
+    tuner       = new (arena("LineTracer")) RelayTuner(AT_RELAY_AMP, AT_HYSTERESIS, AT_CYCLES, PERIOD_NAV_TSK);
+#else
+    tuner       = NULL;
+#endif
+    tuning      = false;
+    tuned       = false;
+#if defined(MAKE_SYSID)
+    identL      = new (arena("LineTracer")) MotorIdentifier(SYSID_DECIM * PERIOD_NAV_TSK / 1000);
+    identR      = new (arena("LineTracer")) MotorIdentifier(SYSID_DECIM * PERIOD_NAV_TSK / 1000);
+#else
+    identL      = NULL;
+    identR      = NULL;
+#endif
+    identifying = false;
+    identified  = false;
+    paramsVersion = g_paramsVersion;
 }
 
+// ramp from the speed the previous navigator left the wheels at
 void LineTracer::haveControl() {
+    speedProfile->reset((actuator->getPWM(ACT_LEFT) + actuator->getPWM(ACT_RIGHT)) / 2);
+    resetVelocity();
     activeNavigator = this;
     syslog(LOG_NOTICE, "%08u, LineTracer has control", clock->now());
 }
 
 void LineTracer::operate() {
+    if (paramsVersion != g_paramsVersion) reloadParams();
+
     if (frozen) {
         forward = turn = 0; /* 障害物を検知したら停止 */
+        speedProfile->reset(0);
+
+    }else if(tuning){
+        forward = AT_SPEED;
+        turn = _EDGE * tuner->compute(g_grayScaleBlueless, gsTarget);
+        if (tuner->isDone() || ++tuneCnt * PERIOD_NAV_TSK >= AT_TIMEOUT * 1000) {
+            tuning = false;
+            if (tuner->isDone()) {
+                double p, i, d;
+                tuner->getGains(AT_RULE, p, i, d);
+                paramFloat(PRM_P_CONST) = p;
+                paramFloat(PRM_I_CONST) = i;
+                paramFloat(PRM_D_CONST) = d;
+                ltPid->setGains(p, i, d);
+                tuned = true;
+                syslog(LOG_NOTICE, "%08u, LineTracer auto-tune: Ku = %lf, Tu = %lf ms", clock->now(), tuner->getKu(), tuner->getTu());
+                syslog(LOG_NOTICE, "%08u, LineTracer auto-tune: kp = %lf, ki = %lf, kd = %lf", clock->now(), p, i, d);
+            } else {
+                syslog(LOG_NOTICE, "%08u, LineTracer auto-tune timed out without a stable oscillation", clock->now());
+            }
+            forward = turn = 0;
+            speedProfile->reset(0);
+            stateMachine->sendTrigger(EVT_autotune_done);
+        }
+
+    }else if(identifying){
+        // the PRBS drives the wheels straight by PWM, bypassing the speed loops, while PID keeps to the line
+        turn = _EDGE * ltPid->compute(g_grayScaleBlueless, gsTarget);
+        if (idTick % SYSID_DECIM == 0) forward = identL->excite();
+        pwm_L = forward - turn;
+        pwm_R = forward + turn;
+        actuator->drive(this, pwm_L, pwm_R);
+        g_turn = turn;
+        idSumL += pwm_L;
+        idSumR += pwm_R;
+        if (++idTick % SYSID_DECIM == 0) {
+            int32_t cntL = leftMotor->getCount(), cntR = rightMotor->getCount();
+            int16_t dt = SYSID_DECIM * PERIOD_NAV_TSK / 1000;
+            identL->update(idSumL / SYSID_DECIM, (cntL - idCntL) * MM_PER_CNT_X1000 / dt);
+            identR->update(idSumR / SYSID_DECIM, (cntR - idCntR) * MM_PER_CNT_X1000 / dt);
+            idCntL = cntL;
+            idCntR = cntR;
+            idSumL = idSumR = 0;
+        }
+        if (idTick * PERIOD_NAV_TSK >= SYSID_TIME * 1000) finishSysId();
+        return;
 
     }else if(cntl_p_flg){
         turn = calcPropP(); /* 比例制御*/
-        forward = speed;
+        speedProfile->setTarget(speed);
+        forward = speedProfile->update(PERIOD_NAV_TSK / 1000);
 
     }else {
-        forward = speed; //前進命令
+        speedProfile->setTarget(speed);
+        forward = speedProfile->update(PERIOD_NAV_TSK / 1000); //前進命令
         /*
         // on-off control
         if (colorSensor->getBrightness() >= (LIGHT_WHITE + LIGHT_BLACK)/2) {
@@ -48,18 +129,15 @@ void LineTracer::operate() {
         */
         // PID control by Gray Scale with blue cut
         int16_t sensor = g_grayScaleBlueless;
-        int16_t target = GS_TARGET;
+        int16_t target = gsTarget;
 
         turn = _EDGE * ltPid->compute(sensor, target);
         //turn = ltPid->compute(sensor, target);
     }
 
     /* 左右モータでロボットのステアリング操作を行う */
-    pwm_L = forward - turn;
-    pwm_R = forward + turn;
-
-    leftMotor->setPWM(pwm_L);
-    rightMotor->setPWM(pwm_R);
+    g_turn = turn;
+    driveLR((forward - turn) * MMPS_PER_PWM, (forward + turn) * MMPS_PER_PWM, speedProfile->getAcc() * MMPS_PER_PWM);
 
     // display pwm in every PERIOD_TRACE_MSG ms */
     // if (++trace_pwmLR * PERIOD_NAV_TSK >= PERIOD_TRACE_MSG) {
@@ -72,6 +150,15 @@ void LineTracer::operate() {
     //printf("cntl_p_flg=%d,forward=%d, turn=%d, pwm_L = %d, pwm_R = %d\n",cntl_p_flg,forward, turn,pwm_L,pwm_R);
 }
 
+// follow the parameters tuned at runtime
+void LineTracer::reloadParams() {
+    paramsVersion = g_paramsVersion;
+    ltPid->setGains(paramFloat(PRM_P_CONST), paramFloat(PRM_I_CONST), paramFloat(PRM_D_CONST));
+    ltPid->setLimits(paramInt(PRM_TURN_MIN), paramInt(PRM_TURN_MAX));
+    if (speed == loadedSpeedNorm) speed = paramInt(PRM_SPEED_NORM);
+    loadedSpeedNorm = paramInt(PRM_SPEED_NORM);
+}
+
 int8_t LineTracer::getSpeed() {
     return speed;
 }
@@ -92,6 +179,81 @@ void LineTracer::setCntlP(bool p) {
     cntl_p_flg = p;
 }
 
+// run the relay feedback experiment on the line edge instead of PID control until it completes
+void LineTracer::startAutoTune() {
+    if (tuner == NULL) {
+        syslog(LOG_NOTICE, "%08u, LineTracer auto-tune needs a build with MAKE_AUTOTUNE", clock->now());
+        return;
+    }
+    tuner->reset();
+    tuneCnt = 0;
+    tuned = false;
+    tuning = true;
+    syslog(LOG_NOTICE, "%08u, LineTracer auto-tune started", clock->now());
+}
+
+// save the gains obtained by the auto-tune, if any, for PIDcalculator to load at the next start
+bool LineTracer::saveGains(const char* filename) {
+    if (!tuned) return false;
+    return ltPid->save(filename);
+}
+
+// drive the wheels by the PRBS of MotorIdentifier instead of the speed loops until SYSID_TIME
+void LineTracer::startSysId() {
+    if (identL == NULL) {
+        syslog(LOG_NOTICE, "%08u, LineTracer motor identification needs a build with MAKE_SYSID", clock->now());
+        return;
+    }
+    identL->reset();
+    identR->reset();
+    idTick = 0;
+    idCntL = leftMotor->getCount();
+    idCntR = rightMotor->getCount();
+    idSumL = idSumR = 0;
+    identified = false;
+    identifying = true;
+    syslog(LOG_NOTICE, "%08u, LineTracer motor identification started", clock->now());
+}
+
+// fit the models, stop and have the speed loops feed them forward from now on
+void LineTracer::finishSysId() {
+    identifying = false;
+    forward = turn = 0;
+    actuator->drive(this, 0, 0);
+    speedProfile->reset(0);
+    struct motorModel mL, mR;
+    if (identL->solve(mL) && identR->solve(mR)) {
+        paramFloat(PRM_MOT_GAIN_L) = mL.gain;
+        paramFloat(PRM_MOT_GAIN_R) = mR.gain;
+        paramInt(PRM_MOT_TAU_L) = mL.tau;
+        paramInt(PRM_MOT_TAU_R) = mR.tau;
+        paramInt(PRM_MOT_DEAD_L) = mL.dead;
+        paramInt(PRM_MOT_DEAD_R) = mR.dead;
+        paramInt(PRM_MOT_VBAT) = ev3_battery_voltage_mV();
+        g_paramsVersion++;
+        velocityL->setModel(mL, paramInt(PRM_MOT_VBAT));
+        velocityR->setModel(mR, paramInt(PRM_MOT_VBAT));
+        identified = true;
+        syslog(LOG_NOTICE, "%08u, LineTracer motor L: gain = %lf mm/s per PWM, tau = %d ms, dead = %d PWM",
+            clock->now(), (double)mL.gain, mL.tau, mL.dead);
+        syslog(LOG_NOTICE, "%08u, LineTracer motor R: gain = %lf mm/s per PWM, tau = %d ms, dead = %d PWM",
+            clock->now(), (double)mR.gain, mR.tau, mR.dead);
+        syslog(LOG_NOTICE, "%08u, LineTracer motor dead time unresolved at a sample of %d ms", clock->now(),
+            SYSID_DECIM * PERIOD_NAV_TSK / 1000);
+    } else {
+        syslog(LOG_NOTICE, "%08u, LineTracer motor identification found no stable model in %d samples", clock->now(), identL->getSamples());
+    }
+    stateMachine->sendTrigger(EVT_sysid_done);
+}
+
+// save the identified motor models, if any, for the speed loops to load at the next start
+bool LineTracer::saveModel(const char* filename) {
+    if (!identified) return false;
+    static const int ids[] = { PRM_MOT_GAIN_L, PRM_MOT_GAIN_R, PRM_MOT_TAU_L, PRM_MOT_TAU_R,
+                               PRM_MOT_DEAD_L, PRM_MOT_DEAD_R, PRM_MOT_VBAT };
+    return paramStore->save(filename, ids, sizeof(ids) / sizeof(*ids));
+}
+
 float LineTracer::calcPropP() {
   const float Kp = 0.83;
   const int target = 18;
@@ -103,5 +265,8 @@ float LineTracer::calcPropP() {
 }
 
 LineTracer::~LineTracer() {
+    if (tuner != NULL) delete tuner;
+    if (identL != NULL) delete identL;
+    if (identR != NULL) delete identR;
     _debug(syslog(LOG_NOTICE, "%08u, LineTracer destructor", clock->now()));
 }
\ No newline at end of file
@@ -10,13 +10,26 @@
 
 #include "aflac_common.hpp"
 #include "Navigator.hpp"
+#include "MotorIdentifier.hpp"
 
 class LineTracer : public Navigator {
 private:
     int32_t motor_ang_l, motor_ang_r;
+    RelayTuner* tuner;
+    int16_t tuneCnt;
+    uint32_t paramsVersion;
+    int8_t loadedSpeedNorm; // SPEED_NORM as last loaded, speed follows it unless set otherwise
+    MotorIdentifier* identL;
+    MotorIdentifier* identR;
+    int16_t idTick;
+    int32_t idCntL, idCntR, idSumL, idSumR; // counts at the start of the sample, PWM summed over it
+    void finishSysId();
+    void reloadParams();
 protected:
     bool    frozen;
     bool    cntl_p_flg;
+    bool    tuning, tuned;
+    bool    identifying, identified;
 public:
     LineTracer();
     LineTracer(Motor* lm, Motor* rm, Motor* tm);
@@ -28,6 +41,10 @@ public:
     void unfreeze();
     float calcPropP();
     void setCntlP(bool p);
+    void startAutoTune();
+    bool saveGains(const char* filename);
+    void startSysId();
+    bool saveModel(const char* filename);
     ~LineTracer();
 };
 
@@ -0,0 +1,211 @@
+//
+//  Localizer.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "Localizer.hpp"
+#include <string.h>
+
+Localizer::Localizer() {
+    numBins = LOC_MAX_BINS;
+    landmarkColors = 0;
+    memset(weight, 0, sizeof(weight));
+    reset();
+}
+
+// the weight of a bin falls linearly from 255 at a landmark edge to 0 at LOC_TOL away from it
+int Localizer::setLandmarks(const struct cfFeature* f, int n, int32_t length) {
+    numBins = (length + LOC_TOL) / LOC_BIN + 1;
+    if (numBins > LOC_MAX_BINS) numBins = LOC_MAX_BINS;
+    landmarkColors = 0;
+    memset(weight, 0, sizeof(weight));
+    int taken = 0;
+    for (int i = 0; i < n; i++) {
+        if (f[i].color >= 16 || f[i].end <= f[i].start) continue;
+        landmarkColors |= 1 << f[i].color;
+        int32_t edge[2] = { f[i].start, f[i].end };
+        for (int e = LOC_ENTRY; e <= LOC_EXIT; e++) {
+            for (int32_t b = (edge[e] - LOC_TOL) / LOC_BIN; b <= (edge[e] + LOC_TOL) / LOC_BIN; b++) {
+                if (b < 0 || b >= numBins) continue;
+                int32_t d = b * LOC_BIN + LOC_BIN / 2 - edge[e];
+                if (d < 0) d = -d;
+                if (d >= LOC_TOL) continue;
+                uint8_t w = 255 - 255 * d / LOC_TOL;
+                if (w > weight[e][b]) weight[e][b] = w;
+            }
+        }
+        taken++;
+    }
+    reset();
+    return taken;
+}
+
+void Localizer::reset() {
+    for (int i = 0; i < numBins; i++) belief[i] = LOC_FLOOR;
+    base = peak = sinceDiffuse = 0;
+    belief[0] = LOC_ONE;
+    remUm = odometryUm = 0;
+    inLandmark = false;
+    runCnt = 0;
+    runUm = 0;
+    refHeading = lateralUm = 0;
+    corrections = 0;
+    shiftMm = 0;
+}
+
+int16_t Localizer::slot(int16_t bin) {
+    int16_t s = base + bin;
+    return (s >= numBins) ? s - numBins : s;
+}
+
+// moving by a bin only rotates the buffer, what falls off an end is kept in the bin at that end
+void Localizer::shift(int8_t dir) {
+    if (dir > 0) {
+        base = (base == 0) ? numBins - 1 : base - 1;
+        uint16_t& last = belief[slot(numBins - 1)];
+        uint16_t& over = belief[slot(0)];
+        last = (last + over > UINT16_MAX) ? UINT16_MAX : last + over;
+        over = LOC_FLOOR;
+        if (peak < numBins - 1) peak++;
+        if (last > belief[slot(peak)]) peak = numBins - 1;
+    } else {
+        base = (base == numBins - 1) ? 0 : base + 1;
+        uint16_t& first = belief[slot(0)];
+        uint16_t& over = belief[slot(numBins - 1)];
+        first = (first + over > UINT16_MAX) ? UINT16_MAX : first + over;
+        over = LOC_FLOOR;
+        if (peak > 0) peak--;
+        if (first > belief[slot(peak)]) peak = 0;
+    }
+}
+
+void Localizer::diffuse() {
+    int16_t s = base;
+    uint16_t prev = belief[s];
+    for (int i = 0; i < numBins; i++) {
+        int16_t next = (s + 1 >= numBins) ? 0 : s + 1;
+        uint16_t cur = belief[s];
+        uint16_t right = (i == numBins - 1) ? cur : belief[next];
+        belief[s] = ((uint32_t)prev + 2 * cur + right) / 4;
+        prev = cur;
+        s = next;
+    }
+    normalize();
+}
+
+// the edge was crossed lagUm ago, when it took the samples to confirm it
+void Localizer::correct(int8_t edge, int32_t lagUm) {
+    int16_t lag = lagUm / LOC_BIN_UM;
+    int16_t prevPeak = peak;
+    int16_t s = base;
+    for (int i = 0; i < numBins; i++) {
+        int16_t b = i - lag;
+        uint16_t w = (b >= 0) ? LOC_W_MISS + ((weight[edge][b] * (256 - LOC_W_MISS)) >> 8) : LOC_W_MISS;
+        belief[s] = ((uint32_t)belief[s] * w) >> 8;
+        s = (s + 1 >= numBins) ? 0 : s + 1;
+    }
+    normalize();
+    corrections++;
+    shiftMm = (peak - prevPeak) * LOC_BIN;
+}
+
+// scale by a power of two to keep the resolution, then raise everything to the floor and find the peak
+void Localizer::normalize() {
+    uint16_t max = 0;
+    for (int i = 0; i < numBins; i++) {
+        if (belief[i] > max) max = belief[i];
+    }
+    int8_t k = 0;
+    while (max > 0 && (max << (k + 1)) <= LOC_ONE) k++;
+    // ties go to the previous peak, so a flat belief does not drift
+    int16_t best = peak;
+    uint16_t bestVal = 0;
+    int16_t s = base;
+    for (int i = 0; i < numBins; i++) {
+        uint16_t v = belief[s] << k;
+        if (v < LOC_FLOOR) v = LOC_FLOOR;
+        belief[s] = v;
+        if (v > bestVal || (v == bestVal && i == peak)) {
+            best = i;
+            bestVal = v;
+        }
+        s = (s + 1 >= numBins) ? 0 : s + 1;
+    }
+    peak = best;
+}
+
+void Localizer::update(int32_t deltaUm, uint8_t color, int32_t heading) {
+    odometryUm += deltaUm;
+    remUm += deltaUm;
+    while (remUm >= LOC_BIN_UM) {
+        remUm -= LOC_BIN_UM;
+        shift(1);
+        if (++sinceDiffuse >= LOC_DIFFUSE_BINS) {
+            sinceDiffuse = 0;
+            diffuse();
+        }
+    }
+    while (remUm < 0) {
+        remUm += LOC_BIN_UM;
+        shift(-1);
+    }
+
+    // an edge of a landmark counts once the colour has held for LOC_CONFIRM samples
+    bool in = (color < 16) && (landmarkColors & (1 << color));
+    if (in == inLandmark) {
+        runCnt = 0;
+    } else {
+        runUm = (runCnt == 0) ? 0 : runUm + deltaUm;
+        if (++runCnt >= LOC_CONFIRM) {
+            inLandmark = in;
+            runCnt = 0;
+            correct(in ? LOC_ENTRY : LOC_EXIT, runUm);
+        }
+    }
+
+    // the line is where the lateral offset is known, off it the heading tells how far the sensor strays
+    if (color == CLS_BLACK || color == CLS_GRAY || in) {
+        refHeading = heading;
+        lateralUm = 0;
+    } else {
+        int32_t d = heading - refHeading;
+        d %= 360000;
+        if (d > 180000) d -= 360000;
+        if (d < -180000) d += 360000;
+        lateralUm += (int32_t)(deltaUm * sin(M_PI * d / 180000.0));
+    }
+}
+
+// without landmarks there is nothing to correct by, and the course length is unknown
+int32_t Localizer::getDistance() {
+    if (landmarkColors == 0) return getOdometry();
+    // centroid of the bins around the peak, to the resolution of the odometry
+    int32_t sum = 0, moment = 0;
+    for (int16_t i = peak - 2; i <= peak + 2; i++) {
+        if (i < 0 || i >= numBins) continue;
+        sum += belief[slot(i)];
+        moment += (int32_t)belief[slot(i)] * (i - peak);
+    }
+    return peak * LOC_BIN + (moment * LOC_BIN) / sum + remUm / 1000;
+}
+
+int32_t Localizer::getOdometry() {
+    return odometryUm / 1000;
+}
+
+int32_t Localizer::getLateral() {
+    return lateralUm / 1000;
+}
+
+int16_t Localizer::getCorrections() {
+    return corrections;
+}
+
+int32_t Localizer::getLastShift() {
+    return shiftMm;
+}
+
+Localizer::~Localizer() {
+}
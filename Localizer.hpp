@@ -0,0 +1,68 @@
+//
+//  Localizer.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef Localizer_hpp
+#define Localizer_hpp
+
+// Note: this header is shared with the host tools and must not depend on ev3api
+#include "aflac_common.hpp"
+#include "CourseFile.hpp"
+#include "ColorClassifier.hpp"
+
+#define LOC_BIN_UM      (LOC_BIN * 1000)
+#define LOC_ONE         0x7FFF  // the peak is scaled up to between LOC_ONE / 2 and this
+#define LOC_FLOOR       1       // no position is ever ruled out, to recover from a wrong correction
+#define LOC_ENTRY       0
+#define LOC_EXIT        1
+
+/*
+ * Histogram filter along the arc length of the course. The belief of each LOC_BIN long bin is
+ * kept in fixed point in a circular buffer, so moving by a bin is a change of the base index;
+ * the motion noise is a [1 2 1] / 4 diffusion every LOC_DIFFUSE_BINS bins travelled.
+ * A confirmed entry into or exit from a landmark colour weights the bins by how close they are
+ * to such an edge in the course map. The distance is the peak bin plus the travel within the bin.
+ * Work per update is O(1), plus one pass over the bins when diffusing or on a colour edge.
+ *
+ * The lateral offset is dead reckoned from the heading relative to the one held on the line,
+ * and reset whenever the sensor is back over the line.
+ */
+class Localizer {
+private:
+    uint16_t belief[LOC_MAX_BINS];      // bin i is at belief[(base + i) % numBins]
+    uint8_t  weight[2][LOC_MAX_BINS];   // likelihood of an entry and an exit at each bin, out of 255
+    uint16_t landmarkColors;            // bit set of the CLS_ colours of the landmarks
+    int16_t  numBins, base, peak, sinceDiffuse;
+    int32_t  remUm;                     // travel within the bin, 0 to LOC_BIN_UM - 1
+    int32_t  odometryUm;
+    bool     inLandmark;                // confirmed state of the colour
+    int8_t   runCnt;                    // successive samples disagreeing with inLandmark
+    int32_t  runUm;                     // travel since the first of them
+    int32_t  refHeading, lateralUm;
+    int16_t  corrections;
+    int32_t  shiftMm;                   // move of the estimate by the last correction
+
+    int16_t slot(int16_t bin);
+    void shift(int8_t dir);
+    void diffuse();
+    void correct(int8_t edge, int32_t lagUm);
+    void normalize();
+protected:
+public:
+    Localizer();
+    int setLandmarks(const struct cfFeature* f, int n, int32_t length); // returns the number taken
+    void reset();
+    // travel in micrometer, filtered colour and heading in millidegree of the cycle
+    void update(int32_t deltaUm, uint8_t color, int32_t heading);
+    int32_t getDistance();      // corrected, in milimeter
+    int32_t getOdometry();
+    int32_t getLateral();       // milimeter to the right of the line
+    int16_t getCorrections();   // number of colour edges applied since reset()
+    int32_t getLastShift();     // milimeter the last of them moved the estimate by
+    ~Localizer();
+};
+
+#endif /* Localizer_hpp */
@@ -9,14 +9,11 @@ using namespace std;
 
 FILE *Logger::fp_bt;
 FILE *Logger::fp_sd;
-char *Logger::buffer;
-Log *Logger::log;
+char Logger::buffer[LOG_MSG_LEN];
+Log Logger::log[MAX_LOG_LINE];
 int Logger::cur_w_line;
 int Logger::cur_r_line;
 
-#define MAX_LOG_LINE (10000)
-#define LOG_MSG_LEN (100)
-
 void Logger::init() {
 
 	// bluetooth
@@ -34,8 +31,6 @@ void Logger::init() {
 
 	cur_w_line = 0;
 	cur_r_line = 0;
-	log = new Log[MAX_LOG_LINE];
-	buffer = new char[LOG_MSG_LEN];
 
 }
 
@@ -58,15 +53,15 @@ void Logger::dprint(char *form, ...) {
 }
 
 void Logger::dprintf(char *form, ...) {
-	memset(buffer,0 ,100);
+	memset(buffer,0 ,LOG_MSG_LEN);
 	va_list arg;
 	va_start(arg, form);
-	vsprintf(buffer, form, arg);
+	vsnprintf(buffer, LOG_MSG_LEN, form, arg);
 	va_end(arg);
 
 	cur_w_line = cur_w_line % MAX_LOG_LINE;
 	if ( log[cur_w_line].writable == true ) {
-		log[cur_w_line].msg = buffer;
+		strncpy(log[cur_w_line].msg, buffer, LOG_MSG_LEN);
 		log[cur_w_line].writable = false;
 //		print_new_line("cur_buf_w_line = %d", cur_w_line);
 		cur_w_line++;
@@ -77,7 +72,7 @@ void Logger::dump() {
 
 	cur_r_line = cur_r_line % MAX_LOG_LINE;
 	if  ( log[cur_r_line].writable == false ) {
-		fprintf(fp_sd, "%d, %s", cur_r_line, log[cur_r_line].msg.c_str());
+		fprintf(fp_sd, "%d, %s", cur_r_line, log[cur_r_line].msg);
 		log[cur_r_line].writable = true;
 		cur_r_line++;
 	}
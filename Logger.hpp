@@ -9,8 +9,7 @@
 #ifndef Logger_hpp
 #define Logger_hpp
 
-#include <vector>
-#include <string>
+#include <cstdio>
 
 using namespace std;
 
@@ -29,9 +28,12 @@ using namespace std;
 	#define print(...) ((void)0)
 #endif
 
+#define MAX_LOG_LINE (10000)
+#define LOG_MSG_LEN (100)
+
 class Log {
 	public:
-		string msg;
+		char msg[LOG_MSG_LEN]; // fixed size not to allocate in dprintf()
 		bool writable;
 		Log():writable(true) { ; }
 };
@@ -50,8 +52,8 @@ class Logger {
 	private:
 		static FILE* fp_bt;
 		static FILE* fp_sd;
-		static char* buffer;
-		static Log *log;
+		static char buffer[LOG_MSG_LEN];
+		static Log log[MAX_LOG_LINE]; // reserved at link time, not to fragment the heap
 		static int cur_w_line;
 		static int cur_r_line;
 };
@@ -0,0 +1,146 @@
+//
+//  MotionPrimitive.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "MotionPrimitive.hpp"
+#include "ColorClassifier.hpp"
+#include <stdlib.h>
+
+// shortest signed difference from one heading to another in degree, positive clockwise
+static int16_t degreeDiff(int16_t to, int16_t from) {
+    int16_t d = (to - from) % 360;
+    if (d > 180) d -= 360;
+    if (d <= -180) d += 360;
+    return d;
+}
+
+// PWM in proportion to what is left within span of the target, between MP_MIN_PWM and that of the primitive
+static int16_t slowDown(int32_t left, int32_t span, int16_t pwm) {
+    int32_t p = pwm * left / span;
+    if (p > pwm) p = pwm;
+    if (p < MP_MIN_PWM) p = MP_MIN_PWM;
+    return p;
+}
+
+MotionPrimitive::MotionPrimitive() {
+    primitive = MP_NONE;
+    result = MP_DONE;
+    stopColor = CLS_UNKNOWN;
+    colorAfter = 0;
+    turned = 0;
+}
+
+void MotionPrimitive::begin(int8_t p, int8_t pw, int16_t azimuth) {
+    pwm = abs(pw);
+    prevDegree = azimuth;
+    turned = 0;
+    primitive = p;
+}
+
+void MotionPrimitive::drive(int32_t mm, int8_t pw, int32_t distance, int16_t azimuth) {
+    start = distance;
+    target = mm;
+    hold = azimuth;
+    begin(MP_DRIVE, pw, azimuth);
+}
+
+void MotionPrimitive::turnTo(int16_t degree, int8_t pw, int16_t azimuth) {
+    target = (degree % 360 + 360) % 360;
+    begin(MP_TURN, pw, azimuth);
+}
+
+// pwm is of the outer wheel, the inner one keeps to the ratio of the radii of their tracks
+void MotionPrimitive::arc(int32_t radius, int16_t degree, int8_t pw, int16_t azimuth) {
+    int32_t r = labs(radius);
+    ratio = (int16_t)(100 * (r - WHEEL_TREAD / 2) / (r + WHEEL_TREAD / 2));
+    target = (radius >= 0) ? abs(degree) : -abs(degree);
+    begin(MP_ARC, pw, azimuth);
+}
+
+void MotionPrimitive::stopOnColor(uint8_t cls, int32_t after) {
+    stopColor = cls;
+    colorAfter = after;
+}
+
+bool MotionPrimitive::step(int32_t distance, int16_t azimuth, uint8_t color, int16_t& pwmL, int16_t& pwmR) {
+    if (primitive == MP_NONE) {
+        pwmL = pwmR = 0;
+        return false;
+    }
+    turned += degreeDiff(azimuth, prevDegree);
+    prevDegree = azimuth;
+    int32_t gone = (primitive == MP_DRIVE) ? labs(distance - start) : labs(turned);
+    if (stopColor != CLS_UNKNOWN && color == stopColor && gone >= colorAfter) {
+        end(MP_COLOR, pwmL, pwmR);
+        return false;
+    }
+
+    int32_t left;
+    int16_t p;
+    switch (primitive) {
+        case MP_DRIVE:
+            left = distance - start;
+            left = (target >= 0) ? target - left : left - target;
+            if (left <= 0) break;
+            p = slowDown(left, MP_DECEL_DIST, pwm);
+            if (target < 0) p = -p;
+            // the wheels turn the robot the same way going forward or backward
+            pwmL = p + MP_HOLD_GAIN * degreeDiff(hold, azimuth);
+            pwmR = p - MP_HOLD_GAIN * degreeDiff(hold, azimuth);
+            return true;
+        case MP_TURN:
+            left = degreeDiff(target, azimuth);
+            if (abs(left) <= MP_TURN_TOL) break;
+            p = slowDown(abs(left), MP_DECEL_DEG, pwm);
+            pwmL = (left > 0) ? p : -p;
+            pwmR = -pwmL;
+            return true;
+        case MP_ARC:
+            left = (target >= 0) ? target - turned : turned - target;
+            if (left <= 0) break;
+            p = slowDown(left, MP_DECEL_DEG, pwm);
+            if (target >= 0) {
+                pwmL = p;
+                pwmR = p * ratio / 100;
+            } else {
+                pwmL = p * ratio / 100;
+                pwmR = p;
+            }
+            return true;
+        default:
+            break;
+    }
+    end(MP_DONE, pwmL, pwmR);
+    return false;
+}
+
+void MotionPrimitive::end(int8_t r, int16_t& pwmL, int16_t& pwmR) {
+    primitive = MP_NONE;
+    stopColor = CLS_UNKNOWN;
+    result = r;
+    pwmL = pwmR = 0;
+}
+
+// stop following the primitive without an end to report
+void MotionPrimitive::cancel() {
+    primitive = MP_NONE;
+    stopColor = CLS_UNKNOWN;
+}
+
+bool MotionPrimitive::isActive() {
+    return (primitive != MP_NONE);
+}
+
+int8_t MotionPrimitive::getResult() {
+    return result;
+}
+
+int32_t MotionPrimitive::getTurned() {
+    return turned;
+}
+
+MotionPrimitive::~MotionPrimitive() {
+}
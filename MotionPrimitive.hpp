@@ -0,0 +1,48 @@
+//
+//  MotionPrimitive.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef MotionPrimitive_hpp
+#define MotionPrimitive_hpp
+
+// Note: this header is shared with the host tools and must not depend on ev3api
+#include "aflac_common.hpp"
+
+/*
+ * Closed-loop motion primitives on the distance and the azimuth of Observer: drive a distance
+ * holding the heading, pivot to an absolute heading, or follow an arc by an angle. The PWM falls
+ * in proportion to what is left within MP_DECEL_DIST or MP_DECEL_DEG of the target, down to
+ * MP_MIN_PWM, and the wheels stop there. A colour class given by stopOnColor() ends the primitive
+ * early once it has gone past the given part of the way.
+ */
+class MotionPrimitive {
+private:
+    int8_t  primitive, result;
+    int16_t pwm;
+    uint8_t stopColor;          // CLS_UNKNOWN for none
+    int32_t colorAfter;         // milimeter or degree to go before the colour counts
+    int32_t target, start;      // milimeter for MP_DRIVE, degree for MP_TURN and MP_ARC
+    int16_t hold, prevDegree, ratio; // heading to hold, last heading seen, inner wheel in percent of the outer on an arc
+    int32_t turned;             // degree turned since the primitive started, clockwise
+    void begin(int8_t p, int8_t pw, int16_t azimuth);
+    void end(int8_t r, int16_t& pwmL, int16_t& pwmR);
+protected:
+public:
+    MotionPrimitive();
+    void drive(int32_t mm, int8_t pw, int32_t distance, int16_t azimuth); // backward if mm < 0
+    void turnTo(int16_t degree, int8_t pw, int16_t azimuth);
+    void arc(int32_t radius, int16_t degree, int8_t pw, int16_t azimuth); // radius > 0 to the right
+    void stopOnColor(uint8_t cls, int32_t after = 0); // for the next primitive, cleared as it ends
+    // PWM of the wheels, false once ended, then getResult() tells MP_DONE or MP_COLOR
+    bool step(int32_t distance, int16_t azimuth, uint8_t color, int16_t& pwmL, int16_t& pwmR);
+    void cancel();
+    bool isActive();
+    int8_t getResult();
+    int32_t getTurned();        // degree turned by the last primitive, clockwise
+    ~MotionPrimitive();
+};
+
+#endif /* MotionPrimitive_hpp */
@@ -0,0 +1,104 @@
+//
+//  MotionProfile.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "MotionProfile.hpp"
+
+#define MPR_ONE     1000000 // micro PWM in a PWM
+
+MotionProfile::MotionProfile(int32_t acc, int32_t jrk) {
+    a = 0;
+    setLimits(acc, jrk);
+    reset(0);
+}
+
+void MotionProfile::setLimits(int32_t acc, int32_t jrk) {
+    accMax = (acc > 0) ? acc * 1000 : 1;
+    jerk = (jrk > 0) ? jrk : 0;
+    if (a > accMax) a = accMax;
+    if (a < -accMax) a = -accMax;
+}
+
+// ramps of a PWM every so many cycles, as ChallengeRunner scripts them
+void MotionProfile::setRate(int32_t pwm, int32_t ms) {
+    accMax = (ms > 0) ? pwm * MPR_ONE / ms : pwm * MPR_ONE;
+    if (accMax < 1) accMax = 1;
+    jerk = 0;
+}
+
+void MotionProfile::reset(int16_t pwm) {
+    v = target = pwm * MPR_ONE;
+    a = applied = 0;
+}
+
+void MotionProfile::setTarget(int16_t pwm) {
+    target = pwm * MPR_ONE;
+}
+
+// speed gained by stepping at acceleration x and then at x - da, x - 2 da, ... down to 0
+static int64_t ramp_down(int32_t x, int32_t da, int16_t dtMs) {
+    if (x <= 0) return (int64_t)x * dtMs;
+    int64_t n = x / da;
+    return dtMs * ((n + 1) * x - da * n * (n + 1) / 2);
+}
+
+int16_t MotionProfile::update(int16_t dtMs) {
+    int32_t e = target - v;
+    int32_t da = jerk * dtMs;
+    if (jerk == 0) {
+        // trapezoid: full acceleration until the target
+        a = (e > 0) ? accMax : (e < 0) ? -accMax : 0;
+    } else {
+        // S-curve: the most acceleration toward the target, within da of the last one, from which
+        // it can still be ramped down to 0 by the time the speed gets there. Worked out in the
+        // direction of the target, by bisection as ramp_down() grows with the acceleration
+        int8_t s = (e < 0) ? -1 : 1;
+        int32_t ae = s * a, ee = s * e;
+        int32_t lo = (ae - da < -accMax) ? -accMax : ae - da;
+        int32_t hi = (ae + da > accMax) ? accMax : ae + da;
+        if (ramp_down(hi, da, dtMs) <= ee) {
+            lo = hi;
+        } else {
+            while (hi - lo > 1) {
+                int32_t mid = lo + (hi - lo) / 2;
+                if (ramp_down(mid, da, dtMs) <= ee) {
+                    lo = mid;
+                } else {
+                    hi = mid;
+                }
+            }
+        }
+        a = s * lo;
+    }
+    int32_t dv = a * dtMs;
+    // land on the target instead of overshooting it, and near it with little acceleration left
+    bool crossed = (e >= 0) ? dv >= e : dv <= e;
+    bool close = jerk > 0 && e <= da * dtMs && e >= -da * dtMs && a <= da && a >= -da;
+    if (crossed || close) {
+        applied = e / dtMs;
+        v = target;
+        a = 0;
+    } else {
+        applied = a;
+        v += dv;
+    }
+    return get();
+}
+
+int16_t MotionProfile::get() {
+    return (v >= 0) ? (v + MPR_ONE / 2) / MPR_ONE : -((-v + MPR_ONE / 2) / MPR_ONE);
+}
+
+int32_t MotionProfile::getAcc() {
+    return applied / 1000;
+}
+
+bool MotionProfile::isSettled() {
+    return v == target && a == 0;
+}
+
+MotionProfile::~MotionProfile() {
+}
@@ -0,0 +1,43 @@
+//
+//  MotionProfile.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef MotionProfile_hpp
+#define MotionProfile_hpp
+
+// Note: this header is shared with the host tools and must not depend on ev3api
+#include "aflac_common.hpp"
+
+/*
+ * Ramps a PWM toward its target under an acceleration limit and, unless the jerk limit is 0,
+ * a jerk limit, giving a trapezoidal or an S-curve profile. The speed is kept in micro PWM,
+ * the acceleration in micro PWM per milisecond (the same number as milli PWM per second) and
+ * the jerk in micro PWM per milisecond squared (the same number as PWM per second squared),
+ * so that slow ramps of a PWM per second fraction keep their rate.
+ * With a jerk limit the acceleration starts to fall once the speed left to go is no more than
+ * what ramping it down to 0 would cover, and the speed lands on the target without overshoot.
+ */
+class MotionProfile {
+private:
+    int32_t v, a;           // micro PWM, micro PWM per milisecond
+    int32_t applied;        // acceleration over the last update, less than a when it landed
+    int32_t target;         // micro PWM
+    int32_t accMax, jerk;   // micro PWM per milisecond, and per milisecond squared
+protected:
+public:
+    MotionProfile(int32_t acc, int32_t jrk = 0); // PWM per second, and per second squared
+    void setLimits(int32_t acc, int32_t jrk = 0);
+    void setRate(int32_t pwm, int32_t ms);  // trapezoid gaining pwm every ms miliseconds
+    void reset(int16_t pwm);        // stand at this PWM
+    void setTarget(int16_t pwm);
+    int16_t update(int16_t dtMs);   // PWM after dtMs miliseconds
+    int16_t get();
+    int32_t getAcc();               // PWM per second over the last update
+    bool isSettled();
+    ~MotionProfile();
+};
+
+#endif /* MotionProfile_hpp */
@@ -0,0 +1,129 @@
+//
+//  MotorIdentifier.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "MotorIdentifier.hpp"
+#include <string.h>
+
+MotorIdentifier::MotorIdentifier(int16_t periodMs) {
+    samplePeriod = periodMs;
+    reset();
+}
+
+void MotorIdentifier::reset() {
+    memset(zPhi, 0, sizeof(zPhi));
+    memset(phiPhi, 0, sizeof(phiPhi));
+    memset(zY, 0, sizeof(zY));
+    memset(phiY, 0, sizeof(phiY));
+    yY = 0;
+    memset(uHist, 0, sizeof(uHist));
+    prevY = 0;
+    samples = 0;
+    lfsr = 0x5A;
+    holdCnt = 0;
+}
+
+// x^7 + x^6 + 1, a maximal length sequence of 127 bits, each held for SYSID_HOLD samples
+int16_t MotorIdentifier::excite() {
+    if (++holdCnt >= SYSID_HOLD) {
+        holdCnt = 0;
+        uint8_t bit = ((lfsr >> 6) ^ (lfsr >> 5)) & 1;
+        lfsr = ((lfsr << 1) | bit) & 0x7F;
+    }
+    return SYSID_PWM + ((lfsr & 1) ? SYSID_AMP : -SYSID_AMP);
+}
+
+// s += v with forgetting, in fixed point
+static inline void accumulate(int64_t& s, int32_t v) {
+    s += ((int64_t)v << SYSID_FRAC) - (s >> SYSID_FORGET);
+}
+
+void MotorIdentifier::update(int16_t u, int16_t y) {
+    for (int d = SYSID_MAX_DELAY + 2; d > 0; d--) uHist[d] = uHist[d - 1];
+    uHist[0] = u;
+    // the first samples have no history to regress on yet
+    if (++samples > SYSID_MAX_DELAY + 3) {
+        for (int d = 0; d <= SYSID_MAX_DELAY; d++) {
+            int32_t phi[SYSID_TERMS] = { prevY, uHist[d], uHist[d + 1], 1 };
+            int32_t z[SYSID_TERMS] = { uHist[d + 2], uHist[d], uHist[d + 1], 1 };
+            for (int i = 0; i < SYSID_TERMS; i++) {
+                for (int j = 0; j < SYSID_TERMS; j++) {
+                    accumulate(zPhi[d][i][j], z[i] * phi[j]);
+                    if (j >= i) accumulate(phiPhi[d][i][j], phi[i] * phi[j]);
+                }
+                accumulate(zY[d][i], z[i] * y);
+                accumulate(phiY[d][i], phi[i] * y);
+            }
+        }
+        accumulate(yY, (int32_t)y * y);
+    }
+    prevY = y;
+}
+
+int16_t MotorIdentifier::getSamples() {
+    return samples;
+}
+
+// Gaussian elimination with partial pivoting, false if A is singular
+static bool solve_linear(double A[SYSID_TERMS][SYSID_TERMS], double B[SYSID_TERMS], double x[SYSID_TERMS]) {
+    for (int c = 0; c < SYSID_TERMS; c++) {
+        int p = c;
+        for (int r = c + 1; r < SYSID_TERMS; r++) {
+            if (fabs(A[r][c]) > fabs(A[p][c])) p = r;
+        }
+        if (fabs(A[p][c]) < 1e-9) return false;
+        for (int k = 0; k < SYSID_TERMS; k++) {
+            double t = A[c][k]; A[c][k] = A[p][k]; A[p][k] = t;
+        }
+        double t = B[c]; B[c] = B[p]; B[p] = t;
+        for (int r = c + 1; r < SYSID_TERMS; r++) {
+            double f = A[r][c] / A[c][c];
+            for (int k = c; k < SYSID_TERMS; k++) A[r][k] -= f * A[c][k];
+            B[r] -= f * B[c];
+        }
+    }
+    for (int c = SYSID_TERMS - 1; c >= 0; c--) {
+        double s = B[c];
+        for (int k = c + 1; k < SYSID_TERMS; k++) s -= A[c][k] * x[k];
+        x[c] = s / A[c][c];
+    }
+    return true;
+}
+
+// solve the equations of each dead time, and keep the one of the least residual
+bool MotorIdentifier::solve(struct motorModel& m) {
+    bool found = false;
+    double best = 0.0;
+    for (int d = 0; d <= SYSID_MAX_DELAY; d++) {
+        double A[SYSID_TERMS][SYSID_TERMS], B[SYSID_TERMS], x[SYSID_TERMS];
+        for (int i = 0; i < SYSID_TERMS; i++) {
+            for (int j = 0; j < SYSID_TERMS; j++) A[i][j] = (double)zPhi[d][i][j];
+            B[i] = (double)zY[d][i];
+        }
+        if (!solve_linear(A, B, x)) continue;
+        double a = x[0], b = x[1] + x[2], c = x[3];
+        if (a <= 0.0 || a >= 1.0 || b <= 0.0) continue; // not a stable lag driven forward by the PWM
+        // sum of the squared errors, y'y - 2 x'phi'y + x'phi'phi x
+        double residual = (double)yY;
+        for (int i = 0; i < SYSID_TERMS; i++) {
+            residual -= 2.0 * x[i] * phiY[d][i];
+            for (int j = 0; j < SYSID_TERMS; j++) {
+                residual += x[i] * x[j] * (double)((i <= j) ? phiPhi[d][i][j] : phiPhi[d][j][i]);
+            }
+        }
+        if (!found || residual < best) {
+            found = true;
+            best = residual;
+            m.gain  = (float)(b / (1.0 - a));
+            m.tau   = (int16_t)(-samplePeriod / log(a) + 0.5);
+            m.dead  = (int16_t)lround(-c / b);
+        }
+    }
+    return found;
+}
+
+MotorIdentifier::~MotorIdentifier() {
+}
@@ -0,0 +1,61 @@
+//
+//  MotorIdentifier.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef MotorIdentifier_hpp
+#define MotorIdentifier_hpp
+
+// Note: this header is shared with the host tools and must not depend on ev3api
+#include "aflac_common.hpp"
+
+#define SYSID_TERMS     4   // speed, PWM of two samples and constant
+
+// first-order model of a wheel: speed = gain * (PWM - dead), lagging by tau
+struct motorModel {
+    float   gain;   // mm/s per PWM
+    int16_t tau;    // ms
+    int16_t dead;   // PWM
+};
+
+/*
+ * Identifies the model of a wheel from its speed sampled every samplePeriod ms, fitting
+ *   y[k+1] = a y[k] + b0 u[k-d] + b1 u[k-d-1] + c
+ * by recursive least squares for each dead time d of 0 to SYSID_MAX_DELAY samples at once.
+ * The dead time is fitted only to keep the other terms unbiased: a sample of SYSID_DECIM cycles
+ * is too coarse to resolve it (see replay sysid), so it is left out of the model.
+ * A speed from whole encoder degrees is noisy as a regressor, which biases plain least squares
+ * toward a faster and weaker motor, so the PWM two samples earlier, u[k-d-2], stands in for y[k]
+ * as the instrument. The recursion is kept in information form, the sums of the products in
+ * fixed point with exponential forgetting by 2^-SYSID_FORGET a sample, so each update is a few
+ * integer multiply-adds and cannot go unstable; solve() takes the equations of every dead time,
+ * once at the end of the run, and keeps the one that leaves the least residual.
+ * excite() gives the PWM of a pseudo random binary sequence to drive the wheels with.
+ */
+class MotorIdentifier {
+private:
+    int64_t zPhi[SYSID_MAX_DELAY + 1][SYSID_TERMS][SYSID_TERMS];   // instruments by regressors
+    int64_t phiPhi[SYSID_MAX_DELAY + 1][SYSID_TERMS][SYSID_TERMS]; // upper triangle, for the residual
+    int64_t zY[SYSID_MAX_DELAY + 1][SYSID_TERMS];
+    int64_t phiY[SYSID_MAX_DELAY + 1][SYSID_TERMS];
+    int64_t yY;
+    int16_t uHist[SYSID_MAX_DELAY + 3]; // uHist[d] is the PWM d samples back
+    int16_t prevY;
+    int16_t samples;
+    int16_t samplePeriod;
+    uint8_t lfsr;
+    int16_t holdCnt;
+protected:
+public:
+    MotorIdentifier(int16_t periodMs);
+    void reset();
+    int16_t excite();   // PWM for the next sample
+    void update(int16_t u, int16_t y); // PWM applied over the last sample and the speed at its end
+    int16_t getSamples();
+    bool solve(struct motorModel& m);
+    ~MotorIdentifier();
+};
+
+#endif /* MotorIdentifier_hpp */
@@ -7,10 +7,23 @@
 
 #include "app.h"
 #include "Navigator.hpp"
+#include "ParamStore.hpp"
+#include "StaticArena.hpp"
+#include "Actuator.hpp"
 
 Navigator::Navigator() {
     _debug(syslog(LOG_NOTICE, "%08u, Navigator default constructor", clock->now()));
-    ltPid = new PIDcalculator(P_CONST, I_CONST, D_CONST, PERIOD_NAV_TSK, TURN_MIN, TURN_MAX); 
+    ltPid = new (arena("Navigator")) PIDcalculator(paramFloat(PRM_P_CONST), paramFloat(PRM_I_CONST), paramFloat(PRM_D_CONST), PERIOD_NAV_TSK, paramInt(PRM_TURN_MIN), paramInt(PRM_TURN_MAX));
+    speedProfile = new (arena("Navigator")) MotionProfile(PRF_ACC, PRF_JERK);
+    velocityL = new (arena("Navigator")) VelocityController(PERIOD_NAV_TSK / 1000);
+    velocityR = new (arena("Navigator")) VelocityController(PERIOD_NAV_TSK / 1000);
+    // the motor models identified by MAKE_SYSID, if the course file has them
+    struct motorModel m = { paramFloat(PRM_MOT_GAIN_L), (int16_t)paramInt(PRM_MOT_TAU_L), (int16_t)paramInt(PRM_MOT_DEAD_L) };
+    velocityL->setModel(m, paramInt(PRM_MOT_VBAT));
+    m.gain = paramFloat(PRM_MOT_GAIN_R);
+    m.tau = paramInt(PRM_MOT_TAU_R);
+    m.dead = paramInt(PRM_MOT_DEAD_R);
+    velocityR->setModel(m, paramInt(PRM_MOT_VBAT));
 }
 
 void Navigator::activate() {
@@ -30,6 +43,34 @@ void Navigator::deactivate() {
     _debug(syslog(LOG_NOTICE, "%08u, Navigator handler unset", clock->now()));
 }
 
+// the speed loops start over from the counts at this moment, as a navigator takes control
+void Navigator::resetVelocity() {
+    velocityL->reset(leftMotor->getCount());
+    velocityR->reset(rightMotor->getCount());
+}
+
+// wheel speeds in mm/s, the speed loops give the PWM; both at 0 stops the wheels at once
+void Navigator::driveLR(int16_t mmpsL, int16_t mmpsR, int32_t acc) {
+    if (mmpsL == 0 && mmpsR == 0) {
+        resetVelocity();
+        velocityL->setTarget(0);
+        velocityR->setTarget(0);
+        pwm_L = pwm_R = 0;
+    } else {
+        int32_t mv = ev3_battery_voltage_mV();
+        velocityL->setTarget(mmpsL, acc);
+        velocityR->setTarget(mmpsR, acc);
+#if VEL_CONTROL == 1
+        pwm_L = velocityL->update(leftMotor->getCount(), mv);
+        pwm_R = velocityR->update(rightMotor->getCount(), mv);
+#else
+        pwm_L = velocityL->feedForward(mv) / 256;
+        pwm_R = velocityR->feedForward(mv) / 256;
+#endif
+    }
+    actuator->drive(this, pwm_L, pwm_R);
+}
+
 Navigator::~Navigator() {
     _debug(syslog(LOG_NOTICE, "%08u, Navigator destructor", clock->now()));
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
 
 #include "aflac_common.hpp"
 #include "utility.hpp"
+#include "MotionProfile.hpp"
+#include "VelocityController.hpp"
 
 class Navigator {
 private:
@@ -22,6 +24,11 @@ protected:
     Motor*          leftMotor;
     Motor*          rightMotor;
     PIDcalculator*  ltPid;
+    MotionProfile*  speedProfile; // ramps forward to speed
+    VelocityController* velocityL;
+    VelocityController* velocityR;
+    void resetVelocity();
+    void driveLR(int16_t mmpsL, int16_t mmpsR, int32_t acc = 0); // acceleration of both in mm/s^2
 public:
     Navigator();
     void activate();
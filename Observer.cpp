@@ -8,15 +8,31 @@
 #include "app.h"
 #include "Observer.hpp"
 #include "StateMachine.hpp"
+#include "ParamStore.hpp"
+#include "TelemetryStreamer.hpp"
+#include "StaticArena.hpp"
+#include "Actuator.hpp"
 
 // global variables to pass FIR-filtered color from Observer to Navigator and its sub-classes
 rgb_raw_t g_rgb;
 hsv_raw_t g_hsv;
+uint8_t g_color; // one of CLS_ given by ColorClassifier
 int16_t g_grayScale, g_grayScaleBlueless;
 // global variables to gyro sensor output from Observer to  Navigator and its sub-classes
 int16_t g_angle, g_anglerVelocity;
 int16_t g_challenge_stepNo, g_color_brightness;
 
+static const int32_t& gsLost       = paramInt(PRM_GS_LOST);
+
+static const char* const snsName[] = { "color", "gyro", "wheels", "sonar", "touch", "button" };
+
+// microseconds since start by the performance counter
+static uint32_t us_since(SYSUTM start) {
+    SYSUTM now;
+    get_utm(&now);
+    return now - start;
+}
+
 
 Observer::Observer(Motor* lm, Motor* rm, Motor* am, Motor* tm, TouchSensor* ts, SonarSensor* ss, GyroSensor* gs, ColorSensor* cs) {
     _debug(syslog(LOG_NOTICE, "%08u, Observer constructor", clock->now()));
@@ -24,6 +40,7 @@ Observer::Observer(Motor* lm, Motor* rm, Motor* am, Motor* tm, TouchSensor* ts,
     rightMotor  = rm;
     armMotor = am;
     tailMotor = tm;
+    actuator->claim(ACT_ARM, this);
     touchSensor = ts;
     sonarSensor = ss;
     gyroSensor  = gs;
@@ -59,13 +76,44 @@ Observer::Observer(Motor* lm, Motor* rm, Motor* am, Motor* tm, TouchSensor* ts,
     prevDisX = 0;
     prevDisY = 0;
     roots_no = 0;
-    turnDegree=0;
     gyroSensor->setOffset(0);
 
-    fir_r = new FIR_Transposed<FIR_ORDER>(hn);
-    fir_g = new FIR_Transposed<FIR_ORDER>(hn);
-    fir_b = new FIR_Transposed<FIR_ORDER>(hn);
-    ma = new MovingAverage<int32_t, MA_CAP>();
+    fir_r = new (arena("Observer")) FIR_Transposed<FIR_ORDER>(hn);
+    fir_g = new (arena("Observer")) FIR_Transposed<FIR_ORDER>(hn);
+    fir_b = new (arena("Observer")) FIR_Transposed<FIR_ORDER>(hn);
+    ma = new (arena("Observer")) WindowStats<int16_t, MA_CAP, int32_t>();
+    sonarFilter = new (arena("Observer")) MedianFilter<int16_t, SONAR_MEDIAN>(SONAR_NO_ECHO, SONAR_NO_ECHO, SONAR_DROPOUT_HOLD);
+    sonarDistance = SONAR_NO_ECHO;
+    // odometry and the colour need every cycle, the sensors for the events do with less
+    sched = new (arena("Observer")) SensorScheduler();
+    sched->add(1, 0); // SNS_COLOR
+    sched->add(1, 0); // SNS_GYRO
+    sched->add(1, 0); // SNS_WHEELS
+    sched->add(SCH_SONAR_DIV, SCH_SONAR_PHASE);
+#if SCH_MULTIRATE == 1
+    sched->add(SCH_TOUCH_DIV, SCH_TOUCH_PHASE);
+    sched->add(SCH_BUTTON_DIV, SCH_BUTTON_PHASE);
+#else
+    sched->add(1, 0);
+    sched->add(1, 0);
+#endif
+    touchPressed = backPressed = false;
+    gsCusum = new (arena("Observer")) CusumDetector<int32_t>(BL_CUSUM_DRIFT, BL_CUSUM_THRESHOLD);
+    heading = new (arena("Observer")) HeadingEstimator(HDG_GYRO_FUSION ? HDG_GYRO_WEIGHT : 0);
+    curDegree360 = 0;
+    localizer = new (arena("Observer")) Localizer();
+    classifier = new (arena("Observer")) ColorClassifier();
+    classifier->build();
+    colorMode = new (arena("Observer")) ColorModeManager(colorSensor);
+    prevColor = CLS_UNKNOWN;
+    learner = NULL;
+    cmdHead = cmdTail = 0;
+}
+
+// rebuilding the table takes a few ms, call it from the main task while frozen
+void Observer::rebuildClassifier() {
+    classifier->build();
+    _debug(syslog(LOG_NOTICE, "%08u, Observer color table rebuilt", clock->now()));
 }
 
 void Observer::activate() {
@@ -78,6 +126,8 @@ void Observer::activate() {
 
 void Observer::reset() {
     distance = azimuth = locX = locY = 0.0;
+    heading->reset();
+    localizer->reset();
     prevAngL = leftMotor->getCount();
     prevAngR = rightMotor->getCount();
     integD = integDL = integDR = 0.0; // temp
@@ -91,12 +141,36 @@ int32_t Observer::getDistance() {
     return (int32_t)distance;
 }
 
+int32_t Observer::getCourseDistance() {
+    return localizer->getDistance();
+}
+
+// milimeter to the right of the line, 0 while on it
+int32_t Observer::getLateral() {
+    return localizer->getLateral();
+}
+
+// landmarks of the course file, to be given before departure
+void Observer::setLandmarks(const struct cfFeature* f, int n, int32_t length) {
+    int taken = localizer->setLandmarks(f, n, length);
+    _debug(syslog(LOG_NOTICE, "%08u, Observer localizes by %d landmarks over %d mm", clock->now(), taken, length));
+}
+
 int16_t Observer::getAzimuth() {
     // degree = 360.0 * radian / M_2PI;
     int16_t degree = (360.0 * azimuth / M_2PI);
     return degree;
 }
 
+int32_t Observer::getSonarDistance() {
+    return sonarDistance;
+}
+
+uint32_t Observer::getAge(int8_t sns) {
+    uint32_t age = sched->getAge(sns);
+    return (age == SCH_NEVER) ? SCH_NEVER : age * (PERIOD_OBS_TSK / 1000);
+}
+
 int16_t Observer::getDegree() {
     // degree = 360.0 * radian / M_2PI;
     int16_t degree = (360.0 * azimuth / M_2PI);
@@ -106,6 +180,14 @@ int16_t Observer::getDegree() {
     return degree;
 }
 
+int8_t Observer::getRoute() {
+    return roots_no;
+}
+
+int16_t Observer::getLatchedDegree() {
+    return garage_flg ? prevDegree360 : prevDegree180;
+}
+
 int32_t Observer::getLocX() {
     return (int32_t)locX;
 }
@@ -115,13 +197,19 @@ int32_t Observer::getLocY() {
 }
 
 void Observer::operate() {
-    colorSensor->getRawColor(cur_rgb);
+    SYSUTM start;
+    sched->startTick();
+    get_utm(&start);
+    colorMode->sample();
+    sched->done(SNS_COLOR, us_since(start));
+    colorMode->getRawColor(cur_rgb);
     // process RGB by the Low Pass Filter
     cur_rgb.r = fir_r->Execute(cur_rgb.r);
     cur_rgb.g = fir_g->Execute(cur_rgb.g);
     cur_rgb.b = fir_b->Execute(cur_rgb.b);
     curRgbSum = cur_rgb.r + cur_rgb.g + cur_rgb.b;
     rgb_to_hsv(cur_rgb, cur_hsv);
+    g_color = classifier->classify(cur_rgb);
     // save filtered color variables to the global area
     g_rgb = cur_rgb;
     g_hsv = cur_hsv;
@@ -132,33 +220,44 @@ void Observer::operate() {
     }else{
         g_grayScale = (cur_rgb.r * 200 + cur_rgb.g * 10 + cur_rgb.b * 29) / 239;
         g_grayScaleBlueless = (cur_rgb.r * 200 + cur_rgb.g * 10 + (cur_rgb.b - cur_rgb.g) * 29) / 239; // B - G cuts off blue
-        g_color_brightness = colorSensor->getBrightness();
+        g_color_brightness = colorMode->getBrightness(); // derived, reading it would switch the sensor out of raw RGB
     }
 
     // save gyro sensor output to the global area
+    get_utm(&start);
     g_angle = gyroSensor->getAngle();
     g_anglerVelocity = gyroSensor->getAnglerVelocity();
+    sched->done(SNS_GYRO, us_since(start));
 
     // accumulate distance
+    get_utm(&start);
     int32_t curAngL = leftMotor->getCount();
     int32_t curAngR = rightMotor->getCount();
+    sched->done(SNS_WHEELS, us_since(start));
     double deltaDistL = M_PI * TIRE_DIAMETER * (curAngL - prevAngL) / 360.0;
     double deltaDistR = M_PI * TIRE_DIAMETER * (curAngR - prevAngR) / 360.0;
     double deltaDist = (deltaDistL + deltaDistR) / 2.0;
     distance += deltaDist;
+    // estimate azimuth
+    heading->update(curAngL - prevAngL, curAngR - prevAngR, g_anglerVelocity, PERIOD_OBS_TSK/1000);
+    azimuth = heading->getRadian();
+    curDegree360 = heading->getDegree();
     prevAngL = curAngL;
     prevAngR = curAngR;
-    // calculate azimuth
-    double deltaAzi = atan2((deltaDistL - deltaDistR), WHEEL_TREAD);
-    azimuth += deltaAzi;
-    if (azimuth > M_2PI) {
-        azimuth -= M_2PI;
-    } else if (azimuth < 0.0) {
-        azimuth += M_2PI;
-    }
     // estimate location
     locX += (deltaDist * sin(azimuth));
     locY += (deltaDist * cos(azimuth));
+    // correct the distance along the course map by the landmarks the colour sensor crosses
+    int16_t corrections = localizer->getCorrections();
+    localizer->update((int32_t)(deltaDist * 1000.0), g_color, heading->getUnwrapped());
+    if (localizer->getCorrections() != corrections) {
+        _debug(syslog(LOG_NOTICE, "%08u, Localizer moved by %d mm to %d mm", clock->now(), localizer->getLastShift(), localizer->getDistance()));
+    }
+    // feed the wheel increments and the colour to the course map learner on a learning lap
+    if (learner != NULL) {
+        learner->update(deltaDistL, deltaDistR, distance);
+        learner->mark(g_color, distance);
+    }
 
     // monitor distance
     if ((notifyDistance != 0.0) && (distance > notifyDistance)) {
@@ -179,6 +278,14 @@ void Observer::operate() {
         stateMachine->sendTrigger(EVT_touch_Off);
     }
     
+    // sample the sonar at its own pace, every decision below takes the filtered distance
+    if (sched->isDue(SNS_SONAR)) {
+        get_utm(&start);
+        int16_t d = sonarSensor->getDistance();
+        sched->done(SNS_SONAR, us_since(start));
+        sonarDistance = sonarFilter->add(d);
+    }
+
     // monitor sonar sensor
     result = check_sonar();
     if (result && !sonar_flag) {
@@ -191,6 +298,14 @@ void Observer::operate() {
         stateMachine->sendTrigger(EVT_sonar_Off);
     }
     
+    // dispatch a command received over Bluetooth within this task like any other trigger
+    while (cmdTail != cmdHead) {
+        uint8_t event = cmdQueue[cmdTail];
+        cmdTail = (cmdTail + 1) % CMD_QUEUE_LEN;
+        syslog(LOG_NOTICE, "%08u, command received", clock->now());
+        stateMachine->sendTrigger(event);
+    }
+
     // monitor Back Button
     result = check_backButton();
     if (result && !backButton_flag) {
@@ -216,32 +331,23 @@ void Observer::operate() {
         //     stateMachine->sendTrigger(EVT_line_found);
         // }
 
-        // temporary dirty logic to detect the second black to blue change
-        int32_t ma_gs;
-        if (prevGS == INT16_MAX) {
-            prevTime = clock->now();
-            prevGS = g_grayScale;
-            ma_gs = ma->add(0);
-        } else {
-            curTime = clock->now();
-            gsDiff = g_grayScale - prevGS;
-            timeDiff = curTime - prevTime;
-            ma_gs = ma->add(gsDiff * 1000000 / timeDiff);
-            prevTime = curTime;
-            prevGS = g_grayScale;
+        // detect the black to blue change and back by the gray scale level confirmed by the colour
+        int8_t change = CUSUM_NONE;
+        if (prevGS != INT16_MAX) {
+            change = gsCusum->add(g_grayScale - ma->mean());
         }
-
-        if ( (ma_gs > 150) || (ma_gs < -150) ){
-            //syslog(LOG_NOTICE, "gs = %d, MA = %d, gsDiff = %d, timeDiff = %d", g_grayScale, ma_gs, gsDiff, timeDiff);
-            if ( !blue_flag && ma_gs > 150 && g_rgb.b - g_rgb.r > 60 && g_rgb.b <= 255 && g_rgb.r <= 255 ) {
-                blue_flag = true;
-                syslog(LOG_NOTICE, "%08u, line color changed black to blue", clock->now());
-                stateMachine->sendTrigger(EVT_bk2bl);
-            } else if ( blue_flag && ma_gs < -150 && g_rgb.b - g_rgb.r < 40 ) {
-                blue_flag = false;
-                syslog(LOG_NOTICE, "%08u, line color changed blue to black", clock->now());
-                stateMachine->sendTrigger(EVT_bl2bk);
-            }
+        ma->add(g_grayScale);
+        prevGS = g_grayScale;
+        if ( !blue_flag && change == CUSUM_RISE && g_color == CLS_BLUE ) {
+            blue_flag = true;
+            gsCusum->clear();
+            syslog(LOG_NOTICE, "%08u, line color changed black to blue", clock->now());
+            stateMachine->sendTrigger(EVT_bk2bl);
+        } else if ( blue_flag && change == CUSUM_FALL && g_color != CLS_BLUE ) {
+            blue_flag = false;
+            gsCusum->clear();
+            syslog(LOG_NOTICE, "%08u, line color changed blue to black", clock->now());
+            stateMachine->sendTrigger(EVT_bl2bk);
         }
 
         // determine if tilt
@@ -251,13 +357,12 @@ void Observer::operate() {
     }
     
     curDegree180 = getDegree();
-    sonarDistance = sonarSensor->getDistance();
 
     // Preparation for slalom climbing
     if(!slalom_flg && !garage_flg){
         if (g_challenge_stepNo == 0 && sonarDistance >= 1 && sonarDistance <= 10 && !move_back_flg){
             state = ST_slalom;
-            armMotor->setPWM(-50);
+            actuator->setPWM(ACT_ARM, -50, this);
             stateMachine->sendTrigger(EVT_slalom_reached);
             g_challenge_stepNo = 1;
 
@@ -266,12 +371,14 @@ void Observer::operate() {
             distance = 0;
             prevAngL =0;
             prevAngR =0;
-            leftMotor->reset();
-            rightMotor->reset();
+            actuator->reset(ACT_LEFT);
+            actuator->reset(ACT_RIGHT);
             azimuth = 0;
+            heading->reset();
+            localizer->reset();
 
             stateMachine->sendTrigger(EVT_slalom_reached);
-            armMotor->setPWM(60);
+            actuator->setPWM(ACT_ARM, 60, this);
             g_challenge_stepNo = 10;
             move_back_flg = true;
         }
@@ -289,7 +396,7 @@ void Observer::operate() {
             prevDis = distance;
             prevDisY = locY;
             prevDegree180=getDegree();
-            armMotor->setPWM(-100);
+            actuator->setPWM(ACT_ARM, -100, this);
         }
     }
 
@@ -303,12 +410,19 @@ void Observer::operate() {
         //      }
         // }
 
+#if defined(MAKE_PATH)
+        // the route replaces the steps up to 140, the board is left the same way after it
+        if(g_challenge_stepNo == 10 && distance - prevDis > 30){
+            g_challenge_stepNo = 139;
+            stateMachine->sendTrigger(EVT_path_start);
+        }
+#else
         //初期位置の特定
         if(g_challenge_stepNo == 10 && distance - prevDis > 30){
             prevDisX = locX;
             prevRgbSum = curRgbSum;
             prevRgbSum = curRgbSum;
-            if(curRgbSum < 100){
+            if(g_color == CLS_BLACK){
                 //もともと黒の上にいる場合、ライン下方面に回転
                 prevDisX = locX;
                 g_challenge_stepNo = 20;
@@ -319,7 +433,7 @@ void Observer::operate() {
             }
         }else if(g_challenge_stepNo == 11){
             //センサーで黒を検知した場合
-            if(curRgbSum < 100 ){
+            if(g_color == CLS_BLACK ){
                 //その場でライン下方面に回転
                 prevDisX = locX;
                 g_challenge_stepNo = 20;
@@ -342,7 +456,7 @@ void Observer::operate() {
                 g_challenge_stepNo = 13;
             
             //途中で黒を検知した場合、左下へ移動
-            }else if(curRgbSum < 100 ){
+            }else if(g_color == CLS_BLACK ){
                 //その場でライン下方面に回転
                 prevDisX = locX;
                 g_challenge_stepNo = 20;
@@ -350,7 +464,7 @@ void Observer::operate() {
 
         }else if(g_challenge_stepNo == 13){
             //センサーで黒を検知した場合
-            if(curRgbSum < 100 ){
+            if(g_color == CLS_BLACK ){
                 //その場でライン下方面に回転
                 prevDisX = locX;
                 stateMachine->sendTrigger(EVT_slalom_challenge);
@@ -360,35 +474,17 @@ void Observer::operate() {
         }else if(g_challenge_stepNo == 20 && curDegree180 >= -45){
             //その場で左回転
             g_challenge_stepNo = 21;
-            stateMachine->sendTrigger(EVT_slalom_challenge);//21
             roots_no = 1;
+            stateMachine->sendTrigger(EVT_slalom_challenge);//21 ChallengeRunner goes on by itself up to 30
             printf("上から回転\n");
 
         }else if(g_challenge_stepNo == 20 && curDegree180 < -45){
             //その場で右回転
             g_challenge_stepNo = 22;
-            stateMachine->sendTrigger(EVT_slalom_challenge);//22
             roots_no = 2;
+            stateMachine->sendTrigger(EVT_slalom_challenge);//22 ChallengeRunner goes on by itself up to 30
             printf("下から回転\n");
 
-        }else if((g_challenge_stepNo == 21 && curDegree180 <= -45) || (g_challenge_stepNo == 22 && curDegree180 >= -55)){
-            //角度が一定角度になったら、停止、直進
-                g_challenge_stepNo = 23;
-                stateMachine->sendTrigger(EVT_slalom_challenge); //23
-                g_challenge_stepNo = 24;
-
-        } else if(g_challenge_stepNo == 24){
-            if((roots_no == 1 && own_abs(prevDisX - locX) > 120) || (roots_no ==2 && own_abs(prevDisX - locX) > 127)){
-                //進行方向に対して横軸に距離進んだら、角度を0度に戻す
-                stateMachine->sendTrigger(EVT_slalom_challenge); //24
-                g_challenge_stepNo = 30;
-            }
-        }else if(g_challenge_stepNo == 30){
-            if((roots_no == 1 && curDegree180 > prevDegree180 - 2) || (roots_no == 2 && curDegree180 > prevDegree180 +2)){
-                //進行方向に対して横軸に進んだら、角度を戻す
-                stateMachine->sendTrigger(EVT_slalom_challenge);
-                g_challenge_stepNo = 40;
-            }
         // ２つ目の障害物に接近したら向きを変える
         }else if (g_challenge_stepNo == 40){
             if(locY - prevDisY > 554 || check_sonar(0,5)){
@@ -396,23 +492,22 @@ void Observer::operate() {
                 g_challenge_stepNo = 41;
                 stateMachine->sendTrigger(EVT_slalom_challenge);
                 g_challenge_stepNo = 50;
-                prevRgbSum = curRgbSum;
+                prevColor = g_color;
                 line_over_flg = false;
-                prevRgbSum = curRgbSum;
             }
         // 視界が晴れたら左上に前進する
         }else if(g_challenge_stepNo == 50  && (check_sonar(50,255)|| own_abs(curDegree180-prevDegree180) > 55)){
             printf(",視界が晴れたところで前進する");
             stateMachine->sendTrigger(EVT_slalom_challenge);
             g_challenge_stepNo = 60;
-            prevRgbSum = curRgbSum;
+            prevColor = g_color;
             line_over_flg = false;
         // 黒ラインを超えるまで前進し、超えたら向きを調整し３つ目の障害物に接近する
         }else if (g_challenge_stepNo == 60 && !line_over_flg){
-            if (curRgbSum < 100) {
-                prevRgbSum = curRgbSum;
+            if (g_color == CLS_BLACK) {
+                prevColor = g_color;
             }
-            if(prevRgbSum < 100 && curRgbSum > 125){
+            if(prevColor == CLS_BLACK && curRgbSum > 125){
                 printf(",黒ラインを超えたら向きを調整し障害物に接近する\n");
                 stateMachine->sendTrigger(EVT_slalom_challenge);
                 //prevDis=distance;
@@ -423,23 +518,22 @@ void Observer::operate() {
                 g_challenge_stepNo = 71;
             }
         }else if(g_challenge_stepNo == 71 && check_sonar(0,5)){
-                stateMachine->sendTrigger(EVT_slalom_challenge);
-                g_challenge_stepNo = 80;
+                stateMachine->sendTrigger(EVT_slalom_challenge); // ChallengeRunner turns and goes on to 80 by itself
+                g_challenge_stepNo = 72;
                 line_over_flg = true;
-                prevDegree180 = curDegree180;
         // 視界が晴れたら左下に前進する
-        }else if (g_challenge_stepNo == 80  && own_abs(prevDegree180 - curDegree180) > 65){
+        }else if (g_challenge_stepNo == 80){
                 printf(",視界が晴れたら左下に前進する\n");
                 stateMachine->sendTrigger(EVT_slalom_challenge);
                 g_challenge_stepNo = 90;
-                prevRgbSum = curRgbSum;
+                prevColor = g_color;
                 line_over_flg = false;
         // 黒ラインを超えるまで前進し、超えたら向きを調整する
         }else if (g_challenge_stepNo == 90 && !line_over_flg){
-            if (curRgbSum < 100) {
-                prevRgbSum = curRgbSum;
+            if (g_color == CLS_BLACK) {
+                prevColor = g_color;
             }
-            if(prevRgbSum < 100 && curRgbSum > 150){
+            if(prevColor == CLS_BLACK && curRgbSum > 150){
                 printf(",黒ラインを超えたら向きを調整する\n");
                 stateMachine->sendTrigger(EVT_slalom_challenge);
                 g_challenge_stepNo = 100;
@@ -467,15 +561,15 @@ void Observer::operate() {
             printf(",視界が晴れたら左上に前進する\n");
             stateMachine->sendTrigger(EVT_slalom_challenge);
             g_challenge_stepNo = 130;
-            prevRgbSum = curRgbSum;
+            prevColor = g_color;
             line_over_flg = false;
         // 黒ラインを２つ目まで前進し、２つ目に載ったら向きを調整する
         }else if (g_challenge_stepNo == 130){
             if (!line_over_flg){
-                if (curRgbSum < 100) {
-                    prevRgbSum = curRgbSum;
+                if (g_color == CLS_BLACK) {
+                    prevColor = g_color;
                 }
-                if(prevRgbSum < 100 && curRgbSum > 160){
+                if(prevColor == CLS_BLACK && curRgbSum > 160){
                     line_over_flg = true;
                 }
             }else if (curRgbSum < 60 && line_over_flg) {
@@ -494,9 +588,10 @@ void Observer::operate() {
         }else if((g_challenge_stepNo == 141 && own_abs(curDegree180 - prevDegree180) > 30)||(g_challenge_stepNo == 140 && own_abs(curDegree180 - prevDegree180) > 40)){
             printf(",直進しスラロームを降りる\n");
             stateMachine->sendTrigger(EVT_slalom_challenge);
-            armMotor->setPWM(30);
+            actuator->setPWM(ACT_ARM, 30, this);
             g_challenge_stepNo = 150;
         }
+#endif
         
         if(g_challenge_stepNo == 140){
             printf("r=%d,g=%d,b=%d,curRgbSum=%d\n",cur_rgb.r,cur_rgb.g,cur_rgb.b,curRgbSum);
@@ -514,9 +609,10 @@ void Observer::operate() {
             prevAngL =0; //初期化 
             prevAngR =0; //初期化 
             azimuth = 0; //初期化 
-            leftMotor->reset(); //初期化 
-            rightMotor->reset(); //初期化 
-            armMotor->setPWM(-100); //初期化 
+            heading->reset(); //初期化
+            actuator->reset(ACT_LEFT); //初期化 
+            actuator->reset(ACT_RIGHT); //初期化 
+            actuator->setPWM(ACT_ARM, -100, this); //初期化 
             curAngle = 0;//初期化
             prevAngle = 0;//初期化
             g_challenge_stepNo = 150;
@@ -561,29 +657,36 @@ void Observer::operate() {
 
         //升目ラインの大外枠とクロス。黒、赤、黄色の３パターンのクロスがある
         else if(g_challenge_stepNo == 180){
-        
+#if defined(MAKE_PATH)
+            // the route of the colour crossed replaces the steps up to 286, the garage is entered the same way after it
+            if(g_color == CLS_BLACK || g_color == CLS_RED || g_color == CLS_YELLOW){
+                roots_no = (g_color == CLS_BLACK) ? 1 : (g_color == CLS_RED) ? 2 : 3;
+                g_challenge_stepNo = 289;
+                stateMachine->sendTrigger(EVT_path_start);
+            }
+#else
             //黒を見つけたら、下向きのライントレース
-            if(cur_rgb.g + cur_rgb.b <= 100 && cur_rgb.r <=50 && cur_rgb.g <=40 && cur_rgb.b <=60){
+            if(g_color == CLS_BLACK){
                 printf("黒を見つけたら、下向きのライントレース\n");
                 g_challenge_stepNo = 190;
-                stateMachine->sendTrigger(EVT_block_challenge);//190
-                prevDegree360 = curDegree360;
+                stateMachine->sendTrigger(EVT_block_challenge);//190 ChallengeRunner turns and goes on to 193 by itself
                 g_challenge_stepNo = 191;
             }
             //赤を見つけたら、赤からブロックへ  直進
-            else if(cur_rgb.r - cur_rgb.b >=40 && cur_rgb.g <65 && cur_rgb.r - cur_rgb.g >30){
+            else if(g_color == CLS_RED){
                 printf("赤を見つけたら、赤からブロックへ  直進\n");
                 g_challenge_stepNo = 200;
-                stateMachine->sendTrigger(EVT_block_challenge); //200
+                stateMachine->sendTrigger(EVT_block_challenge); //200 ChallengeRunner turns and goes on to 250 by itself
                 g_challenge_stepNo = 201;
-                prevDegree360 = curDegree360;
+                roots_no = 2;
                 printf("赤色超えました\n");
             }
             
             //黄色を見つけたら、右に直進のライントレース
-            else if(cur_rgb.r + cur_rgb.g - cur_rgb.b >= 160 &&  cur_rgb.r - cur_rgb.g <= 30){
+            else if(g_color == CLS_YELLOW){
                 printf("黄色を見つけたら、右に直進のライントレース\n");
                 g_challenge_stepNo = 210;
+                roots_no = 3;
                 stateMachine->sendTrigger(EVT_block_challenge); //210
                 g_challenge_stepNo = 211;
 
@@ -595,78 +698,60 @@ void Observer::operate() {
                 prevDis = distance;
             }
          //黒ライン進入の続き
-        }else if(g_challenge_stepNo == 191 && own_abs(curDegree360 - prevDegree360) > 40){
-                g_challenge_stepNo = 192;
-        
-        }else if(g_challenge_stepNo == 192 && (curRgbSum <= 150 || own_abs(curDegree360 - prevDegree360) > 80)){
-                prevDegree360 = curDegree360;
-                g_challenge_stepNo = 193;
-        
-        }else if(g_challenge_stepNo == 193 && own_abs(curDegree360 - prevDegree360) > 25){
+        }else if(g_challenge_stepNo == 193){
 
-                printf("黄色のほうへ,角度=%d,%d　計算=%d",curDegree360,prevDegree360,own_abs(curDegree360 - prevDegree360));
+                printf("黄色のほうへ,角度=%d",curDegree360);
                 stateMachine->sendTrigger(EVT_line_on_p_cntl); //193
                 g_challenge_stepNo = 220;
                 prevDegree360 = curDegree360;
                 roots_no = 1;
 
-        }else if(g_challenge_stepNo >= 191 || g_challenge_stepNo <= 193 ){
-                //printf("r=%d,g=%d,b=%d,curRgbSum=%d\n",cur_rgb.r,cur_rgb.g,cur_rgb.b,curRgbSum);
-
-        //赤ライン進入の続き
-        }else if(g_challenge_stepNo == 201 && curDegree360 - prevDegree360 > 93){
-                printf("赤色超えました2\n");
-                stateMachine->sendTrigger(EVT_block_challenge); //201
-                g_challenge_stepNo = 250;
-                roots_no = 2;
         //黄色ライン進入の続き
-        }else if(g_challenge_stepNo==212 && cur_rgb.r + cur_rgb.g - cur_rgb.b <= 130){
+        }else if(g_challenge_stepNo==212 && g_color != CLS_YELLOW && g_color != CLS_WHITE){
                 g_challenge_stepNo = 213;
 
-        }else if((g_challenge_stepNo==213 && cur_rgb.r + cur_rgb.g - cur_rgb.b >= 160)|| (g_challenge_stepNo==212 && distance-prevDis>70)){
+        }else if((g_challenge_stepNo==213 && g_color == CLS_YELLOW)|| (g_challenge_stepNo==212 && distance-prevDis>70)){
                 printf("黄色超えました23\n");
                 g_challenge_stepNo = 213;
                 stateMachine->sendTrigger(EVT_line_on_pid_cntl); //213
                 g_challenge_stepNo = 250;
         
         //黒ラインからの黄色を見つけたらブロック方向へターン
-        }else if(g_challenge_stepNo ==220 && cur_rgb.r + cur_rgb.g - cur_rgb.b >= 160 &&  cur_rgb.r - cur_rgb.g <= 30){
+        }else if(g_challenge_stepNo ==220 && g_color == CLS_YELLOW){
             
             printf("ここのprevDegree360=%d,azi=%d,sa=%d\n",prevDegree360,curDegree360,prevDegree360-curDegree360);
-            //prevDegree180は黒ライン侵入時、回転後のもの
+            //prevDegree360は黒ライン侵入時、回転後のもの、ChallengeRunnerはそこから93度まで回転する
             cntDegree = prevDegree360 - curDegree360;
-            prevDegree360 = curDegree360;
             g_challenge_stepNo = 230;
-            stateMachine->sendTrigger(EVT_block_area_in); //230
-            g_challenge_stepNo = 231;
+            stateMachine->sendTrigger(EVT_block_area_in); //230 ChallengeRunner turns and goes on to 231 by itself
 
-        }else if(g_challenge_stepNo==231 && prevDegree360 - curDegree360 + cntDegree > 67 + 26){
+        }else if(g_challenge_stepNo==231){
             prevDis = distance;
             stateMachine->sendTrigger(EVT_block_challenge); //231
             g_challenge_stepNo = 232;
             printf("ここまで黄色エリア１ cntDegree=%d,azi=%d,sa=%d,gosa=%d\n",prevDegree360,curDegree360,prevDegree360 -curDegree360,cntDegree);
         
         
-        }else if(g_challenge_stepNo == 232 && distance - prevDis > 180 && cur_rgb.r + cur_rgb.g - cur_rgb.b <= 130 ){
+        }else if(g_challenge_stepNo == 232 && distance - prevDis > 180 && g_color != CLS_YELLOW && g_color != CLS_WHITE ){
             printf("ここまで黄色エリア２\n");
             stateMachine->sendTrigger(EVT_line_on_pid_cntl); //232
             g_challenge_stepNo = 250;
         
         //赤を見つけたら黒を見つけるまで直進、その後ライントレース
-        }else if(g_challenge_stepNo == 220 && cur_rgb.r - cur_rgb.b >= 40 && cur_rgb.g < 60 && cur_rgb.r - cur_rgb.g > 30){
+        }else if(g_challenge_stepNo == 220 && g_color == CLS_RED){
             g_challenge_stepNo = 240;
             //直前までライントレース
             stateMachine->sendTrigger(EVT_block_area_in); //240
             g_challenge_stepNo = 241;
         
         //赤を離脱するために以下の分岐にあるカラーを順番にたどる
-        }else if( cur_rgb.r - cur_rgb.b < 20 && g_challenge_stepNo == 241){
+        }else if( g_color != CLS_RED && g_color != CLS_YELLOW && g_challenge_stepNo == 241){
             g_challenge_stepNo = 242;
-        }else if( cur_rgb.r - cur_rgb.b >=40 && g_challenge_stepNo == 242){
+        }else if( (g_color == CLS_RED || g_color == CLS_YELLOW) && g_challenge_stepNo == 242){
             g_challenge_stepNo = 243;
         
         //赤を通過時、大きくラインを外れたら、カーブして戻る
-        }else if(g_challenge_stepNo == 243 && cur_rgb.r + cur_rgb.g + cur_rgb.b > 300){
+        }else if(g_challenge_stepNo == 243 && g_color == CLS_WHITE){
             g_challenge_stepNo = 244;
             stateMachine->sendTrigger(EVT_block_challenge); //244
             g_challenge_stepNo = 245;
@@ -675,41 +760,23 @@ void Observer::operate() {
             g_challenge_stepNo = 220;
 
         //ラインを外れていなければ、黒のライントレースへ
-        }else if(g_challenge_stepNo == 243 && cur_rgb.r + cur_rgb.g + cur_rgb.b <= 100){
+        }else if(g_challenge_stepNo == 243 && g_color == CLS_BLACK){
             g_challenge_stepNo = 246;
             stateMachine->sendTrigger(EVT_line_on_pid_cntl); //246 
             g_challenge_stepNo = 220;
         
         }else if(g_challenge_stepNo==250){                
             //ブロックに直進、ブロックの黄色を見つけたら
-            if(cur_rgb.r + cur_rgb.g - cur_rgb.b >= 150){
+            if(g_color == CLS_YELLOW){
                     printf("ブロックGETしてほしい\n");                 
                     g_challenge_stepNo = 260;
             }
         //ガレージに戻るべく、ターン
         }else if(g_challenge_stepNo == 260){
             //走行体回頭
+            // ChallengeRunner turns by the angle of the route and goes on to 262 by itself
             stateMachine->sendTrigger(EVT_block_area_in); //260
-            prevDegree360 = curDegree360;
-            cntDegree = 0;
             g_challenge_stepNo = 261;
-
-            //赤〇ポイントからのブロック到達の場合
-            if(roots_no==2){ 
-                //回転角度に140度をセット
-                turnDegree = 140;
-            //黒ライン、黄色直進からのブロック到達の場合
-            }else{
-                //回転角度に80度をセット
-                turnDegree = 100;
-            }
-        }else if(g_challenge_stepNo == 261 && cntDegree > turnDegree){
-            stateMachine->sendTrigger(EVT_block_challenge); //261
-            g_challenge_stepNo = 262;
-
-        }else if(g_challenge_stepNo == 261){ //角度が条件に該当しない場合、差分を累積していく。
-            cntDegree += getTurnDgree(prevDegree360,curDegree360);
-            prevDegree360 = curDegree360;
         //前方に何もない状況になったら進行
         }else if(g_challenge_stepNo == 262){
             if(check_sonar(255,255)){
@@ -733,42 +800,32 @@ void Observer::operate() {
             g_challenge_stepNo = 280;
         }
         //緑を見つけたら、減速
-        else if(g_challenge_stepNo == 280 && cur_rgb.r <= 13 && cur_rgb.b <= 50 && cur_rgb.g > 60){ 
+        else if(g_challenge_stepNo == 280 && g_color == CLS_GREEN){ 
             g_challenge_stepNo = 281;
  
         //一度白を通過
-        }else if(g_challenge_stepNo == 281 && curRgbSum > 300){
+        }else if(g_challenge_stepNo == 281 && g_color == CLS_WHITE){
             g_challenge_stepNo = 282;
 
         //緑をみつけたらカーブ開始
-        }else if(g_challenge_stepNo == 282 && cur_rgb.r <= 13 && cur_rgb.b <= 50 && cur_rgb.g > 60 ){
+        }else if(g_challenge_stepNo == 282 && g_color == CLS_GREEN ){
             stateMachine->sendTrigger(EVT_block_challenge); //282
             g_challenge_stepNo = 283;
         
         //一度白を通過
-        }else if(g_challenge_stepNo == 283 && curRgbSum > 300){
+        }else if(g_challenge_stepNo == 283 && g_color == CLS_WHITE){
             g_challenge_stepNo = 284;
 
-        }else if(g_challenge_stepNo == 284 && cur_rgb.r + cur_rgb.g <= 150){  //青または黒をみつけたら、完全にターン)
+        }else if(g_challenge_stepNo == 284 && (g_color == CLS_BLUE || g_color == CLS_BLACK || g_color == CLS_GRAY)){  //青または黒をみつけたら、完全にターン)
             g_challenge_stepNo = 284;
             stateMachine->sendTrigger(EVT_block_challenge); //284
             g_challenge_stepNo = 285;
             clock->sleep(500);
         // ガレージの奥の距離を捉えたら直進
         }else if(g_challenge_stepNo == 285 && check_sonar(35,250)){
-            prevDegree360 = curDegree360;
-            cntDegree = 0;
+            stateMachine->sendTrigger(EVT_block_challenge); //285 ChallengeRunner turns and goes on to 290 by itself
             g_challenge_stepNo = 286;
-        }else if(g_challenge_stepNo == 286){
-            
-            cntDegree += getTurnDgree(prevDegree360,curDegree360);
-            prevDegree360 = curDegree360;
-
-            if(cntDegree > 27){
-                stateMachine->sendTrigger(EVT_block_challenge); //286
-                g_challenge_stepNo = 290;
-            }
-
+#endif
         }else if(g_challenge_stepNo == 290 && check_sonar(0,15)){
                 stateMachine->sendTrigger(EVT_block_challenge); //290
                 garage_flg = false;
@@ -788,6 +845,28 @@ void Observer::operate() {
     integD  += deltaDist;  // temp
     integDL += deltaDistL; // temp
     integDR += deltaDistR; // temp
+
+    // the control loop only enqueues, TLM_TSK does the packing and the writing
+    if (telemetry != NULL && telemetry->isDue()) {
+        struct tlmRecord r;
+        r.time      = clock->now();
+        r.distance  = getDistance();
+        r.locX      = getLocX();
+        r.locY      = getLocY();
+        r.azimuth   = getAzimuth();
+        r.grayScale = g_grayScale;
+        r.turn      = g_turn;
+        r.stepNo    = g_challenge_stepNo;
+        r.pwmL      = actuator->getPWM(ACT_LEFT);
+        r.pwmR      = actuator->getPWM(ACT_RIGHT);
+        r.state     = state;
+        r.color     = g_color;
+        r.r         = (cur_rgb.r > 255) ? 255 : cur_rgb.r;
+        r.g         = (cur_rgb.g > 255) ? 255 : cur_rgb.g;
+        r.b         = (cur_rgb.b > 255) ? 255 : cur_rgb.b;
+        r.reserved  = 0;
+        telemetry->enqueue(r);
+    }
     // display trace message in every PERIOD_TRACE_MSG ms
     if (++traceCnt * PERIOD_OBS_TSK >= PERIOD_TRACE_MSG) {
         traceCnt = 0;
@@ -816,18 +895,46 @@ void Observer::deactivate() {
     //clock->sleep() seems to be still taking milisec parm
     clock->sleep(PERIOD_OBS_TSK/2/1000); // wait a while
     _debug(syslog(LOG_NOTICE, "%08u, Observer handler unset", clock->now()));
+    colorMode->report();
+    reportAcquisition();
+}
+
+// time the reads took per cycle, as a histogram, and what each of them took
+void Observer::reportAcquisition() {
+    uint32_t ticks = sched->getTicks();
+    if (ticks == 0) return;
+    syslog(LOG_NOTICE, "%08u, Observer acquisition: %u cycles, mean %u us, max %u us", clock->now(),
+           ticks, sched->getMeanCost(), sched->getMaxCost());
+    for (int i = 0; i < SCH_COST_BINS; i++) {
+        uint32_t n = sched->getHistogram(i);
+        if (n == 0) continue;
+        if (i < SCH_COST_BINS - 1) {
+            syslog(LOG_NOTICE, "%08u, Observer acquisition: %4u-%4u us %7u cycles (%3u%%)", clock->now(),
+                   i * SCH_COST_BIN, (i + 1) * SCH_COST_BIN - 1, n, n * 100 / ticks);
+        } else {
+            syslog(LOG_NOTICE, "%08u, Observer acquisition: %4u us and over %7u cycles (%3u%%)", clock->now(),
+                   i * SCH_COST_BIN, n, n * 100 / ticks);
+        }
+    }
+    for (int i = 0; i < sched->getNumTasks(); i++) {
+        const struct schTask& t = sched->getTask(i);
+        syslog(LOG_NOTICE, "%08u, Observer acquisition: %-6s every %2u at %2u, %7u reads of %4u us", clock->now(),
+               snsName[i], t.divisor, t.phase, t.runs, (t.runs == 0) ? 0 : t.costUs / t.runs);
+    }
 }
 
 bool Observer::check_touch(void) {
-    if (touchSensor->isPressed()) {
-        return true;
-    } else {
-        return false;
+    if (sched->isDue(SNS_TOUCH)) {
+        SYSUTM start;
+        get_utm(&start);
+        touchPressed = touchSensor->isPressed();
+        sched->done(SNS_TOUCH, us_since(start));
     }
+    return touchPressed;
 }
 
 bool Observer::check_sonar(void) {
-    int32_t distance = sonarSensor->getDistance();
+    int32_t distance = sonarDistance;
     if ((distance <= SONAR_ALERT_DISTANCE) && (distance >= 0)) {
         return true; // obstacle detected - alert
     } else {
@@ -836,7 +943,7 @@ bool Observer::check_sonar(void) {
 }
 
 bool Observer::check_sonar(int16_t sonar_alert_dist_from, int16_t sonar_alert_dist_to) {
-    int32_t distance = sonarSensor->getDistance();
+    int32_t distance = sonarDistance;
     //printf(",distance2=%d, sonar_alert_dist_from=%d, sonar_alert_dist_to=%d\n",distance, sonar_alert_dist_from, sonar_alert_dist_to );
     if (distance >= sonar_alert_dist_from && distance <= sonar_alert_dist_to) {
         return true; // obstacle detected - alert
@@ -846,15 +953,17 @@ bool Observer::check_sonar(int16_t sonar_alert_dist_from, int16_t sonar_alert_di
 }
 
 bool Observer::check_backButton(void) {
-    if (ev3_button_is_pressed(BACK_BUTTON)) {
-        return true;
-    } else {
-        return false;
+    if (sched->isDue(SNS_BUTTON)) {
+        SYSUTM start;
+        get_utm(&start);
+        backPressed = ev3_button_is_pressed(BACK_BUTTON);
+        sched->done(SNS_BUTTON, us_since(start));
     }
+    return backPressed;
 }
 
 bool Observer::check_lost(void) {
-    if (g_grayScale > GS_LOST) {
+    if (g_grayScale > gsLost) {
         return true;
     } else {
         return false;
@@ -892,6 +1001,28 @@ void Observer::unfreeze() {
     frozen = false;
 }
 
+// invoked from the command task, the event is sent to the state machine in the next operate().
+// the command task is the only writer of cmdHead, the event is stored before it moves
+bool Observer::notifyOfCommand(uint8_t event) {
+    uint8_t next = (cmdHead + 1) % CMD_QUEUE_LEN;
+    if (next == cmdTail) return false;
+    cmdQueue[cmdHead] = event;
+    cmdHead = next;
+    return true;
+}
+
+void Observer::startLearning(CourseLearner* cl) {
+    cl->reset();
+    learner = cl;
+}
+
+void Observer::stopLearning() {
+    if (learner != NULL) {
+        learner->finish(distance);
+        learner = NULL;
+    }
+}
+
 //角度累積分を計算
 int16_t Observer::getTurnDgree(int16_t prev_x,int16_t x){
 
@@ -10,9 +10,16 @@
 
 #include "aflac_common.hpp"
 #include "utility.hpp"
+#include "CourseLearner.hpp"
+#include "ColorClassifier.hpp"
+#include "HeadingEstimator.hpp"
+#include "Localizer.hpp"
+#include "ColorModeManager.hpp"
+#include "SensorScheduler.hpp"
 
 #define OLT_SKIP_PERIOD    1000 * 1000 // period to skip outlier test in miliseconds
 #define OLT_INIT_PERIOD    3000 * 1000 // period before starting outlier test in miliseconds
+#define CMD_QUEUE_LEN      4  // commands waiting for the next cycle, one less than this
 
 // FIR filter parameters
 const int FIR_ORDER = 10;
@@ -22,6 +29,14 @@ const double hn[FIR_ORDER+1] = { -1.247414986406201e-18, -1.270350182429102e-02,
 // moving average parameter
 const int MA_CAP = 10;
 
+// acquisitions of the observer cycle, in the order they are added to its SensorScheduler
+#define SNS_COLOR       0
+#define SNS_GYRO        1
+#define SNS_WHEELS      2
+#define SNS_SONAR       3
+#define SNS_TOUCH       4
+#define SNS_BUTTON      5
+
 class Observer {
 private:
     Motor*          leftMotor;
@@ -35,15 +50,26 @@ private:
     double distance, azimuth, locX, locY,prevDis,prevDisX,prevDisY;
     double integD, integDL, integDR; // temp
     int8_t process_count,roots_no;
-    int16_t traceCnt, prevGS, curRgbSum, prevRgbSum, curAngle, prevAngle, curDegree180, prevDegree180,curDegree360, prevDegree360,cntDegree,turnDegree;
-    int32_t prevAngL, prevAngR, notifyDistance, gsDiff, timeDiff, sonarDistance;
-    uint64_t curTime, prevTime;
+    int16_t traceCnt, prevGS, curRgbSum, prevRgbSum, curAngle, prevAngle, curDegree180, prevDegree180,curDegree360, prevDegree360,cntDegree;
+    int32_t prevAngL, prevAngR, notifyDistance, sonarDistance;
     bool touch_flag, sonar_flag, backButton_flag, lost_flag, frozen, blue_flag, blue2_flg, slalom_flg, line_over_flg, move_back_flg,garage_flg;
 
     rgb_raw_t cur_rgb;
     hsv_raw_t cur_hsv;
     FIR_Transposed<FIR_ORDER> *fir_r, *fir_g, *fir_b;
-    MovingAverage<int32_t, MA_CAP> *ma;
+    WindowStats<int16_t, MA_CAP, int32_t> *ma; // baseline of the gray scale level
+    MedianFilter<int16_t, SONAR_MEDIAN> *sonarFilter; // sonarDistance is its output
+    CusumDetector<int32_t> *gsCusum; // change of the gray scale level on a black/blue transition
+    ColorClassifier* classifier;
+    ColorModeManager* colorMode;    // the only reader of colorSensor, held in CSM_RGB
+    SensorScheduler* sched;         // when each sensor is read, and how long it took
+    bool            touchPressed, backPressed; // as last read
+    HeadingEstimator* heading;      // the one source of azimuth and curDegree360
+    Localizer*      localizer;      // distance along the course map corrected by colour landmarks
+    uint8_t         prevColor; // colour latched by the slalom steps to detect crossing a line
+    CourseLearner*  learner;
+    uint8_t         cmdQueue[CMD_QUEUE_LEN]; // events posted by the command task
+    volatile uint8_t cmdHead, cmdTail; // written by the command task and by operate() alone
     //OutlierTester*  ot_r;
     //OutlierTester*  ot_g;
     //OutlierTester*  ot_b;
@@ -55,6 +81,7 @@ private:
     bool check_lost(void);
     bool check_tilt(void);
     int16_t getTurnDgree(int16_t prev_x,int16_t x);
+    void reportAcquisition();
     
 protected:
 public:
@@ -64,15 +91,25 @@ public:
     void reset();
     void notifyOfDistance(int32_t delta);
     int32_t getDistance();
+    int32_t getCourseDistance();
+    int32_t getLateral();
+    void setLandmarks(const struct cfFeature* f, int n, int32_t length);
     int32_t getSonarDistance();
+    uint32_t getAge(int8_t sns); // miliseconds since the SNS_ acquisition, SCH_NEVER before the first
     int16_t getAzimuth();
     int16_t getDegree();
+    int8_t getRoute();          // way in: slalom 1 or 2, block area 1 black, 2 red, 3 yellow frame
+    int16_t getLatchedDegree(); // heading latched by the steps, as getDegree() on the slalom and from 0 to 359 in the block area
     int32_t getLocX();
     int32_t getLocY();
     void operate(); // method to invoke from the cyclic handler
     void deactivate();
     void freeze();
     void unfreeze();
+    bool notifyOfCommand(uint8_t event); // false when the queue is full
+    void rebuildClassifier(); // after the colour centroids have changed
+    void startLearning(CourseLearner* cl);
+    void stopLearning();
     ~Observer();
 };
 
@@ -0,0 +1,137 @@
+//
+//  ParamStore.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "ParamStore.hpp"
+#include <string.h>
+
+struct paramBlock g_params;
+volatile uint32_t g_paramsVersion = 0;
+
+#define PARAM_TYPE(name, type, def, min, max) PT_##type,
+static const int8_t paramTypes[NUM_PARAMS] = { PARAM_LIST(PARAM_TYPE) };
+#undef PARAM_TYPE
+
+#define PARAM_MIN(name, type, def, min, max) (double)(min),
+static const double paramMin[NUM_PARAMS] = { PARAM_LIST(PARAM_MIN) };
+#undef PARAM_MIN
+
+#define PARAM_MAX(name, type, def, min, max) (double)(max),
+static const double paramMax[NUM_PARAMS] = { PARAM_LIST(PARAM_MAX) };
+#undef PARAM_MAX
+
+#define PARAM_NAME(name, type, def, min, max) #name,
+static const char* const paramNames[NUM_PARAMS] = { PARAM_LIST(PARAM_NAME) };
+#undef PARAM_NAME
+
+ParamStore::ParamStore() {
+    for (int i = 0; i < (1 << PARAM_HASH_BITS); i++) slotToId[i] = -1;
+    for (int i = 0; i < NUM_PARAMS; i++) slotToId[param_slot(paramKeys[i])] = i;
+    reset();
+}
+
+// set every parameter to the default given by its macro
+void ParamStore::reset() {
+#define PARAM_SET_INT(id, def) g_params.v[id].i = (int32_t)(def);
+#define PARAM_SET_FLT(id, def) g_params.v[id].f = (float)(def);
+#define PARAM_DEFAULT(name, type, def, min, max) PARAM_SET_##type(PRM_##name, def)
+    PARAM_LIST(PARAM_DEFAULT)
+#undef PARAM_DEFAULT
+#undef PARAM_SET_FLT
+#undef PARAM_SET_INT
+}
+
+// apply the parameters of the course file over the current values.
+// returns the number of parameters applied, or -1 when the file is missing or corrupted
+int ParamStore::load(const char* filename) {
+    CourseFile* file = new CourseFile();
+    if (!file->load(filename)) {
+        delete file;
+        return -1;
+    }
+    int n = 0;
+    for (int i = 0; i < file->getNumParams(); i++) {
+        const struct cfParam* p = file->getParam(i);
+        int id = find(p->key);
+        if (id >= 0) {
+            g_params.v[id].i = p->value; // the bit pattern is kept for FLT as well
+            n++;
+        }
+    }
+    delete file;
+    return n;
+}
+
+// write the current values of the given parameters into the course file, keeping the rest of it.
+// the parameters of the file stay sorted by key
+bool ParamStore::save(const char* filename, const int* ids, int n) {
+    CourseFile* file = new CourseFile();
+    bool loaded = file->load(filename);
+    int ns = loaded ? file->getNumSections() : 0;
+    int nf = loaded ? file->getNumFeatures() : 0;
+    int np = loaded ? file->getNumParams() : 0;
+    struct cfSection* sections = new struct cfSection[ns > 0 ? ns : 1];
+    struct cfFeature* features = new struct cfFeature[nf > 0 ? nf : 1];
+    struct cfParam* params = new struct cfParam[CF_MAX_PARAMS];
+    for (int i = 0; i < ns; i++) sections[i] = *file->getSection(i);
+    for (int i = 0; i < nf; i++) features[i] = *file->getFeature(i);
+    for (int i = 0; i < np; i++) params[i] = *file->getParam(i);
+    delete file; // the image of the file must be released before it is overwritten
+
+    for (int k = 0; k < n; k++) {
+        uint32_t key = paramKeys[ids[k]];
+        int i = 0;
+        while (i < np && params[i].key < key) i++;
+        if (i == np || params[i].key != key) {
+            if (np >= CF_MAX_PARAMS) continue;
+            memmove(&params[i + 1], &params[i], sizeof(struct cfParam) * (np - i));
+            params[i].key = key;
+            np++;
+        }
+        params[i].value = g_params.v[ids[k]].i;
+    }
+    bool result = CourseFile::write(filename, sections, ns, params, np, features, nf);
+    delete[] params;
+    delete[] features;
+    delete[] sections;
+    return result;
+}
+
+// O(1) lookup of the parameter id by key, -1 if the key is unknown
+int ParamStore::find(uint32_t key) {
+    int id = slotToId[param_slot(key)];
+    return (id >= 0 && paramKeys[id] == key) ? id : -1;
+}
+
+// raw value, the bit pattern for FLT
+int32_t ParamStore::get(int id) {
+    return g_params.v[id].i;
+}
+
+// a single aligned word store, thus safe against readers in other tasks
+void ParamStore::set(int id, int32_t raw) {
+    g_params.v[id].i = raw;
+    g_paramsVersion++;
+}
+
+// the bit pattern is taken as the type of the parameter, a NaN is never within the bounds
+bool ParamStore::check(int id, int32_t raw) {
+    union paramValue v;
+    v.i = raw;
+    double d = (paramTypes[id] == PT_FLT) ? (double)v.f : (double)v.i;
+    return d >= paramMin[id] && d <= paramMax[id];
+}
+
+int8_t ParamStore::getType(int id) {
+    return paramTypes[id];
+}
+
+const char* ParamStore::getName(int id) {
+    return paramNames[id];
+}
+
+ParamStore::~ParamStore() {
+}
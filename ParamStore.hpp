@@ -0,0 +1,127 @@
+//
+//  ParamStore.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef ParamStore_hpp
+#define ParamStore_hpp
+
+#include "aflac_common.hpp"
+#include "CourseFile.hpp"
+
+/**
+ * Runtime tunables, defaulting to the macros of the same name.
+ * P(name, type, default, min, max): INT parameters are stored as int32_t and FLT parameters as float.
+ * Values set at runtime outside min to max are refused.
+ * In the course file an FLT parameter holds the bit pattern of the float.
+ * Note: name must only be used with # or ## as it is a macro itself
+ */
+#define PARAM_LIST(P) \
+    P(GS_TARGET,        INT, GS_TARGET,           0, GS_MAX) \
+    P(GS_LOST,          INT, GS_LOST,             0, GS_MAX) \
+    P(LIGHT_WHITE,      INT, LIGHT_WHITE,         0, 100) \
+    P(LIGHT_BLACK,      INT, LIGHT_BLACK,         0, 100) \
+    P(RGB_WHITE,        INT, RGB_WHITE,           0, CLR_RGB(255, 255, 255)) \
+    P(RGB_BLACK,        INT, RGB_BLACK,           0, CLR_RGB(255, 255, 255)) \
+    P(P_CONST,          FLT, P_CONST,             0, 10) \
+    P(I_CONST,          FLT, I_CONST,             0, 10) \
+    P(D_CONST,          FLT, D_CONST,             0, 10) \
+    P(SPEED_NORM,       INT, SPEED_NORM,          0, 100) \
+    P(SPEED_SLOW,       INT, SPEED_SLOW,          0, 100) \
+    P(SPEED_RECOVER,    INT, SPEED_RECOVER,       0, 100) \
+    P(SPEED_BLIND,      INT, SPEED_BLIND,         0, 100) \
+    P(TURN_MIN,         INT, TURN_MIN,         -100, 0) \
+    P(TURN_MAX,         INT, TURN_MAX,            0, 100) \
+    P(PLAN_ACC_MAX,     INT, PLAN_ACC_MAX,        1, 5000) \
+    P(PLAN_DEC_MAX,     INT, PLAN_DEC_MAX,        1, 5000) \
+    P(PLAN_LAT_ACC_MAX, INT, PLAN_LAT_ACC_MAX,    1, 5000) \
+    P(CLR_BLACK,        INT, CLR_BLACK,           0, CLR_RGB(255, 255, 255)) \
+    P(CLR_GRAY,         INT, CLR_GRAY,            0, CLR_RGB(255, 255, 255)) \
+    P(CLR_WHITE,        INT, CLR_WHITE,           0, CLR_RGB(255, 255, 255)) \
+    P(CLR_BLUE,         INT, CLR_BLUE,            0, CLR_RGB(255, 255, 255)) \
+    P(CLR_RED,          INT, CLR_RED,             0, CLR_RGB(255, 255, 255)) \
+    P(CLR_YELLOW,       INT, CLR_YELLOW,          0, CLR_RGB(255, 255, 255)) \
+    P(CLR_GREEN,        INT, CLR_GREEN,           0, CLR_RGB(255, 255, 255)) \
+    P(CLR_REJECT,       INT, CLR_REJECT,          0, 3 * 255 * 255) \
+    P(TLM_DECIM,        INT, TLM_DECIM,           0, 100) \
+    P(CAL_ENABLE,       INT, CAL_ENABLE,          0, 1) \
+    P(MOT_GAIN_L,       FLT, MOT_GAIN,            0, 100) \
+    P(MOT_GAIN_R,       FLT, MOT_GAIN,            0, 100) \
+    P(MOT_TAU_L,        INT, MOT_TAU,             0, 1000) \
+    P(MOT_TAU_R,        INT, MOT_TAU,             0, 1000) \
+    P(MOT_DEAD_L,       INT, MOT_DEAD,            0, 100) \
+    P(MOT_DEAD_R,       INT, MOT_DEAD,            0, 100) \
+    P(MOT_VBAT,         INT, MOT_VBAT,            0, 10000)
+
+#define PARAM_ENUM(name, type, def, min, max) PRM_##name,
+enum paramId { PARAM_LIST(PARAM_ENUM) NUM_PARAMS };
+#undef PARAM_ENUM
+
+#define PT_INT  0
+#define PT_FLT  1
+
+union paramValue {
+    int32_t i;
+    float   f;
+};
+
+// flat storage of all parameters, hot paths keep references into it
+struct paramBlock {
+    union paramValue v[NUM_PARAMS];
+};
+extern struct paramBlock g_params;
+extern volatile uint32_t g_paramsVersion; // incremented on every change at runtime
+
+inline int32_t& paramInt(int id) { return g_params.v[id].i; }
+inline float& paramFloat(int id) { return g_params.v[id].f; }
+
+// compile time version of cf_hash() to give each parameter its key in the course file
+constexpr uint32_t param_hash(const char* name, uint32_t h = 2166136261UL) {
+    return *name ? param_hash(name + 1, (h ^ (uint8_t)*name) * 16777619UL) : h;
+}
+
+// keys are mapped to slots by a multiplicative hash, which must be perfect over PARAM_LIST
+#define PARAM_HASH_BITS 6
+#define PARAM_HASH_SEED 0x130cffUL
+constexpr uint32_t param_slot(uint32_t key) {
+    return (uint32_t)(key * PARAM_HASH_SEED) >> (32 - PARAM_HASH_BITS);
+}
+
+#define PARAM_KEY(name, type, def, min, max) param_hash(#name),
+constexpr uint32_t paramKeys[NUM_PARAMS] = { PARAM_LIST(PARAM_KEY) };
+#undef PARAM_KEY
+
+constexpr bool param_unique(int i, int j) {
+    return j >= NUM_PARAMS ? true : (param_slot(paramKeys[i]) != param_slot(paramKeys[j]) && param_unique(i, j + 1));
+}
+constexpr bool param_perfect(int i) {
+    return i >= NUM_PARAMS ? true : (param_unique(i, i + 1) && param_perfect(i + 1));
+}
+#define PARAM_IN_BOUNDS(name, type, def, min, max) ((double)(def) >= (min) && (double)(def) <= (max)) &&
+static_assert(PARAM_LIST(PARAM_IN_BOUNDS) true, "a parameter defaults to a value outside its bounds");
+#undef PARAM_IN_BOUNDS
+static_assert(NUM_PARAMS <= (1 << PARAM_HASH_BITS), "too many parameters for PARAM_HASH_BITS");
+static_assert(param_perfect(0), "parameter keys collide, change PARAM_HASH_SEED");
+
+class ParamStore {
+private:
+    int8_t slotToId[1 << PARAM_HASH_BITS];
+public:
+    ParamStore();
+    void reset();
+    int load(const char* filename);
+    bool save(const char* filename, const int* ids, int n);
+    int find(uint32_t key);
+    int32_t get(int id);
+    void set(int id, int32_t raw);
+    bool check(int id, int32_t raw); // whether the value is within the bounds of the parameter
+    int8_t getType(int id);
+    const char* getName(int id);
+    ~ParamStore();
+};
+
+extern ParamStore*  paramStore;
+
+#endif /* ParamStore_hpp */
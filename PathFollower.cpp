@@ -0,0 +1,59 @@
+//
+//  PathFollower.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "app.h"
+#include "PathFollower.hpp"
+#include "Observer.hpp"
+#include "StateMachine.hpp"
+#include "StaticArena.hpp"
+
+PathFollower::PathFollower(Motor* lm, Motor* rm) {
+    _debug(syslog(LOG_NOTICE, "%08u, PathFollower constructor", clock->now()));
+    leftMotor  = lm;
+    rightMotor = rm;
+    pursuit = new (arena("PathFollower")) PurePursuit();
+    route = NULL;
+    routeSize = 0;
+    routeName = "";
+    notified = true;
+}
+
+void PathFollower::setRoute(const char* name, const struct waypoint* p, int n) {
+    routeName = name;
+    route = p;
+    routeSize = n;
+}
+
+// the route starts from the pose at this moment
+void PathFollower::haveControl() {
+    pursuit->start(route, routeSize, observer->getLocX(), observer->getLocY(), M_PI * observer->getAzimuth() / 180.0);
+    startTime = clock->now();
+    notified = false;
+    resetVelocity();
+    activeNavigator = this;
+    syslog(LOG_NOTICE, "%08u, PathFollower has control of route %s", clock->now(), routeName);
+}
+
+void PathFollower::operate() {
+    int16_t f, t;
+    if (!pursuit->step(observer->getLocX(), observer->getLocY(), M_PI * observer->getAzimuth() / 180.0, f, t)) {
+        driveLR(0, 0);
+        if (!notified) {
+            notified = true;
+            syslog(LOG_NOTICE, "%08u, PathFollower finished route %s in %u ms", clock->now(), routeName, clock->now() - startTime);
+            stateMachine->sendTrigger(EVT_path_done);
+        }
+    } else {
+        forward = f;
+        turn = t;
+        driveLR((forward + turn) * MMPS_PER_PWM, (forward - turn) * MMPS_PER_PWM);
+    }
+}
+
+PathFollower::~PathFollower() {
+    _debug(syslog(LOG_NOTICE, "%08u, PathFollower destructor", clock->now()));
+}
@@ -0,0 +1,36 @@
+//
+//  PathFollower.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef PathFollower_hpp
+#define PathFollower_hpp
+
+#include "aflac_common.hpp"
+#include "Navigator.hpp"
+#include "PurePursuit.hpp"
+
+/*
+ * Drives a waypoint route by PurePursuit on the pose from Observer and
+ * sends EVT_path_done once at the end of it.
+ */
+class PathFollower : public Navigator {
+private:
+    PurePursuit* pursuit;
+    const struct waypoint* route;
+    int         routeSize;
+    const char* routeName;
+    uint32_t    startTime;
+    bool        notified;
+protected:
+public:
+    PathFollower(Motor* lm, Motor* rm);
+    void setRoute(const char* name, const struct waypoint* p, int n);
+    void haveControl();
+    void operate(); // method to invoke from the cyclic handler
+    ~PathFollower();
+};
+
+#endif /* PathFollower_hpp */
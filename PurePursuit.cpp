@@ -0,0 +1,116 @@
+//
+//  PurePursuit.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "PurePursuit.hpp"
+
+PurePursuit::PurePursuit() {
+    path = NULL;
+    numPoints = seg = 0;
+    mirror = _EDGE;
+    x0 = y0 = az0 = 0.0;
+    crossTrack = remaining = 0.0;
+    done = true;
+}
+
+void PurePursuit::start(const struct waypoint* p, int n, double x, double y, double azimuth, int8_t m) {
+    path = p;
+    numPoints = (n > PP_MAX_POINTS) ? PP_MAX_POINTS : n;
+    seg = 0;
+    mirror = m;
+    x0 = x;
+    y0 = y;
+    az0 = azimuth;
+    crossTrack = 0.0;
+    remaining = 0.0;
+    done = (numPoints < 2);
+}
+
+bool PurePursuit::step(double x, double y, double azimuth, int16_t& forward, int16_t& turn) {
+    forward = turn = 0;
+    if (done) return false;
+
+    // pose in the frame of the route
+    double c = cos(az0), s = sin(az0);
+    double rx = (x - x0) * c - (y - y0) * s;
+    double ry = (x - x0) * s + (y - y0) * c;
+    double raz = azimuth - az0;
+
+    // project onto the current segment, moving on while past its end
+    double ax = 0.0, ay = 0.0, dx = 0.0, dy = 0.0, len = 0.0, t = 0.0;
+    for (;;) {
+        ax = mirror * path[seg].x;
+        ay = path[seg].y;
+        dx = mirror * path[seg + 1].x - ax;
+        dy = path[seg + 1].y - ay;
+        len = sqrt(dx * dx + dy * dy);
+        t = (len > 0.0) ? ((rx - ax) * dx + (ry - ay) * dy) / len : len;
+        if (t < len || seg == numPoints - 2) break;
+        seg++;
+    }
+    if (t < 0.0) t = 0.0;
+    if (len > 0.0) crossTrack = ((rx - ax) * dy - (ry - ay) * dx) / len;
+
+    // walk PP_LOOKAHEAD along the path for the goal point, and the rest of it for the distance to go
+    double gx = mirror * path[numPoints - 1].x, gy = path[numPoints - 1].y;
+    double ahead = PP_LOOKAHEAD, along = (len > t) ? len - t : 0.0;
+    bool found = false;
+    if (along >= ahead && len > 0.0) {
+        gx = ax + dx * (t + ahead) / len;
+        gy = ay + dy * (t + ahead) / len;
+        found = true;
+    }
+    for (int i = seg + 1; i < numPoints - 1; i++) {
+        double ex = mirror * (path[i + 1].x - path[i].x), ey = path[i + 1].y - path[i].y;
+        double el = sqrt(ex * ex + ey * ey);
+        if (!found && along + el >= ahead && el > 0.0) {
+            gx = mirror * path[i].x + ex * (ahead - along) / el;
+            gy = path[i].y + ey * (ahead - along) / el;
+            found = true;
+        }
+        along += el;
+    }
+    remaining = along;
+    if (remaining < PP_GOAL_TOL) {
+        done = true;
+        return false;
+    }
+
+    // bearing of the goal point off the heading, clockwise
+    double bx = gx - rx, by = gy - ry;
+    double ld = sqrt(bx * bx + by * by);
+    double alpha = atan2(bx, by) - raz;
+    while (alpha > M_PI) alpha -= M_2PI;
+    while (alpha < -M_PI) alpha += M_2PI;
+    if (fabs(alpha) > PP_PIVOT_DEG * M_PI / 180.0) {
+        turn = (alpha > 0.0) ? PP_PIVOT_PWM : -PP_PIVOT_PWM;
+        return true;
+    }
+    double curvature = (ld > 0.0) ? 2.0 * sin(alpha) / ld : 0.0;
+
+    double v = PP_SPEED * MMPS_PER_PWM;
+    if (fabs(curvature) > 0.0 && sqrt(PP_LAT_ACC / fabs(curvature)) < v) v = sqrt(PP_LAT_ACC / fabs(curvature));
+    if (sqrt(2.0 * PP_DEC * remaining) < v) v = sqrt(2.0 * PP_DEC * remaining);
+    forward = (int16_t)(v / MMPS_PER_PWM + 0.5);
+    if (forward < PP_MIN_SPEED) forward = PP_MIN_SPEED;
+    turn = (int16_t)lround(forward * curvature * WHEEL_TREAD / 2.0);
+    return true;
+}
+
+bool PurePursuit::isDone() {
+    return done;
+}
+
+double PurePursuit::getCrossTrack() {
+    return crossTrack;
+}
+
+double PurePursuit::getRemaining() {
+    return remaining;
+}
+
+PurePursuit::~PurePursuit() {
+}
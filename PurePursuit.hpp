@@ -0,0 +1,79 @@
+//
+//  PurePursuit.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef PurePursuit_hpp
+#define PurePursuit_hpp
+
+// Note: this header is shared with the host tools and must not depend on ev3api
+#include "aflac_common.hpp"
+
+// point of a route in milimeter, x to the right and y ahead of the pose where the route starts.
+// routes are for the left course and mirrored on the right one
+struct waypoint {
+    int16_t x, y;
+};
+
+// routes from the thresholds of the scripted steps, timed against them by replay path on a kinematic
+// model; the waypoints are still to be checked on the simulator.
+// slalom: from on top of the board, weaving between the obstacles to its far edge
+const struct waypoint slalomRoute[] = {
+    {   0,    0}, {   0,   60}, {-130,  200}, {-130,  520}, {  60,  700},
+    {  60,  820}, { -90, 1000}, { -90, 1100}, {  60, 1250}, {  60, 1400}
+}; // Note: size of this array is given by sizeof(slalomRoute)/sizeof(*slalomRoute)
+
+// garage: from where the frame of the block area is crossed, by the block spot to the mouth of
+// the garage, one route for each colour the frame can be crossed on. Up to the block spot they
+// follow the steps of that colour, from there on they go as the former single route did:
+// 300 mm to the right, then 850 mm down to the mouth.
+// black: 105 degree to the right onto the frame, 350 mm along it to the yellow circle, then
+// ahead again for 300 mm
+const struct waypoint garageRouteBlack[] = {
+    {   0,    0}, {   0,   30}, { 350,   30}, { 350,  300}, { 650,  300},
+    { 650, -150}, { 650, -550}
+}; // Note: size of this array is given by sizeof(garageRouteBlack)/sizeof(*garageRouteBlack)
+
+// red: the 93 degree pivot on the inner wheel, then straight on for 350 mm
+const struct waypoint garageRouteRed[] = {
+    {   0,    0}, {  40,   65}, {  80,   75}, { 430,   60}, { 730,   60},
+    { 730, -390}, { 730, -790}
+}; // Note: size of this array is given by sizeof(garageRouteRed)/sizeof(*garageRouteRed)
+
+// yellow: the curve of PWM 30 and 25 for 800 ms, then straight on past the yellow circle
+const struct waypoint garageRouteYellow[] = {
+    {   0,    0}, {  45,  195}, {  80,  365}, { 380,  365}, { 380,  -85},
+    { 380, -485}
+}; // Note: size of this array is given by sizeof(garageRouteYellow)/sizeof(*garageRouteYellow)
+#define GARAGE_TAIL_LEN    1150 // milimeter of each garage route past the block spot
+
+/*
+ * Pure pursuit of a waypoint polyline in the frame of Observer (locX, locY and the azimuth
+ * clockwise from the y axis). The goal point is PP_LOOKAHEAD along the path ahead of where the
+ * robot projects onto it, and the arc through it gives the curvature. The speed is limited by
+ * PP_LAT_ACC on that arc and by PP_DEC to stop at the last point; beyond PP_PIVOT_DEG off the
+ * goal the robot pivots on the spot. Each step only looks at the segments from the current one on.
+ */
+class PurePursuit {
+private:
+    const struct waypoint* path;
+    int     numPoints, seg;
+    int8_t  mirror;
+    double  x0, y0, az0;    // pose where the route starts
+    double  crossTrack, remaining;
+    bool    done;
+protected:
+public:
+    PurePursuit();
+    void start(const struct waypoint* p, int n, double x, double y, double azimuth, int8_t m = _EDGE);
+    // PWM to drive forward and to add to the left wheel and take from the right one, false once arrived
+    bool step(double x, double y, double azimuth, int16_t& forward, int16_t& turn);
+    bool isDone();
+    double getCrossTrack();     // milimeter off the current segment, positive to its right
+    double getRemaining();      // milimeter along the path to its end
+    ~PurePursuit();
+};
+
+#endif /* PurePursuit_hpp */
@@ -0,0 +1,85 @@
+//
+//  SensorScheduler.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "SensorScheduler.hpp"
+#include <string.h>
+
+SensorScheduler::SensorScheduler() {
+    numTasks = 0;
+    tick = 0;
+    started = false;
+    tickCost = 0;
+    memset(hist, 0, sizeof(hist));
+    ticks = maxCost = 0;
+    sumCost = 0;
+}
+
+int8_t SensorScheduler::add(uint8_t divisor, uint8_t phase) {
+    if (numTasks >= SCH_MAX_TASKS) return -1;
+    struct schTask& t = tasks[numTasks];
+    t.divisor = (divisor == 0) ? 1 : divisor;
+    t.phase = phase % t.divisor;
+    t.lastTick = 0;
+    t.runs = t.costUs = 0;
+    return numTasks++;
+}
+
+void SensorScheduler::startTick() {
+    if (started) {
+        int bin = tickCost / SCH_COST_BIN;
+        hist[(bin < SCH_COST_BINS) ? bin : SCH_COST_BINS - 1]++;
+        ticks++;
+        sumCost += tickCost;
+        if (tickCost > maxCost) maxCost = tickCost;
+        tick++;
+    }
+    started = true;
+    tickCost = 0;
+}
+
+bool SensorScheduler::isDue(int8_t id) {
+    return (tick % tasks[id].divisor) == tasks[id].phase;
+}
+
+void SensorScheduler::done(int8_t id, uint32_t costUs) {
+    struct schTask& t = tasks[id];
+    t.lastTick = tick;
+    t.runs++;
+    t.costUs += costUs;
+    tickCost += costUs;
+}
+
+uint32_t SensorScheduler::getAge(int8_t id) {
+    return (tasks[id].runs == 0) ? SCH_NEVER : tick - tasks[id].lastTick;
+}
+
+const struct schTask& SensorScheduler::getTask(int8_t id) {
+    return tasks[id];
+}
+
+int8_t SensorScheduler::getNumTasks() {
+    return numTasks;
+}
+
+uint32_t SensorScheduler::getHistogram(int bin) {
+    return hist[bin];
+}
+
+uint32_t SensorScheduler::getTicks() {
+    return ticks;
+}
+
+uint32_t SensorScheduler::getMaxCost() {
+    return maxCost;
+}
+
+uint32_t SensorScheduler::getMeanCost() {
+    return (ticks == 0) ? 0 : (uint32_t)(sumCost / ticks);
+}
+
+SensorScheduler::~SensorScheduler() {
+}
@@ -0,0 +1,59 @@
+//
+//  SensorScheduler.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef SensorScheduler_hpp
+#define SensorScheduler_hpp
+
+// Note: this header is shared with the host tools and must not depend on ev3api
+#include "aflac_common.hpp"
+
+#define SCH_MAX_TASKS   8
+#define SCH_COST_BINS   8   // of SCH_COST_BIN microseconds each, the last one takes everything beyond
+#define SCH_NEVER       UINT32_MAX // age of a value never acquired
+
+struct schTask {
+    uint8_t  divisor, phase;
+    uint32_t lastTick;      // of the latest acquisition
+    uint32_t runs;
+    uint32_t costUs;        // taken by all of them
+};
+
+/*
+ * Multi-rate polling within the observer cycle. Each acquisition runs every divisor-th tick at
+ * its phase within them, so that the slow ones can be spread over different ticks instead of
+ * piling up on the same one; the caller asks isDue(), reads and keeps the value, and hands the
+ * time the read took to done(). The age of the value is counted in ticks from then on.
+ * The time of all the acquisitions of a tick goes into a histogram when the next one starts.
+ */
+class SensorScheduler {
+private:
+    struct schTask tasks[SCH_MAX_TASKS];
+    int8_t   numTasks;
+    uint32_t tick;
+    bool     started;
+    uint32_t tickCost;      // microseconds taken by the acquisitions of this tick so far
+    uint32_t hist[SCH_COST_BINS];
+    uint32_t ticks, maxCost;
+    uint64_t sumCost;
+protected:
+public:
+    SensorScheduler();
+    int8_t add(uint8_t divisor, uint8_t phase); // returns the id, in the order of adding, or -1
+    void startTick();       // at the top of every cycle
+    bool isDue(int8_t id);
+    void done(int8_t id, uint32_t costUs);
+    uint32_t getAge(int8_t id); // ticks since the acquisition, SCH_NEVER before the first one
+    const struct schTask& getTask(int8_t id);
+    int8_t getNumTasks();
+    uint32_t getHistogram(int bin); // ticks whose cost fell into the bin
+    uint32_t getTicks();
+    uint32_t getMaxCost();
+    uint32_t getMeanCost();
+    ~SensorScheduler();
+};
+
+#endif /* SensorScheduler_hpp */
@@ -0,0 +1,72 @@
+//
+//  StackMonitor.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "StackMonitor.hpp"
+#include "aflac_common.hpp"
+
+struct stackInfo {
+    const char* name;
+    STK_T*      base;   // the lowest address, stacks grow downwards
+    uint32_t    size;
+};
+
+static const struct stackInfo stacks[] = {
+    { "MAIN_TASK", main_stack, sizeof(main_stack) },
+    { "OBS_TSK",   obs_stack,  sizeof(obs_stack) },
+    { "NAV_TSK",   nav_stack,  sizeof(nav_stack) },
+    { "CMD_TSK",   cmd_stack,  sizeof(cmd_stack) },
+    { "TLM_TSK",   tlm_stack,  sizeof(tlm_stack) },
+};
+#define NUM_STACKS (int)(sizeof(stacks) / sizeof(stacks[0]))
+
+// each entry is written by the task of the stack alone
+static bool     painted[NUM_STACKS];
+static uint32_t entries[NUM_STACKS];
+static volatile uint32_t used[NUM_STACKS];
+
+// paint the caller's own stack below its frame, the part above it is in use
+static void paint(int index) {
+    uint8_t*  sp  = (uint8_t*)__builtin_frame_address(0);
+    uint32_t* p   = (uint32_t*)stacks[index].base;
+    uint32_t* end = (uint32_t*)((uintptr_t)(sp - STACK_PAINT_MARGIN) & ~(uintptr_t)3);
+    while (p < end) *p++ = STACK_PAINT;
+    painted[index] = true;
+}
+
+void stack_enter(int index) {
+    if (!painted[index]) {
+        paint(index);
+    } else if (++entries[index] % STACK_CHECK_DIV == 0) {
+        stack_check(index);
+    }
+}
+
+// bytes ever used, or the whole size if the paint at the bottom was overwritten
+void stack_check(int index) {
+    const uint32_t* p   = (const uint32_t*)stacks[index].base;
+    const uint32_t* end = (const uint32_t*)((const uint8_t*)stacks[index].base + stacks[index].size);
+    while (p < end && *p == STACK_PAINT) p++;
+    used[index] = (const uint8_t*)end - (const uint8_t*)p;
+}
+
+uint32_t stack_used(int index) {
+    return used[index];
+}
+
+// the stack of the caller is measured now, the others as their tasks last did
+void stack_report() {
+    uint8_t* sp = (uint8_t*)__builtin_frame_address(0);
+    for (int i = 0; i < NUM_STACKS; i++) {
+        if (sp >= (uint8_t*)stacks[i].base && sp < (uint8_t*)stacks[i].base + stacks[i].size) stack_check(i);
+    }
+    for (int i = 0; i < NUM_STACKS; i++) {
+        if (!painted[i]) continue; // the task never ran
+        uint32_t u = used[i];
+        syslog((u * 100 >= stacks[i].size * STACK_WARN_PERCENT) ? LOG_WARNING : LOG_NOTICE,
+               "%08u, stack: %-9s %5u of %5u bytes used", clock->now(), stacks[i].name, u, stacks[i].size);
+    }
+}
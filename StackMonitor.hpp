@@ -0,0 +1,36 @@
+//
+//  StackMonitor.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef StackMonitor_hpp
+#define StackMonitor_hpp
+
+#include "app.h"
+
+/**
+ * High-water marks of the task stacks defined in app.cpp.
+ * Under memory protection a task stack is accessible to its own task only, so every task
+ * paints its stack with STACK_PAINT on its first entry and measures it itself afterwards:
+ * the words still holding the paint from the bottom up are the ones never touched.
+ */
+#define STACK_PAINT         0xDEADBEEFU
+#define STACK_PAINT_MARGIN  64  // bytes left unpainted below the frame of the caller of stack_enter()
+#define STACK_WARN_PERCENT  75  // usage to report as a warning
+#define STACK_CHECK_DIV     25  // entries of a task between two measurements of its stack
+
+// index of each stack, in the order of the table in StackMonitor.cpp
+#define STK_MAIN    0
+#define STK_OBS     1
+#define STK_NAV     2
+#define STK_CMD     3
+#define STK_TLM     4
+
+void stack_enter(int index); // call at the top of every task function, with its own stack
+void stack_check(int index); // measure now, with its own stack as well
+uint32_t stack_used(int index); // as last measured by the task
+void stack_report(); // print usage of every stack to syslog, at exit and on CMD_REPORT
+
+#endif /* StackMonitor_hpp */
@@ -9,6 +9,11 @@
 #include "StateMachine.hpp"
 #include "Observer.hpp"
 #include "LineTracer.hpp"
+#include "ParamStore.hpp"
+#include "TelemetryStreamer.hpp"
+#include "StaticArena.hpp"
+#include "AllocTracker.hpp"
+#include "Actuator.hpp"
 
 
 StateMachine::StateMachine() {
@@ -16,34 +21,73 @@ StateMachine::StateMachine() {
 }
 
 void StateMachine::initialize() {
+    /* パラメーターを既定値で初期化し、コースファイルの値で上書きする */
+    alloc_watch_state(&state);
+    paramStore = new (arena("ParamStore")) ParamStore();
+    int n = paramStore->load(COURSE_FILE);
+    syslog(LOG_NOTICE, "%08u, %d parameters loaded from %s", clock->now(), n, COURSE_FILE);
+    // gains obtained by the auto-tune override the others
+    double p = paramFloat(PRM_P_CONST), i = paramFloat(PRM_I_CONST), d = paramFloat(PRM_D_CONST);
+    if (PIDcalculator::load(PID_PROP_FILE, p, i, d)) {
+        paramFloat(PRM_P_CONST) = p;
+        paramFloat(PRM_I_CONST) = i;
+        paramFloat(PRM_D_CONST) = d;
+    }
+
     /* 各オブジェクトを生成・初期化する */
-    touchSensor = new TouchSensor(PORT_1);
-    sonarSensor = new SonarSensor(PORT_2);
-    colorSensor = new ColorSensor(PORT_3);
-    gyroSensor  = new GyroSensor(PORT_4);
-    leftMotor   = new Motor(PORT_C);
-    rightMotor  = new Motor(PORT_B);
-    tailMotor   = new Motor(PORT_D);
-    armMotor   = new Motor(PORT_A);
-    steering    = new Steering(*leftMotor, *rightMotor);
+    touchSensor = new (arena("devices")) TouchSensor(PORT_1);
+    sonarSensor = new (arena("devices")) SonarSensor(PORT_2);
+    colorSensor = new (arena("devices")) ColorSensor(PORT_3);
+    gyroSensor  = new (arena("devices")) GyroSensor(PORT_4);
+    leftMotor   = new (arena("devices")) Motor(PORT_C);
+    rightMotor  = new (arena("devices")) Motor(PORT_B);
+    tailMotor   = new (arena("devices")) Motor(PORT_D);
+    armMotor   = new (arena("devices")) Motor(PORT_A);
+    actuator    = new (arena("devices")) Actuator(leftMotor, rightMotor, tailMotor, armMotor);
     
     /* LCD画面表示 */
     ev3_lcd_fill_rect(0, 0, EV3_LCD_WIDTH, EV3_LCD_HEIGHT, EV3_LCD_WHITE);
     ev3_lcd_draw_string("EV3way-ET aflac2020", 0, CALIB_FONT_HEIGHT*1);
     
-    observer = new Observer(leftMotor, rightMotor, armMotor, tailMotor, touchSensor, sonarSensor, gyroSensor, colorSensor);    observer->freeze(); // Do NOT attempt to collect sensor data until unfreeze() is invoked
+    telemetry = new (arena("TelemetryStreamer")) TelemetryStreamer();
+    telemetry->activate();
+    observer = new (arena("Observer")) Observer(leftMotor, rightMotor, armMotor, tailMotor, touchSensor, sonarSensor, gyroSensor, colorSensor);    observer->freeze(); // Do NOT attempt to collect sensor data until unfreeze() is invoked
     observer->activate();
-    blindRunner = new BlindRunner(leftMotor, rightMotor, tailMotor);
-    lineTracer = new LineTracer(leftMotor, rightMotor, tailMotor);
+    blindRunner = new (arena("BlindRunner")) BlindRunner(leftMotor, rightMotor, tailMotor);
+    lineTracer = new (arena("LineTracer")) LineTracer(leftMotor, rightMotor, tailMotor);
     lineTracer->activate();
-    challengeRunner = new ChallengeRunner(leftMotor, rightMotor, tailMotor,armMotor);
+    challengeRunner = new (arena("ChallengeRunner")) ChallengeRunner(leftMotor, rightMotor, tailMotor,armMotor);
     challengeRunner->activate();
+    pathFollower = new (arena("PathFollower")) PathFollower(leftMotor, rightMotor);
+    courseLearner = new (arena("CourseLearner")) CourseLearner();
+    calibrator = new (arena("Calibrator")) Calibrator(leftMotor, rightMotor);
+    if (paramInt(PRM_CAL_ENABLE)) calibrate();
     
+    arena_report();
     ev3_led_set_color(LED_ORANGE); /* 初期化完了通知 */
 
     state = ST_start;
 }
 
+// sweep over the line at the start position and adopt the thresholds it measured
+void StateMachine::calibrate() {
+    ev3_lcd_draw_string("calibrating...", 0, CALIB_FONT_HEIGHT*2);
+    //clock->sleep() seems to be still taking milisec parm
+    clock->sleep(PERIOD_OBS_TSK*FIR_ORDER/1000); // wait until FIR array is filled
+    uint32_t start = clock->now();
+    calibrator->haveControl();
+    // Calibrator gives up by itself at CAL_TIMEOUT, the margin is for the cyclic handler not running
+    while (!calibrator->isDone() && clock->now() - start < CAL_TIMEOUT + 100) {
+        clock->sleep(PERIOD_NAV_TSK/1000);
+    }
+    activeNavigator = NULL;
+    actuator->stop();
+    if (calibrator->publish()) {
+        observer->rebuildClassifier();
+    }
+    syslog(LOG_NOTICE, "%08u, calibration finished in %u ms", clock->now(), clock->now() - start);
+}
+
 void StateMachine::sendTrigger(uint8_t event) {
     syslog(LOG_NOTICE, "%08u, StateMachine::sendTrigger(): event %s received by state %s", clock->now(), eventName[event], stateName[state]);
     switch (state) {
@@ -52,12 +96,16 @@ void StateMachine::sendTrigger(uint8_t event) {
                 case EVT_cmdStart_R:
                 case EVT_cmdStart_L:
                 case EVT_touch_On:
+#if defined(MAKE_AUTOTUNE) || defined(MAKE_SYSID)
+                    state = ST_tuning;
+#else
                     state = ST_tracing;
+#endif
                     syslog(LOG_NOTICE, "%08u, Departing...", clock->now());
                     
                     /* 走行モーターエンコーダーリセット */
-                    leftMotor->reset();
-                    rightMotor->reset();
+                    actuator->reset(ACT_LEFT);
+                    actuator->reset(ACT_RIGHT);
                     
                     observer->reset();
                     
@@ -67,13 +115,24 @@ void StateMachine::sendTrigger(uint8_t event) {
                     
                     observer->freeze();
                     lineTracer->freeze();
+#if defined(MAKE_AUTOTUNE)
+                    lineTracer->startAutoTune();
+#elif defined(MAKE_SYSID)
+                    lineTracer->startSysId();
+#endif
                     lineTracer->haveControl();
                     //clock->sleep() seems to be still taking milisec parm
                     clock->sleep(PERIOD_NAV_TSK*FIR_ORDER/1000); // wait until FIR array is filled
                     lineTracer->unfreeze();
                     observer->unfreeze();
                     syslog(LOG_NOTICE, "%08u, Departed", clock->now());
+                    arena_lock(); // everything for the run must be in place by now
+#if defined(MAKE_LEARN)
+                    observer->startLearning(courseLearner);
+                    observer->notifyOfDistance(LEARN_LAP_LEN); // trace the whole lap to learn the course map
+#elif !defined(MAKE_AUTOTUNE) && !defined(MAKE_SYSID)
                     observer->notifyOfDistance(600); // switch to ST_Blind after 600
+#endif
                     break;
                 default:
                     break;
@@ -86,8 +145,14 @@ void StateMachine::sendTrigger(uint8_t event) {
                     wakeupMain();
                     break;
                 case EVT_dist_reached:
+#if defined(MAKE_LEARN)
+                    observer->stopLearning();
+                    state = ST_end;
+                    wakeupMain();
+#else
                     state = ST_blind;
                     blindRunner->haveControl();
+#endif
                     break;
                 case EVT_bl2bk:
                 case EVT_bk2bl:
@@ -131,6 +196,18 @@ void StateMachine::sendTrigger(uint8_t event) {
                     break;
             }
             break;
+        case ST_tuning:
+            switch (event) {
+                case EVT_backButton_On:
+                case EVT_autotune_done:
+                case EVT_sysid_done:
+                    state = ST_end;
+                    wakeupMain();
+                    break;
+                default:
+                    break;
+            }
+            break;
         case ST_slalom:
             switch (event) {
                 case EVT_slalom_reached:
@@ -139,6 +216,16 @@ void StateMachine::sendTrigger(uint8_t event) {
                 case EVT_slalom_challenge:
                     challengeRunner->runChallenge();
                     break;
+                case EVT_path_start:
+                    pathFollower->setRoute("slalom", slalomRoute, sizeof(slalomRoute) / sizeof(*slalomRoute));
+                    pathFollower->haveControl();
+                    break;
+                case EVT_path_done:
+                    // drive straight off the board as the scripted steps do
+                    g_challenge_stepNo = 141;
+                    challengeRunner->haveControl();
+                    challengeRunner->runChallenge();
+                    break;
                 default:
                     break;
             }
@@ -162,6 +249,24 @@ void StateMachine::sendTrigger(uint8_t event) {
                     challengeRunner->haveControl();
                     challengeRunner->runChallenge();
                     break;
+                case EVT_path_start:
+                    // by the colour the frame of the block area was crossed on
+                    if (observer->getRoute() == 2) {
+                        pathFollower->setRoute("garage red", garageRouteRed, sizeof(garageRouteRed) / sizeof(*garageRouteRed));
+                    } else if (observer->getRoute() == 3) {
+                        pathFollower->setRoute("garage yellow", garageRouteYellow, sizeof(garageRouteYellow) / sizeof(*garageRouteYellow));
+                    } else {
+                        pathFollower->setRoute("garage black", garageRouteBlack, sizeof(garageRouteBlack) / sizeof(*garageRouteBlack));
+                    }
+                    pathFollower->haveControl();
+                    break;
+                case EVT_path_done:
+                    // creep into the garage until the sonar finds its back as the scripted steps do
+                    g_challenge_stepNo = 286;
+                    challengeRunner->haveControl();
+                    challengeRunner->runChallenge();
+                    g_challenge_stepNo = 290;
+                    break;
                 default:
                     break;
             }
@@ -181,15 +286,39 @@ void StateMachine::exit() {
     if (activeNavigator != NULL) {
         activeNavigator->deactivate();
     }
-    leftMotor->reset();
-    rightMotor->reset();
+    actuator->reset(ACT_LEFT);
+    actuator->reset(ACT_RIGHT);
+    arena_unlock();
+    arena_report();
+    alloc_report();
+    actuator->report();
+
+    // save the auto-tune result here rather than in the cyclic handler
+    if (lineTracer->saveGains(PID_PROP_FILE)) {
+        syslog(LOG_NOTICE, "%08u, PID gains saved to %s", clock->now(), PID_PROP_FILE);
+    }
+    if (lineTracer->saveModel(COURSE_FILE)) {
+        syslog(LOG_NOTICE, "%08u, motor models saved to %s", clock->now(), COURSE_FILE);
+    }
+    // a partial lap is not saved as finish() is only called at LEARN_LAP_LEN
+    if (courseLearner->save(COURSE_FILE)) {
+        syslog(LOG_NOTICE, "%08u, course map saved to %s", clock->now(), COURSE_FILE);
+    }
     
     delete lineTracer;
     delete blindRunner;
     delete challengeRunner;
+    delete pathFollower;
+    delete courseLearner;
+    delete calibrator;
     observer->deactivate();
     delete observer;
+    telemetry->deactivate();
+    delete telemetry;
+    telemetry = NULL;
     
+    delete actuator;
+    actuator = NULL;
     delete tailMotor;
     delete armMotor;
     delete rightMotor;
@@ -198,6 +327,7 @@ void StateMachine::exit() {
     delete colorSensor;
     delete sonarSensor;
     delete touchSensor;
+    delete paramStore;
 }
 
 StateMachine::~StateMachine() {
@@ -11,6 +11,9 @@
 #include "aflac_common.hpp"
 #include "BlindRunner.hpp"
 #include "ChallengeRunner.hpp"
+#include "CourseLearner.hpp"
+#include "Calibrator.hpp"
+#include "PathFollower.hpp"
 
 /* LCDフォントサイズ */
 #define CALIB_FONT (EV3_FONT_SMALL)
@@ -27,10 +30,14 @@ private:
     Motor*          rightMotor;
     Motor*          tailMotor;
     Motor*          armMotor;
-    Steering*       steering;
     LineTracer*     lineTracer;
     BlindRunner*    blindRunner;
     ChallengeRunner*    challengeRunner;
+    CourseLearner*  courseLearner;
+    Calibrator*     calibrator;
+    PathFollower*   pathFollower;
+
+    void calibrate();
 protected:
 public:
     StateMachine();
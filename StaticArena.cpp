@@ -0,0 +1,59 @@
+//
+//  StaticArena.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "app.h"
+#include "StaticArena.hpp"
+#include "AllocTracker.hpp"
+#include "aflac_common.hpp"
+
+// all of the following are zero-initialized, hence usable before any constructor runs
+static union {
+    uint64_t align;
+    uint8_t  bytes[ARENA_SIZE];
+} pool;
+static size_t   poolUsed;
+static uint32_t staticBytes[ALLOC_MAX_MODULES];
+
+void* operator new(size_t size, const struct arenaTag& tag) {
+    if (poolUsed == 0) alloc_register_pool(pool.bytes, ARENA_SIZE);
+    alloc_set_module(tag.module);
+    size_t top = (poolUsed + 7) & ~(size_t)7;
+    if (top + size > ARENA_SIZE) {
+        syslog(LOG_WARNING, "%08u, arena exhausted by %s, %u bytes go to heap, raise ARENA_SIZE", (clock != NULL) ? clock->now() : 0, tag.module, size);
+        return operator new(size);
+    }
+    poolUsed = top + size;
+    staticBytes[alloc_module_index(tag.module)] += size;
+    return pool.bytes + top;
+}
+
+void operator delete(void* p, const struct arenaTag& tag) {
+    operator delete(p);
+}
+
+void arena_lock() {
+    alloc_lock();
+}
+
+void arena_unlock() {
+    alloc_unlock();
+    if (alloc_violations() > 0) {
+        syslog(LOG_NOTICE, "%08u, %u heap allocations where none was allowed", clock->now(), alloc_violations());
+    }
+}
+
+void arena_report() {
+    uint32_t heapLive = 0;
+    for (int i = 0; i < ALLOC_MAX_MODULES; i++) {
+        if (i > 0 && alloc_module_name(i) == NULL) break;
+        const struct allocStats& s = alloc_module_stats(i);
+        heapLive += s.live;
+        if (staticBytes[i] == 0 && s.live == 0) continue;
+        syslog(LOG_NOTICE, "%08u, memory: %-18s static %6u, heap %6u", clock->now(), alloc_module_name(i), staticBytes[i], s.live);
+    }
+    syslog(LOG_NOTICE, "%08u, memory: arena %u of %u bytes, heap %u bytes live", clock->now(), poolUsed, ARENA_SIZE, heapLive);
+}
@@ -0,0 +1,41 @@
+//
+//  StaticArena.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef StaticArena_hpp
+#define StaticArena_hpp
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Long-lived objects are placed in a pool reserved at link time instead of the heap
+ *   observer = new (arena("Observer")) Observer(...);
+ * The pool is never freed, delete only runs the destructor. Heap allocations are accounted
+ * by AllocTracker to the module last given to arena(), so those made inside a constructor
+ * are charged to the object being constructed.
+ * After arena_lock() any heap allocation by new is logged and asserted.
+ */
+#define ARENA_SIZE      (64 * 1024) // bytes, arena_report() tells how much is actually used
+#define ARENA_MAX_TAGS  16
+
+struct arenaTag {
+    const char* module;
+};
+
+inline struct arenaTag arena(const char* module) {
+    struct arenaTag t = { module };
+    return t;
+}
+
+void* operator new(size_t size, const struct arenaTag& tag);
+void operator delete(void* p, const struct arenaTag& tag);
+
+void arena_lock();   // the run has started, no more heap allocation is allowed
+void arena_unlock();
+void arena_report(); // print static and heap bytes by module to syslog
+
+#endif /* StaticArena_hpp */
@@ -0,0 +1,109 @@
+//
+//  TelemetryStreamer.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "TelemetryStreamer.hpp"
+#include <string.h>
+#if !defined(MAKE_HOST)
+#include "app.h"
+#include "ParamStore.hpp"
+
+static const int32_t& tlmDecim = paramInt(PRM_TLM_DECIM);
+#endif
+
+// build a frame of count records into buf, returns its length
+int tlm_encode(uint8_t seq, uint8_t dropped, const struct tlmRecord* rec, int count, uint8_t* buf) {
+    struct tlmHeader h = { TLM_SYNC, seq, (uint8_t)count, dropped };
+    int len = sizeof(h) + count * sizeof(struct tlmRecord);
+    memcpy(buf, &h, sizeof(h));
+    memcpy(buf + sizeof(h), rec, count * sizeof(struct tlmRecord));
+    uint32_t crc = cf_crc32(buf, len);
+    memcpy(buf + len, &crc, sizeof(crc));
+    return len + sizeof(crc);
+}
+
+// check the frame at the top of buf, returns its length or -1 if broken, 0 if more bytes are needed
+int tlm_verify(const uint8_t* buf, int len) {
+    if (len < (int)sizeof(struct tlmHeader)) return 0;
+    const struct tlmHeader* h = (const struct tlmHeader*)buf;
+    if (h->sync != TLM_SYNC || h->count > TLM_MAX_RECORDS) return -1;
+    int body = sizeof(struct tlmHeader) + h->count * sizeof(struct tlmRecord);
+    if (len < body + (int)sizeof(uint32_t)) return 0;
+    uint32_t crc;
+    memcpy(&crc, buf + body, sizeof(crc));
+    return (crc == cf_crc32(buf, body)) ? body + sizeof(crc) : -1;
+}
+
+#if !defined(MAKE_HOST)
+TelemetryStreamer::TelemetryStreamer() {
+    _debug(syslog(LOG_NOTICE, "%08u, TelemetryStreamer constructor", clock->now()));
+    head = tail = 0;
+    tick = dropped = sent = 0;
+    seq = droppedInFrame = 0;
+    bt = ev3_serial_open_file(EV3_SERIAL_BT);
+}
+
+void TelemetryStreamer::activate() {
+    // register cyclic handler to EV3RT
+    sta_cyc(CYC_TLM_TSK);
+    _debug(syslog(LOG_NOTICE, "%08u, TelemetryStreamer handler set", clock->now()));
+}
+
+// decimation by TLM_DECIM observer cycles, 0 disables streaming
+bool TelemetryStreamer::isDue() {
+    if (tlmDecim <= 0) return false;
+    if (++tick < (uint32_t)tlmDecim) return false;
+    tick = 0;
+    return true;
+}
+
+void TelemetryStreamer::enqueue(const struct tlmRecord& r) {
+    uint16_t next = (head + 1) & (TLM_RING_SIZE - 1);
+    if (next == tail) { // full, TLM_TSK is starved or the link is slow
+        dropped++;
+        if (droppedInFrame < UINT8_MAX) droppedInFrame++;
+        return;
+    }
+    ring[head] = r;
+    head = next; // publish the record only after it is complete
+}
+
+void TelemetryStreamer::send(int count) {
+    struct tlmRecord rec[TLM_MAX_RECORDS];
+    for (int i = 0; i < count; i++) {
+        rec[i] = ring[tail];
+        tail = (tail + 1) & (TLM_RING_SIZE - 1);
+    }
+    if (!ev3_bluetooth_is_connected()) return;
+    int len = tlm_encode(seq++, droppedInFrame, rec, count, buf);
+    droppedInFrame = 0;
+    // the serial port is shared with the acks from CMD_TSK
+    wai_sem(BT_SEM);
+    fwrite(buf, 1, len, bt);
+    fflush(bt);
+    sig_sem(BT_SEM);
+    sent++;
+}
+
+// drain the ring in frames as full as TLM_MTU allows, a partial frame goes only when it gets stale
+void TelemetryStreamer::operate() {
+    int avail;
+    while ((avail = (head - tail) & (TLM_RING_SIZE - 1)) >= (int)TLM_MAX_RECORDS) {
+        send(TLM_MAX_RECORDS);
+    }
+    if (avail > 0 && clock->now() - ring[tail].time >= TLM_MAX_LATENCY) send(avail);
+}
+
+void TelemetryStreamer::deactivate() {
+    // deregister cyclic handler from EV3RT
+    stp_cyc(CYC_TLM_TSK);
+    _debug(syslog(LOG_NOTICE, "%08u, TelemetryStreamer handler unset, %u frames sent, %u records dropped", clock->now(), sent, dropped));
+}
+
+TelemetryStreamer::~TelemetryStreamer() {
+    _debug(syslog(LOG_NOTICE, "%08u, TelemetryStreamer destructor", clock->now()));
+}
+#endif
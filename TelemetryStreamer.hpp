@@ -0,0 +1,79 @@
+//
+//  TelemetryStreamer.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef TelemetryStreamer_hpp
+#define TelemetryStreamer_hpp
+
+// Note: the frame format below is shared with the host tools and must not depend on ev3api
+#include "aflac_common.hpp"
+#include "CourseFile.hpp"
+
+/**
+ * Binary telemetry over the Bluetooth serial port
+ *   tlmHeader tlmRecord[count] crc(4)
+ * crc is CRC-32 of the header and the records as in the course file, all little endian.
+ * The sync byte differs from CMD_SYNC so that a receiver can tell them apart from acks.
+ */
+#define TLM_SYNC        0x5A
+#define TLM_MTU         512  // bytes per write to the serial port
+#define TLM_RING_SIZE   128  // records buffered between the observer and TLM_TSK, power of two
+#define TLM_MAX_LATENCY 500  // send a partial frame when the oldest record is older than this in miliseconds
+
+struct tlmHeader {
+    uint8_t  sync;
+    uint8_t  seq;
+    uint8_t  count;     // number of records
+    uint8_t  dropped;   // records lost since the previous frame, saturated
+};
+
+struct tlmRecord {
+    uint32_t time;      // clock->now() in miliseconds
+    int32_t  distance;  // in milimeter
+    int32_t  locX;
+    int32_t  locY;
+    int16_t  azimuth;   // in degree
+    int16_t  grayScale;
+    int16_t  turn;      // output of the PID calculator
+    int16_t  stepNo;    // g_challenge_stepNo
+    int8_t   pwmL;
+    int8_t   pwmR;
+    uint8_t  state;
+    uint8_t  color;     // g_color
+    uint8_t  r, g, b;   // FIR-filtered raw RGB clamped to 255
+    uint8_t  reserved;
+};
+
+#define TLM_MAX_RECORDS ((TLM_MTU - sizeof(struct tlmHeader) - sizeof(uint32_t)) / sizeof(struct tlmRecord))
+
+int tlm_encode(uint8_t seq, uint8_t dropped, const struct tlmRecord* rec, int count, uint8_t* buf);
+int tlm_verify(const uint8_t* buf, int len);
+
+#if !defined(MAKE_HOST)
+class TelemetryStreamer {
+private:
+    struct tlmRecord ring[TLM_RING_SIZE];
+    volatile uint16_t head, tail; // head is written only by the observer, tail only by TLM_TSK
+    uint32_t tick, dropped, sent;
+    uint8_t  seq, droppedInFrame;
+    uint8_t  buf[TLM_MTU];
+    FILE*    bt;
+    void send(int count);
+protected:
+public:
+    TelemetryStreamer();
+    void activate();
+    bool isDue();
+    void enqueue(const struct tlmRecord& r); // called from the observer, never blocks
+    void operate(); // method to invoke from the cyclic handler
+    void deactivate();
+    ~TelemetryStreamer();
+};
+
+extern TelemetryStreamer* telemetry;
+#endif
+
+#endif /* TelemetryStreamer_hpp */
@@ -0,0 +1,83 @@
+//
+//  VelocityController.cpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "VelocityController.hpp"
+
+VelocityController::VelocityController(int16_t periodMs) {
+    dtMs = periodMs;
+    target = 0;
+    accel = 0;
+    struct motorModel m = { MOT_GAIN, MOT_TAU, MOT_DEAD };
+    setModel(m, MOT_VBAT);
+    reset(0);
+}
+
+void VelocityController::reset(int32_t count) {
+    for (int i = 0; i < VEL_WINDOW; i++) counts[i] = count;
+    head = 0;
+    filled = 1;
+    speed = 0;
+    integral = 0;
+}
+
+void VelocityController::setModel(const struct motorModel& m, int32_t batteryMv) {
+    gain = (m.gain > 0.0F) ? (int32_t)(m.gain * 256) : MMPS_PER_PWM * 256;
+    lead = m.tau; // not the dead time, see the header
+    dead = m.dead;
+    modelMv = batteryMv;
+}
+
+void VelocityController::setTarget(int16_t mmps, int32_t acc) {
+    target = mmps;
+    accel = acc;
+}
+
+int16_t VelocityController::feedForward(int32_t batteryMv) {
+    if (target == 0) return 0;
+    if (batteryMv < VEL_VBAT_MIN) batteryMv = VEL_VBAT_MIN;
+    int32_t ahead = target + accel * lead / 1000;
+    int32_t ff = (int64_t)256 * 256 * ahead * modelMv / ((int64_t)gain * batteryMv);
+    ff += (target > 0) ? dead * 256 : -dead * 256;
+    if (ff > 100 * 256) ff = 100 * 256;
+    if (ff < -100 * 256) ff = -100 * 256;
+    return ff;
+}
+
+int16_t VelocityController::update(int32_t count, int32_t batteryMv) {
+    // the oldest count in the window is where head is about to write
+    int8_t oldest = (filled < VEL_WINDOW) ? 0 : head;
+    int32_t span = (filled < VEL_WINDOW) ? filled : VEL_WINDOW;
+    speed = (int64_t)(count - counts[oldest]) * MM_PER_CNT_X1000 / (span * dtMs);
+    counts[head] = count;
+    head = (head + 1 >= VEL_WINDOW) ? 0 : head + 1;
+    if (filled < VEL_WINDOW) filled++;
+
+    int32_t ff = feedForward(batteryMv);
+    int32_t err = target - speed;
+    int32_t out = ff + VEL_KP * err + integral / 1000;
+    // integrate only while that does not push the output further into saturation
+    bool high = out >= 100 * 256, low = out <= -100 * 256;
+    if ((err > 0 && !high) || (err < 0 && !low)) {
+        integral += VEL_KI * err * dtMs;
+        if (integral > VEL_I_MAX * 256 * 1000) integral = VEL_I_MAX * 256 * 1000;
+        if (integral < -VEL_I_MAX * 256 * 1000) integral = -VEL_I_MAX * 256 * 1000;
+    }
+    if (out > 100 * 256) out = 100 * 256;
+    if (out < -100 * 256) out = -100 * 256;
+    return (out >= 0) ? (out + 128) / 256 : -((-out + 128) / 256);
+}
+
+int16_t VelocityController::getTarget() {
+    return target;
+}
+
+int16_t VelocityController::getSpeed() {
+    return speed;
+}
+
+VelocityController::~VelocityController() {
+}
@@ -0,0 +1,51 @@
+//
+//  VelocityController.hpp
+//  aflac2020
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#ifndef VelocityController_hpp
+#define VelocityController_hpp
+
+// Note: this header is shared with the host tools and must not depend on ev3api
+#include "aflac_common.hpp"
+#include "MotorIdentifier.hpp"
+
+#define MM_PER_CNT_X1000    ((int32_t)(M_PI * TIRE_DIAMETER * 1000 / 360)) // wheel travel per encoder degree in micrometer
+
+/*
+ * Speed loop of a wheel in mm/s, run every navigator cycle off the encoder count.
+ * The speed is the count difference over the last VEL_WINDOW cycles, as one degree in a
+ * single cycle is already some 200 mm/s. The PWM is the feed-forward of the motor model,
+ * scaled by the battery voltage it was identified at over the present one, plus a PI correction
+ * whose integral stops while the output saturates. The feed-forward leads the target by the
+ * time constant of the model along the acceleration given with it; not by a dead time, which
+ * MotorIdentifier cannot resolve at a sample of SYSID_DECIM cycles, see replay sysid.
+ * Gains are in 1/256 PWM per mm/s, and per mm/s and second.
+ */
+class VelocityController {
+private:
+    int32_t counts[VEL_WINDOW]; // circular history of the encoder count
+    int8_t  head, filled;
+    int16_t dtMs;
+    int16_t target, speed;      // mm/s
+    int32_t accel;              // mm/s^2 of the target
+    int32_t gain;               // 1/256 mm/s per PWM
+    int16_t lead, dead;         // ms, PWM
+    int32_t modelMv;
+    int32_t integral;           // 1/256 PWM times miliseconds
+protected:
+public:
+    VelocityController(int16_t periodMs);
+    void reset(int32_t count);
+    void setModel(const struct motorModel& m, int32_t batteryMv);
+    void setTarget(int16_t mmps, int32_t acc = 0);
+    int16_t feedForward(int32_t batteryMv); // 1/256 PWM the model gives for the target
+    int16_t update(int32_t count, int32_t batteryMv); // PWM to apply
+    int16_t getTarget();
+    int16_t getSpeed();         // measured mm/s
+    ~VelocityController();
+};
+
+#endif /* VelocityController_hpp */
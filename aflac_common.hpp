@@ -30,23 +30,39 @@
 
 //#include <cinttypes>
 #include <cmath>
+#if defined(MAKE_HOST)
+// host tools share the modules free of ev3api, which only need the following from it
+#include <stdint.h>
+#include <cassert>
+typedef struct {
+    uint16_t r, g, b;
+} rgb_raw_t;
+#else
 #include "TouchSensor.h"
 #include "SonarSensor.h"
 #include "ColorSensor.h"
 #include "GyroSensor.h"
 #include "Motor.h"
-#include "Steering.h"
 #include "Clock.h"
 using namespace ev3api;
+#endif
 
 /* 下記のマクロは個体/環境に合わせて変更する必要があります */
 #define GYRO_OFFSET           0  /* ジャイロセンサオフセット値(角速度0[deg/sec]時) */
 #define LIGHT_WHITE          60  /* 白色の光センサ値 */
 #define LIGHT_BLACK           3  /* 黒色の光センサ値 */
+// raw RGB of the same spots, for the brightness model of ColorModeManager until Calibrator measures them
+#define RGB_WHITE           CLR_RGB(155, 165, 150)
+#define RGB_BLACK           CLR_RGB(  8,  10,   8)
 #define GS_LOST              90  // threshold to determine "line lost"
+#define GS_MAX             1023  // gray scale of a full 10-bit raw RGB reading
 #define FINAL_APPROACH_LEN  100  // final approch length in milimater
 #define ANG_V_TILT           50  // threshold to determine "tilt"
 #define SONAR_ALERT_DISTANCE 10  /* 超音波センサによる障害物検知距離[cm] */
+#define SONAR_PERIOD         40  // update period of the ultrasonic sensor in miliseconds
+#define SONAR_MEDIAN          5  // number of readings the median is taken from
+#define SONAR_NO_ECHO       255  // reading when no echo returns
+#define SONAR_DROPOUT_HOLD    3  // successive no-echo readings held over before believed
 #define TAIL_ANGLE_STAND_UP  85  /* 完全停止時の角度[度] */
 #define TAIL_ANGLE_DRIVE      3  /* バランス走行時の角度[度] */
 #define P_GAIN             2.5F  /* 完全停止用モータ制御比例係数 */
@@ -76,9 +92,124 @@ using namespace ev3api;
 #define TURN_MIN            -16  // minimum value PID calculator returns
 #define TURN_MAX             16  // maximum value PID calculator returns
 
+// colour class centroids in FIR-filtered raw RGB for ColorClassifier, typical readings on the course mat
+// each inside the region the threshold tests of the challenge steps used to select;
+// Calibrator replaces black, gray and white by the mat at startup
+#define CLR_RGB(r, g, b)    ((r) | (g) << 8 | (b) << 16)
+#define CLR_BLACK           CLR_RGB( 20,  25,  20)
+#define CLR_GRAY            CLR_RGB( 45,  50,  40)
+#define CLR_WHITE           CLR_RGB(150, 160, 150)
+#define CLR_BLUE            CLR_RGB( 20,  45,  90)
+#define CLR_RED             CLR_RGB(100,  25,  20)
+#define CLR_YELLOW          CLR_RGB(110, 100,  30)
+#define CLR_GREEN           CLR_RGB( 10,  70,  40)
+#define CLR_REJECT            0  // squared distance beyond which a colour is unknown, 0 for no limit
+
+// velocity profile planner for BlindRunner
+#define MMPS_PER_PWM          9  // wheel speed in mm/s given by one PWM unit
+#define PLAN_SEG_LEN         10  // length of a speed table segment in milimeter
+#define PLAN_ACC_MAX        600  // acceleration limit in mm/s^2
+#define PLAN_DEC_MAX        900  // deceleration limit in mm/s^2
+#define PLAN_LAT_ACC_MAX   1000  // lateral acceleration limit in mm/s^2
+
 
 //#define GS_TARGET            45 //sano_t
 
+// relay feedback auto-tuner, enabled by building with MAKE_AUTOTUNE
+#define AT_SPEED             30  // forward speed during the relay experiment
+#define AT_RELAY_AMP         10  // relay output given to turn
+#define AT_HYSTERESIS         3  // relay hysteresis in gray scale
+#define AT_CYCLES             6  // number of oscillation periods to average
+#define AT_TIMEOUT         5000  // period to give up the experiment in miliseconds
+#define AT_RULE      AT_RULE_ZN  // AT_RULE_ZN or AT_RULE_TL
+// teach-and-repeat, enabled by building with MAKE_LEARN
+#define LEARN_LAP_LEN     11600  // length of the traced lap to learn the course map from in milimeter
+// closed-loop motion primitives of ChallengeRunner
+#define MP_MIN_PWM            6  // PWM the primitives slow down to near the target
+#define MP_DECEL_DIST        80  // distance in milimeter before the target to start slowing down
+#define MP_DECEL_DEG         30  // angle in degree before the target to start slowing down
+#define MP_TURN_TOL           2  // degree off the target heading taken as reached
+#define MP_HOLD_GAIN          1  // turn PWM per degree off the heading while driving straight
+// pure pursuit of the slalom and garage routes, in place of the scripted steps when built with MAKE_PATH
+#define PP_LOOKAHEAD        120  // distance in milimeter along the path to the goal point
+#define PP_SPEED             30  // top forward PWM
+#define PP_MIN_SPEED          8  // forward PWM not slowed down below but to pivot
+#define PP_LAT_ACC          500  // lateral acceleration limit in mm/s^2
+#define PP_DEC              600  // deceleration limit toward the last point in mm/s^2
+#define PP_PIVOT_DEG         60  // bearing of the goal point in degree beyond which to pivot on the spot
+#define PP_PIVOT_PWM         12  // PWM to pivot
+#define PP_GOAL_TOL          15  // path left in milimeter taken as arrived
+#define PP_MAX_POINTS        32  // waypoints taken from a route at most
+// acceleration and jerk limited ramps of the PWM by the navigators
+#define PRF_ACC             200  // PWM per second
+#define PRF_JERK           2000  // PWM per second squared, 0 for trapezoidal ramps
+// speed loops of the wheels, through which the navigators but ChallengeRunner drive
+#define VEL_CONTROL           1  // 0 to give the wheels the feed-forward PWM of the motor model only
+#define VEL_WINDOW           10  // cycles the wheel speed is measured over
+#define VEL_VBAT_MIN       5000  // battery voltage in mV below which the reading is not believed
+#define VEL_KP               32  // 1/256 PWM per mm/s off the target
+#define VEL_KI              256  // 1/256 PWM per mm/s off the target and second
+#define VEL_I_MAX            30  // PWM the integral is limited to
+// identification of the wheel motors, run instead of the course when built with MAKE_SYSID
+#define SYSID_TIME        10000  // miliseconds to drive the wheels with the PRBS, tracing the line
+#define SYSID_DECIM          10  // navigator cycles per sample of the speed
+#define SYSID_PWM            40  // PWM around which the PRBS swings
+#define SYSID_AMP            25  // PWM the PRBS swings by
+#define SYSID_HOLD            3  // samples each bit of the PRBS is held for
+#define SYSID_MAX_DELAY       3  // longest dead time tried in samples
+#define SYSID_FRAC            8  // fraction bits of the regressor sums
+#define SYSID_FORGET         10  // forgetting factor of 1 - 2^-SYSID_FORGET a sample
+// wheel motor model the speed loops feed forward, defaulting to MMPS_PER_PWM without lag
+#define MOT_GAIN   MMPS_PER_PWM  // mm/s per PWM
+#define MOT_TAU               0  // time constant in ms
+#define MOT_DEAD              0  // PWM before the wheel starts to turn
+#define MOT_VBAT           7800  // battery voltage in mV the model was identified at, or MMPS_PER_PWM holds
+// heading estimator in Observer
+#define HDG_GYRO_FUSION       0  // 1 once the gyro measures yaw, it is mounted for the pitch on the slalom now
+#define HDG_GYRO_WEIGHT     224  // share of the gyro in a heading increment out of 256
+#define HDG_SLIP            500  // gap in millidegree per cycle between the gyro and the encoders taken as slip
+#define HDG_STILL_CYCLES     50  // cycles the wheels must stand still before learning the gyro bias
+// course map localisation by colour landmarks in Observer
+#define LOC_BIN              20  // length of a histogram bin in milimeter
+#define LOC_MAX_BINS        640  // bins to cover the course with
+#define LOC_DIFFUSE_BINS      5  // bins travelled between two diffusions of the belief
+#define LOC_TOL              60  // distance in milimeter from a landmark edge still weighted up
+#define LOC_W_MISS           32  // weight out of 256 of the bins off every landmark edge
+#define LOC_CONFIRM           3  // samples a colour must hold for to count as an edge
+#define LOC_MIN_FEATURE      40  // shortest colour run in milimeter learned as a landmark
+// black/blue line transition by two-sided CUSUM of the gray scale off its moving average in Observer
+#define BL_CUSUM_DRIFT        3  // deviation per observer cycle taken as noise
+#define BL_CUSUM_THRESHOLD    5  // accumulated deviation in gray scale to report a change, see replay cusum
+// startup calibration of the line thresholds
+#define CAL_ENABLE            1  // sweep over the line at startup, 0 to keep the parameters as loaded
+#define CAL_PWM              10  // PWM to pivot on the spot
+#define CAL_SWEEP_DEG        60  // wheel rotation in degree to pivot each way
+#define CAL_TIMEOUT        3000  // period to give up the sweep in miliseconds
+#define CAL_MIN_SHARE        10  // minimum share in percent of the samples on either side of the edge
+#define CAL_MIN_CONTRAST     20  // minimum difference in gray scale between the line and the background
+#define CAL_TARGET_RATIO     45  // GS_TARGET in percent from the black to the white level
+#define CAL_LOST_RATIO       85  // GS_LOST in percent from the black to the white level
+// colour sensor mode manager in Observer, the reflected light is derived from raw RGB to stay in one mode
+#define BRT_W_R             200  // weights of the raw channels in the model of the reflected light,
+#define BRT_W_G              10  // red as the LED of the reflect mode, as the gray scale in the garage
+#define BRT_W_B              29
+// multi-rate polling of the sensors by Observer, divisors and phases in cycles of PERIOD_OBS_TSK
+#define SCH_MULTIRATE         1  // 0 to poll the touch sensor and the back button every cycle as before
+#define SCH_SONAR_DIV        10  // SONAR_PERIOD over PERIOD_OBS_TSK
+#define SCH_SONAR_PHASE       0
+#define SCH_TOUCH_DIV        20
+#define SCH_TOUCH_PHASE       5
+#define SCH_BUTTON_DIV       20
+#define SCH_BUTTON_PHASE     15
+#define SCH_COST_BIN         25  // width of a bin of the per-cycle acquisition time in microseconds
+// binary telemetry over Bluetooth
+#define TLM_DECIM             5  // stream every n-th observer cycle, 0 to disable
+#if defined(MAKE_SIM)
+#define PID_PROP_FILE   "PID_prop.txt"
+#else
+#define PID_PROP_FILE   "/ev3rt/res/PID_prop.txt"
+#endif
+
 #define M_2PI    (2.0 * M_PI)
 
 //#define DEVICE_NAME     "ET0"  /* Bluetooth名 hrp2/target/ev3.h BLUETOOTH_LOCAL_NAMEで設定 */
@@ -98,6 +229,7 @@ using namespace ev3api;
 #define ST_end          4
 #define ST_slalom 5
 #define ST_block  6
+#define ST_tuning       7
 
 #define ST_NAME_LEN     20  // maximum number of characters for a machine state name
 const char stateName[][ST_NAME_LEN] = {
@@ -107,7 +239,8 @@ const char stateName[][ST_NAME_LEN] = {
     "ST_stopping",
     "ST_end",
     "ST_slalom",
-    "ST_block"
+    "ST_block",
+    "ST_tuning"
 };
 
 // event
@@ -133,6 +266,10 @@ const char stateName[][ST_NAME_LEN] = {
 #define EVT_block_area_in   18
 #define EVT_line_on_pid_cntl    19
 #define EVT_line_on_p_cntl  20
+#define EVT_autotune_done   21
+#define EVT_path_start      22
+#define EVT_path_done       23
+#define EVT_sysid_done      24
 #define EVT_NAME_LEN        21  // maximum number of characters for an event name
 const char eventName[][EVT_NAME_LEN] = {
     "EVT_cmdStart_L",
@@ -155,7 +292,11 @@ const char eventName[][EVT_NAME_LEN] = {
     "EVT_block_challenge",
     "EVT_block_area_in",
     "EVT_line_on_pid_cntl",
-    "EVT_line_on_p_cntl"
+    "EVT_line_on_p_cntl",
+    "EVT_autotune_done",
+    "EVT_path_start",
+    "EVT_path_done",
+    "EVT_sysid_done"
 };
 
 typedef struct {
@@ -175,14 +316,26 @@ typedef struct {
 #define Mode_speed_incrsLdcrsR  8
 #define Mode_speed_incrsRdcrsL  9
 
+// motion primitives of ChallengeRunner and how they ended
+#define MP_NONE         0
+#define MP_DRIVE        1
+#define MP_TURN         2
+#define MP_ARC          3
+#define MP_DONE         0  // reached the target
+#define MP_COLOR        1  // stopped on the colour given by stopOnColor()
+
 // global variables
 extern rgb_raw_t g_rgb;
 extern hsv_raw_t g_hsv;
+extern uint8_t g_color;
 extern int16_t g_grayScale, g_grayScaleBlueless;
 extern int16_t g_angle, g_anglerVelocity;
 extern int16_t g_challenge_stepNo,g_color_brightness; //sano
+extern int16_t g_turn;
 
+#if !defined(MAKE_HOST)
 extern Clock*       clock;
+#endif
 extern uint8_t      state;
 
 #endif /* aflac_common_hpp */
\ No newline at end of file
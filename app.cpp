@@ -11,13 +11,32 @@
 #include "Observer.hpp"
 #include "Navigator.hpp"
 #include "StateMachine.hpp"
+#include "ParamStore.hpp"
+#include "CommandParser.hpp"
+#include "TelemetryStreamer.hpp"
+#include "StaticArena.hpp"
+#include "AllocTracker.hpp"
+#include "StackMonitor.hpp"
+#include "Actuator.hpp"
 
 Clock*          clock;
 StateMachine*   stateMachine;
 Observer*       observer;
+ParamStore*     paramStore;
+TelemetryStreamer* telemetry = NULL;
 Navigator*      activeNavigator = NULL;
+Actuator*       actuator = NULL;
 uint8_t         state = ST_start;
 
+STK_T main_stack[COUNT_STK_T(STACK_SIZE_MAIN)];
+STK_T obs_stack[COUNT_STK_T(STACK_SIZE_OBS)];
+STK_T nav_stack[COUNT_STK_T(STACK_SIZE_NAV)];
+STK_T cmd_stack[COUNT_STK_T(STACK_SIZE_CMD)];
+STK_T tlm_stack[COUNT_STK_T(STACK_SIZE_TLM)];
+
+static volatile bool cmdStop = false;    // asks command_task to return
+static volatile bool cmdRunning = false; // until it has returned
+
 // a cyclic handler to activate a task
 void task_activator(intptr_t tskid) {
     ER ercd = act_tsk(tskid);
@@ -31,25 +50,87 @@ void task_activator(intptr_t tskid) {
 
 // Observer's periodic task
 void observer_task(intptr_t unused) {
+    stack_enter(STK_OBS);
+    NoAllocGuard guard("observer_task");
     if (observer != NULL) observer->operate();
 }
 
 // Navigator's periodic task
 void navigator_task(intptr_t unused) {
+    stack_enter(STK_NAV);
+    NoAllocGuard guard("navigator_task");
     if (activeNavigator != NULL) activeNavigator->operate();
 }
 
+// Command task, blocks on Bluetooth at the lowest priority and acknowledges every frame.
+// it is never terminated from outside, as it may hold BT_SEM or the lock of the stream then;
+// main_task sets cmdStop and releases its wait instead, and the task returns on its own
+void command_task(intptr_t unused) {
+    stack_enter(STK_CMD);
+    FILE* bt = ev3_serial_open_file(EV3_SERIAL_BT);
+    CommandParser parser;
+    struct cmdFrame ack;
+    uint8_t buf[CMD_MAX_FRAME];
+
+    while (!cmdStop) {
+        int c = fgetc(bt);
+        if (c == EOF) {
+            clearerr(bt);
+            if (!cmdStop) dly_tsk(10 * 1000);
+            continue;
+        }
+        if (!parser.push(c)) continue;
+        int event = cmd_execute(parser.getFrame(), ack);
+        if (event >= 0 && (observer == NULL || !observer->notifyOfCommand(event))) {
+            syslog(LOG_NOTICE, "%08u, command dropped as the queue is full", clock->now());
+            ack.payload[1] = CMD_STS_BUSY;
+        }
+        if (!parser.isLegacy() && wai_sem(BT_SEM) == E_OK) {
+            fwrite(buf, 1, CommandParser::encode(ack, buf), bt);
+            fflush(bt);
+            sig_sem(BT_SEM);
+        }
+        if (parser.getFrame().cmd == CMD_REPORT) {
+            stack_report();
+            if (actuator != NULL) actuator->report();
+        }
+    }
+    stack_check(STK_CMD);
+    cmdRunning = false;
+}
+
+// Telemetry's periodic task
+void telemetry_task(intptr_t unused) {
+    stack_enter(STK_TLM);
+    NoAllocGuard guard("telemetry_task");
+    if (telemetry != NULL) telemetry->operate();
+}
+
 void main_task(intptr_t unused) {
-    clock    = new Clock;
-    stateMachine  = new StateMachine;
+    stack_enter(STK_MAIN);
+    alloc_name_task(MAIN_TASK, "main");
+    alloc_name_task(OBS_TSK, "observer");
+    alloc_name_task(NAV_TSK, "navigator");
+    alloc_name_task(CMD_TSK, "command");
+    alloc_name_task(TLM_TSK, "telemetry");
+    clock    = new (arena("main")) Clock;
+    stateMachine  = new (arena("main")) StateMachine;
 
     stateMachine->initialize();
+    cmdRunning = true;
+    act_tsk(CMD_TSK);
     
     // sleep until being waken up
     ER ercd = slp_tsk();
     assert(ercd == E_OK);
 
+    cmdStop = true;
+    while (cmdRunning) {
+        rel_wai(CMD_TSK); // out of fgetc() or dly_tsk(), E_OBJ when it is not waiting
+        dly_tsk(10 * 1000);
+    }
     stateMachine->exit();
+    stack_report();
 
     delete stateMachine;
     delete clock;
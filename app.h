@@ -25,6 +25,8 @@ extern "C" {
 #define PRIORITY_OBS_TSK    TMIN_APP_TPRI
 #define PRIORITY_NAV_TSK    TMIN_APP_TPRI
 #define PRIORITY_MAIN_TASK  (TMIN_APP_TPRI + 1)
+#define PRIORITY_CMD_TSK    (TMIN_APP_TPRI + 2)
+#define PRIORITY_TLM_TSK    (TMIN_APP_TPRI + 3)
 
 /**
  * Task periods in micro seconds
@@ -32,6 +34,7 @@ extern "C" {
  */
 #define PERIOD_OBS_TSK  ( 4 * 1000)
 #define PERIOD_NAV_TSK  ( 4 * 1000)
+#define PERIOD_TLM_TSK  (100 * 1000)
 #define PERIOD_TRACE_MSG   1000 * 1000 // Trace message in every 1000 ms
 
 /**
@@ -40,6 +43,15 @@ extern "C" {
 #ifndef STACK_SIZE
 #define STACK_SIZE      4096
 #endif /* STACK_SIZE */
+
+/**
+ * Stack size of each task, to be sized from the high-water marks stack_report() prints
+ */
+#define STACK_SIZE_MAIN STACK_SIZE
+#define STACK_SIZE_OBS  STACK_SIZE
+#define STACK_SIZE_NAV  STACK_SIZE
+#define STACK_SIZE_CMD  STACK_SIZE
+#define STACK_SIZE_TLM  STACK_SIZE
     
 /**
  * Prototypes for configuration
@@ -49,9 +61,18 @@ extern "C" {
 extern void main_task(intptr_t unused);
 extern void observer_task(intptr_t unused);
 extern void navigator_task(intptr_t unused);
+extern void command_task(intptr_t unused);
+extern void telemetry_task(intptr_t unused);
 
 extern void task_activator(intptr_t tskid);
 
+// stacks given to the tasks in app.cfg rather than allocated by the kernel, so that they can be painted
+extern STK_T main_stack[COUNT_STK_T(STACK_SIZE_MAIN)];
+extern STK_T obs_stack[COUNT_STK_T(STACK_SIZE_OBS)];
+extern STK_T nav_stack[COUNT_STK_T(STACK_SIZE_NAV)];
+extern STK_T cmd_stack[COUNT_STK_T(STACK_SIZE_CMD)];
+extern STK_T tlm_stack[COUNT_STK_T(STACK_SIZE_TLM)];
+
 #endif /* TOPPERS_MACRO_ONLY */
 
 #ifdef __cplusplus
@@ -0,0 +1,208 @@
+//
+//  bt_standin.cpp
+//  aflac2020
+//
+//  Host stand-in for the Bluetooth command channel over a pseudo terminal.
+//  Without options it plays the robot: it opens a pty, prints its name and answers
+//  commands with the same parser and parameter store as command_task.
+//  With -t it also streams telemetry of a synthetic run for tlm_receiver.
+//  With -c it plays the PC: it sends one command to the given device and prints the ack.
+//
+//  build: g++ -std=gnu++11 -DMAKE_HOST -I.. -o bt_standin bt_standin.cpp
+//             ../CommandParser.cpp ../ParamStore.cpp ../CourseFile.cpp ../TelemetryStreamer.cpp
+//             ../AllocTracker.cpp ../ColorClassifier.cpp
+//  usage: bt_standin [-t] [course.bin]
+//         bt_standin -c /dev/pts/N start L|R | stop | report | get NAME | set NAME VALUE
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#define _XOPEN_SOURCE 600
+#include "CommandParser.hpp"
+#include "ParamStore.hpp"
+#include "TelemetryStreamer.hpp"
+#include "AllocTracker.hpp"
+#include "ColorClassifier.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/select.h>
+
+#define SIM_PERIOD (4 * 1000) // PERIOD_OBS_TSK in micro seconds
+
+ParamStore* paramStore;
+static ColorClassifier classifier;
+
+static void raw_mode(int fd) {
+    struct termios t;
+    if (tcgetattr(fd, &t) == 0) {
+        cfmakeraw(&t);
+        tcsetattr(fd, TCSANOW, &t);
+    }
+}
+
+// a lap of a circle with radius 500mm at 300mm/s, sampled at SIM_PERIOD as the observer does
+static void synthesize(uint32_t now, struct tlmRecord& r) {
+    double dist = 0.3 * now, theta = dist / 500.0;
+    r.time      = now;
+    r.distance  = (int32_t)dist;
+    r.locX      = (int32_t)(500.0 * sin(theta));
+    r.locY      = (int32_t)(500.0 * (1.0 - cos(theta)));
+    r.azimuth   = (int16_t)fmod(theta * 180.0 / M_PI, 360.0);
+    r.grayScale = GS_TARGET + (int16_t)(10.0 * sin(now / 200.0));
+    r.turn      = (int16_t)(-0.85 * (r.grayScale - GS_TARGET));
+    r.pwmL      = SPEED_NORM - r.turn;
+    r.pwmR      = SPEED_NORM + r.turn;
+    r.state     = ST_tracing;
+    r.stepNo    = 0;
+    r.r         = 20 + (r.grayScale - GS_TARGET + 10) * 4; // black to white across the edge
+    r.g         = r.r + 5;
+    r.b         = r.r;
+    r.color     = classifier.classify((rgb_raw_t){ r.r, r.g, r.b });
+    r.reserved  = 0;
+}
+
+static int robot(const char* course, bool tlm) {
+    if (course != NULL) printf("%d parameters loaded from %s\n", paramStore->load(course), course);
+    int fd = posix_openpt(O_RDWR | O_NOCTTY);
+    if (fd < 0 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+        perror("posix_openpt");
+        return 1;
+    }
+    classifier.build();
+    raw_mode(fd);
+    fcntl(fd, F_SETFL, O_NONBLOCK); // never block on a pty nobody has open
+    printf("listening on %s\n", ptsname(fd));
+    fflush(stdout);
+
+    CommandParser parser;
+    struct cmdFrame ack;
+    struct tlmRecord rec[TLM_MAX_RECORDS];
+    uint8_t  buf[TLM_MTU], c, tseq = 0;
+    uint32_t now = 0, tick = 0;
+    int      count = 0;
+    while (true) {
+        usleep(SIM_PERIOD);
+        now += SIM_PERIOD / 1000;
+        NoAllocGuard guard("bt_standin cycle", true); // as the periodic tasks on the brick
+        while (read(fd, &c, 1) == 1) {
+            if (!parser.push(c)) continue;
+            const struct cmdFrame& f = parser.getFrame();
+            int event = cmd_execute(f, ack);
+            printf("seq %3u cmd '%c' status %u value %d", f.seq, f.cmd, ack.payload[1],
+                   (int32_t)(ack.payload[2] | ack.payload[3] << 8 | ack.payload[4] << 16 | ack.payload[5] << 24));
+            if (event >= 0) printf(" -> %s", eventName[event]);
+            printf(", %u broken frames so far\n", parser.getErrors());
+            fflush(stdout);
+            if (!parser.isLegacy() && write(fd, buf, CommandParser::encode(ack, buf)) < 0) perror("write");
+        }
+        if (!tlm) continue;
+        // same decimation and batching as TelemetryStreamer, TLM_DECIM can be changed with set
+        if (paramInt(PRM_TLM_DECIM) > 0 && ++tick >= (uint32_t)paramInt(PRM_TLM_DECIM)) {
+            tick = 0;
+            synthesize(now, rec[count++]);
+        }
+        if (count == (int)TLM_MAX_RECORDS || (count > 0 && now - rec[0].time >= TLM_MAX_LATENCY)) {
+            if (write(fd, buf, tlm_encode(tseq++, 0, rec, count, buf)) < 0) tseq--; // nobody is reading
+            count = 0;
+        }
+    }
+    return 0;
+}
+
+static void put_u32(uint8_t* p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = v >> (8 * i);
+}
+
+static int client(const char* device, int argc, char* argv[]) {
+    struct cmdFrame req;
+    memset(&req, 0, sizeof(req));
+    req.seq = getpid() & 0xFF;
+    int id = -1;
+    if (argc >= 2 && strcmp(argv[0], "start") == 0) {
+        req.cmd = (argv[1][0] == 'R' || argv[1][0] == 'r') ? CMD_START_R : CMD_START_L;
+    } else if (argc >= 1 && strcmp(argv[0], "stop") == 0) {
+        req.cmd = CMD_STOP_S;
+    } else if (argc >= 1 && strcmp(argv[0], "report") == 0) {
+        req.cmd = CMD_REPORT;
+    } else if (argc >= 2 && (strcmp(argv[0], "get") == 0 || strcmp(argv[0], "set") == 0)) {
+        uint32_t key = cf_hash(argv[1]);
+        id = paramStore->find(key);
+        put_u32(req.payload, key);
+        req.len = 4;
+        req.cmd = CMD_GET_PARAM;
+        if (argv[0][0] == 's') {
+            if (argc < 3 || id < 0) {
+                fprintf(stderr, "set needs a known NAME and a VALUE\n");
+                return 2;
+            }
+            int32_t raw;
+            if (paramStore->getType(id) == PT_FLT) {
+                float f = (float)atof(argv[2]);
+                memcpy(&raw, &f, sizeof(raw));
+            } else {
+                raw = atoi(argv[2]);
+            }
+            put_u32(req.payload + 4, raw);
+            req.len = 8;
+            req.cmd = CMD_SET_PARAM;
+        }
+    } else {
+        fprintf(stderr, "unknown command\n");
+        return 2;
+    }
+
+    int fd = open(device, O_RDWR | O_NOCTTY);
+    if (fd < 0) {
+        perror(device);
+        return 1;
+    }
+    raw_mode(fd);
+    uint8_t buf[CMD_MAX_FRAME];
+    if (write(fd, buf, CommandParser::encode(req, buf)) < 0) perror("write");
+
+    CommandParser parser;
+    fd_set fds;
+    struct timeval tv = {1, 0};
+    uint8_t c;
+    while (true) {
+        FD_ZERO(&fds);
+        FD_SET(fd, &fds);
+        if (select(fd + 1, &fds, NULL, NULL, &tv) <= 0 || read(fd, &c, 1) <= 0) {
+            fprintf(stderr, "no ack\n");
+            close(fd);
+            return 1;
+        }
+        if (parser.push(c) && !parser.isLegacy() && parser.getFrame().seq == req.seq) break;
+    }
+    close(fd);
+    const struct cmdFrame& ack = parser.getFrame();
+    int32_t raw = ack.payload[2] | ack.payload[3] << 8 | ack.payload[4] << 16 | ack.payload[5] << 24;
+    printf("status %u", ack.payload[1]);
+    if (ack.payload[1] == CMD_STS_OK && id >= 0) {
+        printf(" %s = ", paramStore->getName(id));
+        if (paramStore->getType(id) == PT_FLT) {
+            float f;
+            memcpy(&f, &raw, sizeof(f));
+            printf("%g", f);
+        } else {
+            printf("%d", raw);
+        }
+    }
+    printf("\n");
+    return ack.payload[1] == CMD_STS_OK ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+    paramStore = new ParamStore();
+    if (argc >= 2 && strcmp(argv[1], "-t") == 0) return robot(argc >= 3 ? argv[2] : NULL, true);
+    if (argc < 2 || strcmp(argv[1], "-c") != 0) return robot(argc >= 2 ? argv[1] : NULL, false);
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s -c DEVICE COMMAND...\n", argv[0]);
+        return 2;
+    }
+    return client(argv[2], argc - 3, argv + 3);
+}
@@ -0,0 +1,219 @@
+//
+//  colorlut.cpp
+//  aflac2020
+//
+//  Builds the colour lookup table of ColorClassifier on the host, classifies recorded traces
+//  with it and draws it as an image.
+//  Traces are CSV with columns r, g, b and optionally label (a class name), as written by
+//  tlm_receiver. With -k the centroids are refitted to the traces, by the means of the labelled
+//  samples if there are any, otherwise by k-means seeded with the current centroids, and
+//  printed as lines of the parameter CSV for course_conv.
+//  The image is a PPM of CLR_LUT_SIZE slices along b, each with r across and g down,
+//  where the cells hit by the traces are outlined.
+//
+//  build: g++ -std=gnu++11 -DMAKE_HOST -I.. -o colorlut colorlut.cpp
+//             ../ColorClassifier.cpp ../ParamStore.cpp ../CourseFile.cpp
+//  usage: colorlut [-c course.bin] [-k] [-o lut.ppm] [trace.csv ...]
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "ColorClassifier.hpp"
+#include "ParamStore.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define KMEANS_ITERATIONS 20
+#define CELL_PX           4 // pixels per cell in the image
+#define SLICES_PER_ROW    8
+
+ParamStore* paramStore;
+
+struct sample {
+    int r, g, b;
+    int label; // class, or -1 if not labelled
+};
+
+static const uint8_t classRgb[NUM_CLASSES + 1][3] = {
+    {   0,   0,   0 }, // black
+    { 128, 128, 128 }, // gray
+    { 255, 255, 255 }, // white
+    {   0,   0, 255 }, // blue
+    { 255,   0,   0 }, // red
+    { 255, 255,   0 }, // yellow
+    {   0, 160,   0 }, // green
+    { 255,   0, 255 }, // unknown
+};
+
+static int class_of_name(const char* name) {
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        if (strcmp(name, className[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static bool read_trace(const char* filename, std::vector<struct sample>& samples) {
+    FILE* fp = fopen(filename, "r");
+    if (fp == NULL) return false;
+    char line[512];
+    int col[4] = { -1, -1, -1, -1 }; // r, g, b, label
+    if (fgets(line, sizeof(line), fp) != NULL) {
+        const char* names[4] = { "r", "g", "b", "label" };
+        int i = 0;
+        for (char* tok = strtok(line, ",\r\n"); tok != NULL; tok = strtok(NULL, ",\r\n"), i++) {
+            for (int k = 0; k < 4; k++) {
+                if (strcmp(tok, names[k]) == 0) col[k] = i;
+            }
+        }
+    }
+    if (col[0] < 0 || col[1] < 0 || col[2] < 0) {
+        fprintf(stderr, "%s: columns r, g and b are needed\n", filename);
+        fclose(fp);
+        return false;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        struct sample s = { -1, -1, -1, -1 };
+        int i = 0;
+        for (char* tok = strtok(line, ",\r\n"); tok != NULL; tok = strtok(NULL, ",\r\n"), i++) {
+            if (i == col[0]) s.r = atoi(tok);
+            if (i == col[1]) s.g = atoi(tok);
+            if (i == col[2]) s.b = atoi(tok);
+            if (i == col[3]) s.label = class_of_name(tok);
+        }
+        if (s.r >= 0 && s.g >= 0 && s.b >= 0) samples.push_back(s);
+    }
+    fclose(fp);
+    return true;
+}
+
+static int nearest(const struct sample& s, const uint32_t* centroids) {
+    int best = 0;
+    for (int i = 1; i < NUM_CLASSES; i++) {
+        if (clr_distance(s.r, s.g, s.b, centroids[i]) < clr_distance(s.r, s.g, s.b, centroids[best])) best = i;
+    }
+    return best;
+}
+
+// labelled samples give the means of their classes directly, otherwise Lloyd's iterations
+static void refit(const std::vector<struct sample>& samples, uint32_t* centroids) {
+    bool labelled = false;
+    for (size_t j = 0; j < samples.size(); j++) labelled = labelled || (samples[j].label >= 0);
+    for (int it = 0; it < (labelled ? 1 : KMEANS_ITERATIONS); it++) {
+        long sum[NUM_CLASSES][3] = {{0}};
+        long n[NUM_CLASSES] = {0};
+        for (size_t j = 0; j < samples.size(); j++) {
+            int c = labelled ? samples[j].label : nearest(samples[j], centroids);
+            if (c < 0) continue;
+            sum[c][0] += samples[j].r;
+            sum[c][1] += samples[j].g;
+            sum[c][2] += samples[j].b;
+            n[c]++;
+        }
+        for (int i = 0; i < NUM_CLASSES; i++) {
+            if (n[i] == 0) continue; // keep the centroid of a class absent from the traces
+            centroids[i] = CLR_RGB(sum[i][0] / n[i], sum[i][1] / n[i], sum[i][2] / n[i]);
+        }
+    }
+}
+
+static bool write_ppm(const char* filename, const ColorClassifier& lut, const std::vector<struct sample>& samples) {
+    const int slice = CLR_LUT_SIZE * CELL_PX + 1;
+    const int w = SLICES_PER_ROW * slice, h = (CLR_LUT_SIZE / SLICES_PER_ROW) * slice;
+    std::vector<uint8_t> img(w * h * 3, 64);
+    std::vector<bool> hit(CLR_LUT_SIZE * CLR_LUT_SIZE * CLR_LUT_SIZE, false);
+    for (size_t j = 0; j < samples.size(); j++) {
+        hit[(clr_quantize(samples[j].r) * CLR_LUT_SIZE + clr_quantize(samples[j].g)) * CLR_LUT_SIZE + clr_quantize(samples[j].b)] = true;
+    }
+    for (int qb = 0; qb < CLR_LUT_SIZE; qb++) {
+        int x0 = (qb % SLICES_PER_ROW) * slice, y0 = (qb / SLICES_PER_ROW) * slice;
+        for (int qr = 0; qr < CLR_LUT_SIZE; qr++) {
+            for (int qg = 0; qg < CLR_LUT_SIZE; qg++) {
+                uint8_t cls = lut.getCell(qr, qg, qb);
+                const uint8_t* rgb = classRgb[(cls < NUM_CLASSES) ? cls : NUM_CLASSES];
+                bool outline = hit[(qr * CLR_LUT_SIZE + qg) * CLR_LUT_SIZE + qb];
+                for (int py = 0; py < CELL_PX; py++) {
+                    for (int px = 0; px < CELL_PX; px++) {
+                        bool edge = outline && (px == 0 || py == 0 || px == CELL_PX - 1 || py == CELL_PX - 1);
+                        uint8_t* p = &img[((y0 + qg * CELL_PX + py) * w + x0 + qr * CELL_PX + px) * 3];
+                        for (int k = 0; k < 3; k++) p[k] = edge ? 255 - rgb[k] : rgb[k];
+                    }
+                }
+            }
+        }
+    }
+    FILE* fp = fopen(filename, "wb");
+    if (fp == NULL) return false;
+    fprintf(fp, "P6\n%d %d\n255\n", w, h);
+    fwrite(&img[0], 1, img.size(), fp);
+    fclose(fp);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    const char* course = NULL;
+    const char* image = NULL;
+    bool fit = false;
+    std::vector<struct sample> samples;
+
+    paramStore = new ParamStore();
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            course = argv[++i];
+        } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            image = argv[++i];
+        } else if (strcmp(argv[i], "-k") == 0) {
+            fit = true;
+        } else if (!read_trace(argv[i], samples)) {
+            fprintf(stderr, "cannot read %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (course != NULL && paramStore->load(course) < 0) {
+        fprintf(stderr, "cannot read %s\n", course);
+        return 1;
+    }
+
+    uint32_t centroids[NUM_CLASSES];
+    for (int i = 0; i < NUM_CLASSES; i++) centroids[i] = paramInt(PRM_CLR_BLACK + i);
+    if (fit && !samples.empty()) refit(samples, centroids);
+
+    static ColorClassifier lut; // too large for the stack
+    lut.build(centroids, paramInt(PRM_CLR_REJECT));
+
+    long cells[NUM_CLASSES + 1] = {0}, hits[NUM_CLASSES + 1] = {0}, wrong = 0, labelled = 0;
+    for (int qr = 0; qr < CLR_LUT_SIZE; qr++)
+        for (int qg = 0; qg < CLR_LUT_SIZE; qg++)
+            for (int qb = 0; qb < CLR_LUT_SIZE; qb++) {
+                uint8_t cls = lut.getCell(qr, qg, qb);
+                cells[(cls < NUM_CLASSES) ? cls : NUM_CLASSES]++;
+            }
+    for (size_t j = 0; j < samples.size(); j++) {
+        rgb_raw_t c = { (uint16_t)samples[j].r, (uint16_t)samples[j].g, (uint16_t)samples[j].b };
+        uint8_t cls = lut.classify(c);
+        hits[(cls < NUM_CLASSES) ? cls : NUM_CLASSES]++;
+        if (samples[j].label >= 0) {
+            labelled++;
+            if (cls != samples[j].label) wrong++;
+        }
+    }
+    printf("class    centroid         cells  samples\n");
+    for (int i = 0; i <= NUM_CLASSES; i++) {
+        if (i < NUM_CLASSES) {
+            printf("%-8s (%3u, %3u, %3u) %6ld %8ld\n", className[i], CLR_GET_R(centroids[i]), CLR_GET_G(centroids[i]), CLR_GET_B(centroids[i]), cells[i], hits[i]);
+        } else {
+            printf("%-8s                 %6ld %8ld\n", "unknown", cells[i], hits[i]);
+        }
+    }
+    if (labelled > 0) printf("%ld of %ld labelled samples misclassified\n", wrong, labelled);
+    if (fit) {
+        const char* names[NUM_CLASSES] = { "CLR_BLACK", "CLR_GRAY", "CLR_WHITE", "CLR_BLUE", "CLR_RED", "CLR_YELLOW", "CLR_GREEN" };
+        for (int i = 0; i < NUM_CLASSES; i++) printf("%s,0x%06X\n", names[i], centroids[i]);
+    }
+    if (image != NULL && !write_ppm(image, lut, samples)) {
+        fprintf(stderr, "cannot write %s\n", image);
+        return 1;
+    }
+    return 0;
+}
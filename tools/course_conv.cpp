@@ -0,0 +1,208 @@
+//
+//  course_conv.cpp
+//  aflac2020
+//
+//  Host tool to convert a course map CSV (the format of BlindRunner_prop.txt) and
+//  an optional parameter CSV (name,value per line) into the binary course file.
+//  Each name must be one of PARAM_LIST, and its value is converted to the type declared there:
+//  FLT parameters are stored as the bit pattern of the float, INT ones must be whole numbers.
+//  Course rows labelled F and a colour name, e.g. Fblue,2240,2710, are landmarks from start to end.
+//
+//  build: g++ -DMAKE_HOST -I.. -o course_conv course_conv.cpp ../CourseFile.cpp ../ParamStore.cpp
+//  usage: course_conv course.csv [params.csv] course.bin
+//         course_conv -d course.bin
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "CourseFile.hpp"
+#include "ColorClassifier.hpp"
+#include "ParamStore.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+static bool byKey(const struct cfParam& a, const struct cfParam& b) {
+    return a.key < b.key;
+}
+
+static int readFeature(const char* label, int start, double end, struct cfFeature* f, int& nf) {
+    if (nf >= CF_MAX_FEATURES) {
+        fprintf(stderr, "too many landmarks, at most %d\n", CF_MAX_FEATURES);
+        return -1;
+    }
+    for (int c = 0; c < NUM_CLASSES; c++) {
+        if (strcmp(label + 1, className[c]) == 0) {
+            memset(&f[nf], 0, sizeof(f[nf]));
+            f[nf].start = start;
+            f[nf].end = (int32_t)end;
+            f[nf].color = c;
+            nf++;
+            return 0;
+        }
+    }
+    fprintf(stderr, "landmark of unknown colour %s\n", label + 1);
+    return -1;
+}
+
+// labels without a section type, like st00 in BlindRunner_prop.txt, are taken as blind sections
+static int readCourse(const char* filename, struct cfSection* s, struct cfFeature* f, int& nf) {
+    FILE* fp = fopen(filename, "r");
+    if (fp == NULL) return -1;
+    char buf[128], label[16];
+    int n = 0, end;
+    double curv;
+    if (fgets(buf, sizeof(buf), fp) == NULL) n = -1; // header
+    while (n >= 0 && fgets(buf, sizeof(buf), fp) != NULL) {
+        if (sscanf(buf, "%15[^,],%d,%lf", label, &end, &curv) != 3) continue;
+        if (label[0] == 'F') {
+            if (readFeature(label, end, curv, f, nf) < 0) n = -1;
+            continue;
+        }
+        if (n >= CF_MAX_SECTIONS - 1) {
+            fprintf(stderr, "too many sections, at most %d\n", CF_MAX_SECTIONS - 1);
+            n = -1;
+            break;
+        }
+        memset(&s[n], 0, sizeof(s[n]));
+        size_t prefix = (strchr("BRL", label[0]) != NULL) ? 0 : 1, len = strlen(label);
+        if (prefix + len >= sizeof(s[n].id)) { // the id keeps its terminator
+            fprintf(stderr, "section label %s too long, at most %d characters\n", label, (int)(sizeof(s[n].id) - 1 - prefix));
+            n = -1;
+            break;
+        }
+        s[n].id[0] = 'B';
+        memcpy(s[n].id + prefix, label, len);
+        s[n].id[prefix + len] = '\0';
+        s[n].sectionEnd = end;
+        s[n].curvature = cf_curvature(curv);
+        n++;
+    }
+    fclose(fp);
+    // the map has to end by giving control back to LineTracer as courseMap does
+    if (n > 0 && s[n - 1].id[0] != 'L') {
+        s[n] = s[n - 1];
+        s[n - 1].id[0] = 'R';
+        s[n].id[0] = 'L';
+        n++;
+    }
+    return n;
+}
+
+// value converted to the declared type of the parameter, false if it is not one of PARAM_LIST
+// or the text is not a number of that type within its bounds
+static bool convertParam(ParamStore& store, const char* name, const char* value, struct cfParam& p) {
+    int id = store.find(cf_hash(name));
+    if (id < 0 || strcmp(store.getName(id), name) != 0) {
+        fprintf(stderr, "unknown parameter %s\n", name);
+        return false;
+    }
+    p.key = cf_hash(name);
+    char* end;
+    if (store.getType(id) == PT_FLT) {
+        float f = (float)strtod(value, &end);
+        memcpy(&p.value, &f, sizeof(f));
+    } else {
+        p.value = strtol(value, &end, 0); // hex as well, e.g. CLR_RGB() colours
+        if (*end == '.' || *end == 'e' || *end == 'E') {
+            double d = strtod(value, &end);
+            if (d != (double)(int32_t)d) {
+                fprintf(stderr, "parameter %s is an integer, not %s\n", name, value);
+                return false;
+            }
+            p.value = (int32_t)d;
+        }
+    }
+    if (end == value || *end != '\0') {
+        fprintf(stderr, "parameter %s has no valid value in %s\n", name, value);
+        return false;
+    }
+    if (!store.check(id, p.value)) {
+        fprintf(stderr, "parameter %s is out of its bounds at %s\n", name, value);
+        return false;
+    }
+    return true;
+}
+
+static int readParams(const char* filename, struct cfParam* p) {
+    FILE* fp = fopen(filename, "r");
+    if (fp == NULL) return -1;
+    ParamStore store;
+    char buf[128], name[64], value[32];
+    int n = 0;
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+        if (sscanf(buf, "%63[^,],%31s", name, value) != 2) continue;
+        if (strcmp(name, "name") == 0) continue; // header
+        if (n >= CF_MAX_PARAMS) {
+            fprintf(stderr, "too many parameters, at most %d\n", CF_MAX_PARAMS);
+            n = -1;
+            break;
+        }
+        if (!convertParam(store, name, value, p[n])) {
+            n = -1;
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (p[i].key == p[n].key) {
+                fprintf(stderr, "parameter %s duplicated or colliding\n", name);
+                fclose(fp);
+                return -1;
+            }
+        }
+        n++;
+    }
+    fclose(fp);
+    std::sort(p, p + (n > 0 ? n : 0), byKey);
+    return n;
+}
+
+static int dump(const char* filename) {
+    CourseFile file;
+    if (!file.load(filename)) {
+        fprintf(stderr, "%s: not found or corrupted\n", filename);
+        return 1;
+    }
+    printf("lable,distanceTo,curvature\n");
+    for (int i = 0; i < file.getNumSections(); i++) {
+        const struct cfSection* s = file.getSection(i);
+        printf("%.6s,%05d,%.4f\n", s->id, s->sectionEnd, (double)s->curvature / CF_CURV_SCALE);
+    }
+    for (int i = 0; i < file.getNumFeatures(); i++) {
+        const struct cfFeature* f = file.getFeature(i);
+        printf("F%s,%05d,%05d\n", (f->color < NUM_CLASSES) ? className[f->color] : "?", f->start, f->end);
+    }
+    for (int i = 0; i < file.getNumParams(); i++) {
+        const struct cfParam* p = file.getParam(i);
+        printf("#%08x,%d\n", p->key, p->value);
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc == 3 && strcmp(argv[1], "-d") == 0) return dump(argv[2]);
+    if (argc != 3 && argc != 4) {
+        fprintf(stderr, "usage: %s course.csv [params.csv] course.bin\n       %s -d course.bin\n", argv[0], argv[0]);
+        return 2;
+    }
+    struct cfSection sections[CF_MAX_SECTIONS];
+    struct cfParam params[CF_MAX_PARAMS];
+    struct cfFeature features[CF_MAX_FEATURES];
+    int nf = 0;
+    int ns = readCourse(argv[1], sections, features, nf);
+    if (ns < 0) {
+        fprintf(stderr, "%s: cannot read\n", argv[1]);
+        return 1;
+    }
+    int np = 0;
+    if (argc == 4 && (np = readParams(argv[2], params)) < 0) {
+        fprintf(stderr, "%s: cannot read\n", argv[2]);
+        return 1;
+    }
+    if (!CourseFile::write(argv[argc - 1], sections, ns, params, np, features, nf)) {
+        fprintf(stderr, "%s: cannot write\n", argv[argc - 1]);
+        return 1;
+    }
+    printf("%d sections, %d parameters, %d landmarks written to %s\n", ns, np, nf, argv[argc - 1]);
+    return 0;
+}
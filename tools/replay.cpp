@@ -0,0 +1,1049 @@
+//
+//  replay.cpp
+//  aflac2020
+//
+//  Replays recorded traces through the on-robot estimators to compare them offline.
+//  Traces are CSV as written by tlm_receiver, recorded with TLM_DECIM 1 for the observer rate;
+//  an optional label column (a class name as in colorlut) overrides the colour the robot saw
+//  as the ground truth. Without a trace, -s synthesizes one with known transitions.
+//
+//  cusum: detection of the black/blue transitions by the former derivative moving average
+//         (MA of 10, +-150 per second) and by CusumDetector (BL_CUSUM_DRIFT, BL_CUSUM_THRESHOLD)
+//         of the gray scale off its moving average.
+//         A detection matches a true transition in the same direction up to MATCH_WINDOW ms
+//         later; the others are false alarms.
+//
+//  heading: HeadingEstimator with and without the gyro over a synthesized lap, where the effective
+//         tread, the tire diameters and slip on the curves put the encoders off, and the gyro has
+//         a bias and noise and reads whole degrees per second. The robot stands still for
+//         HDG_STANDSTILL ms first. Telemetry carries no gyro rate, hence no trace input.
+//
+//  localize: Localizer against plain odometry over the same lap with blue landmarks, where the
+//         odometry is off by a scale error and slip, and the colour flickers to blue now and then.
+//         Reports the distance errors and the time taken by Localizer::update().
+//
+//  path:  PurePursuit driving the slalom and garage routes on a kinematic model of the robot, whose
+//         wheels follow the PWM with a first-order lag. Reports the time to the end of each route and
+//         how far off the path it ran. Each garage route is timed to its block spot against the steps
+//         of its colour on the same model, with their rests, their turns by MotionPrimitive and the
+//         line traces as straights; the sensors the steps wait on are taken as seen on time.
+//
+//  motion: MotionPrimitive driving, turning and following arcs on the kinematic model of path,
+//         against the scripted steps that drove the same PWM until Observer saw the distance or the
+//         angle and then stopped the wheels. Reports where each came to rest past the target, then
+//         how far past a line each stopped on its colour, with a turn that starts on another line.
+//
+//  profile: MotionProfile on steps of the target, checking the acceleration and jerk limits and
+//         that the speed settles without overshoot, then a lap of speed changes on a model where
+//         the body follows the wheels up to PRF_TRACTION and the wheels slip beyond it. Compares
+//         instant steps, trapezoids and S-curves by lap time and slipped travel.
+//
+//  velocity: VelocityController against the plain PWM of MMPS_PER_PWM on a wheel whose speed follows
+//         the PWM scaled by the battery voltage, less a load, with a first-order lag; the encoder
+//         reads whole degrees. Reports the speed held and the time to reach it for a range of
+//         battery voltages, on the flat and on the slalom climb.
+//
+//  sysid: MotorIdentifier on two wheels of known first-order plus dead-time models, driven by its
+//         PRBS for SYSID_TIME as LineTracer does, with a random turn on top as the PID gives and
+//         the encoders reading whole degrees. Reports the fitted models against the true ones; their
+//         dead time is shorter than a sample, so the fit does not resolve it and it is not reported.
+//
+//  sched: SensorScheduler on the acquisitions of Observer, each taking the time given with -c in
+//         microseconds, by default the SCH_COST_ guesses below until the robot reports its own.
+//         Compares every sensor in every cycle, the sonar alone at its pace as before, the
+//         multi-rate divisors without phases and with them by the distribution of the time per cycle.
+//
+//  build: g++ -std=gnu++11 -O2 -DMAKE_HOST -I.. -o replay replay.cpp ../HeadingEstimator.cpp ../Localizer.cpp ../PurePursuit.cpp ../MotionProfile.cpp ../MotionPrimitive.cpp ../VelocityController.cpp ../MotorIdentifier.cpp ../SensorScheduler.cpp
+//  usage: replay cusum [-k drift] [-h threshold] [-s seconds] [trace.csv ...]
+//         replay heading [-w gyro weight] [-b bias] [-l laps]
+//         replay localize [-e scale error] [-f flickers per second]
+//         replay path [-r]
+//         replay motion [-l motor lag ms]
+//         replay profile [-a acceleration] [-j jerk]
+//         replay velocity [-s mm/s]
+//         replay sysid [-t turn amplitude]
+//         replay sched [-c color,gyro,wheels,sonar,touch,button]
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "aflac_common.hpp"
+#include "utility.hpp"
+#include "ColorClassifier.hpp"
+#include "HeadingEstimator.hpp"
+#include "Localizer.hpp"
+#include "PurePursuit.hpp"
+#include "MotionProfile.hpp"
+#include "MotionPrimitive.hpp"
+#include "VelocityController.hpp"
+#include "MotorIdentifier.hpp"
+#include "SensorScheduler.hpp"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+
+#define MA_BASE            10 // MA_CAP of Observer, the baseline of the gray scale level
+#define MATCH_WINDOW      300 // ms after a true transition to accept its detection
+#define TRUTH_HOLD          5 // samples a colour must persist to count as a true transition
+#define SYN_PERIOD          4 // ms between synthesized samples, as PERIOD_OBS_TSK
+#define SYN_SEGMENT      3000 // ms between synthesized transitions
+#define HDG_STANDSTILL   2000 // ms at rest before the lap
+#define HDG_SPEED         300 // mm/s along the lap
+#define HDG_TREAD_ERR    1.03 // effective tread over WHEEL_TREAD
+#define HDG_TIRE_ERR    1.005 // left tire diameter over the right one
+#define HDG_SLIP_RATE    0.02 // chance per cycle on a curve that the inner wheel slips
+#define HDG_GYRO_NOISE    1.5 // standard deviation of the gyro rate in degree per second
+#define LOC_SCALE_ERR    0.02 // odometry over the true travel
+#define LOC_SLIP_RATE   0.005 // chance per cycle that the wheels slip forward by LOC_SLIP_LEN
+#define LOC_SLIP_LEN      1.0 // mm
+#define LOC_FLICKER       1.0 // false blue samples per second
+#define PATH_PERIOD         4 // ms between steps, as PERIOD_NAV_TSK
+#define PATH_MOTOR_LAG    100 // time constant of the wheel speed following the PWM in ms
+#define PATH_TIMEOUT    60000 // ms to give up a route
+#define MOT_PERIOD          4 // ms between steps, as PERIOD_NAV_TSK and PERIOD_OBS_TSK
+#define MOT_TIMEOUT     10000 // ms to give up a primitive
+#define MOT_LINE_Y        250 // mm ahead of the start where the line to stop on begins
+#define MOT_LINE_WIDTH     20 // mm across the lines, and degree for the turn over them
+#define MOT_LINE_DEG       60 // heading of the second line the turn crosses, the first is at 0
+#define PRF_PERIOD          4 // ms between updates, as PERIOD_NAV_TSK
+#define PRF_TRACTION     2500 // mm/s^2 the tires pass on before slipping
+#define PRF_WHEEL_LAG      20 // time constant of a slipping wheel following the PWM in ms
+#define VEL_RUN          3000 // ms to run each case
+#define VEL_CLIMB          80 // mm/s the slalom climb takes off the wheel speed
+#define SCH_RUN         60000 // ms of observer cycles to schedule
+#define SCH_COST_COLOR     60 // us per read, raw RGB
+#define SCH_COST_GYRO      30 // angle and rate
+#define SCH_COST_WHEELS    10 // both counts
+#define SCH_COST_SONAR     40
+#define SCH_COST_TOUCH     15
+#define SCH_COST_BUTTON     5
+
+struct sample {
+    uint32_t time;
+    int16_t  grayScale;
+    int      color; // class the robot saw
+    int      label; // true class, or -1 if not labelled
+};
+
+struct event {
+    uint32_t time;
+    int      rise; // 1 for black to blue, 0 for blue to black
+};
+
+struct score {
+    int      detected, missed, falseAlarms;
+    uint32_t sumLatency, maxLatency;
+};
+
+static int class_of_name(const char* name) {
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        if (strcmp(name, className[i]) == 0) return i;
+    }
+    return -1;
+}
+
+static bool read_trace(const char* filename, std::vector<struct sample>& samples) {
+    FILE* fp = fopen(filename, "r");
+    if (fp == NULL) return false;
+    char line[512];
+    int col[4] = { -1, -1, -1, -1 }; // time, grayScale, color, label
+    if (fgets(line, sizeof(line), fp) != NULL) {
+        const char* names[4] = { "time", "grayScale", "color", "label" };
+        int i = 0;
+        for (char* tok = strtok(line, ",\r\n"); tok != NULL; tok = strtok(NULL, ",\r\n"), i++) {
+            for (int k = 0; k < 4; k++) {
+                if (strcmp(tok, names[k]) == 0) col[k] = i;
+            }
+        }
+    }
+    if (col[0] < 0 || col[1] < 0 || col[2] < 0) {
+        fprintf(stderr, "%s: columns time, grayScale and color are needed\n", filename);
+        fclose(fp);
+        return false;
+    }
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        struct sample s = { 0, 0, CLS_UNKNOWN, -1 };
+        int i = 0;
+        for (char* tok = strtok(line, ",\r\n"); tok != NULL; tok = strtok(NULL, ",\r\n"), i++) {
+            if (i == col[0]) s.time = strtoul(tok, NULL, 10);
+            if (i == col[1]) s.grayScale = atoi(tok);
+            if (i == col[2]) s.color = atoi(tok);
+            if (i == col[3]) s.label = class_of_name(tok);
+        }
+        samples.push_back(s);
+    }
+    fclose(fp);
+    return true;
+}
+
+// tracing the edge of a black line with blue sections, the colour turns blue a little after the level rises
+static void synthesize(int seconds, std::vector<struct sample>& samples) {
+    srand(1);
+    const int black = 23, blue = 42, white = 155;
+    double level = black;
+    for (uint32_t t = 0; t < (uint32_t)seconds * 1000; t += SYN_PERIOD) {
+        bool onBlue = (t / SYN_SEGMENT) % 2 == 1;
+        double line = onBlue ? blue : black;
+        level += (line - level) * 0.15; // the sensor spot moves onto the new colour over a few cycles
+        // weaving across the edge, the spot sees a varying share of white
+        double share = 0.15 + 0.1 * sin(2.0 * M_PI * t / 700.0);
+        double gs = level + (white - level) * share + (rand() % 3 - 1); // the FIR leaves little noise
+        struct sample s;
+        s.time = t;
+        s.grayScale = (int16_t)gs;
+        s.label = onBlue ? CLS_BLUE : CLS_BLACK;
+        s.color = (level - black > (blue - black) / 2) ? CLS_BLUE : CLS_BLACK;
+        if (rand() % 200 == 0) s.color = (s.color == CLS_BLUE) ? CLS_BLACK : CLS_BLUE; // a stray misclassification
+        samples.push_back(s);
+    }
+}
+
+static void find_truth(const std::vector<struct sample>& samples, std::vector<struct event>& truth) {
+    int cur = -1, cand = -1, held = 0;
+    uint32_t candTime = 0;
+    for (size_t j = 0; j < samples.size(); j++) {
+        int c = (samples[j].label >= 0) ? samples[j].label : samples[j].color;
+        if (c != CLS_BLACK && c != CLS_BLUE) continue;
+        if (c != cand) {
+            cand = c;
+            candTime = samples[j].time;
+            held = 0;
+        }
+        if (++held == TRUTH_HOLD && cand != cur) {
+            if (cur >= 0) {
+                struct event e = { candTime, cand == CLS_BLUE };
+                truth.push_back(e);
+            }
+            cur = cand;
+        }
+    }
+}
+
+// the logic Observer had before CusumDetector
+static void detect_ma(const std::vector<struct sample>& samples, std::vector<struct event>& found) {
+    MovingAverage<int32_t, 10> ma;
+    bool blue = false;
+    for (size_t j = 1; j < samples.size(); j++) {
+        int32_t timeDiff = samples[j].time - samples[j - 1].time;
+        if (timeDiff <= 0) continue;
+        int32_t ma_gs = ma.add((samples[j].grayScale - samples[j - 1].grayScale) * 1000 / timeDiff * 1000);
+        if (!blue && ma_gs > 150 && samples[j].color == CLS_BLUE) {
+            blue = true;
+            struct event e = { samples[j].time, 1 };
+            found.push_back(e);
+        } else if (blue && ma_gs < -150 && samples[j].color != CLS_BLUE) {
+            blue = false;
+            struct event e = { samples[j].time, 0 };
+            found.push_back(e);
+        }
+    }
+}
+
+static void detect_cusum(const std::vector<struct sample>& samples, int32_t k, int32_t h, std::vector<struct event>& found) {
+    WindowStats<int16_t, MA_BASE, int32_t> base;
+    CusumDetector<int32_t> cusum(k, h);
+    bool blue = false;
+    base.add(samples[0].grayScale);
+    for (size_t j = 1; j < samples.size(); j++) {
+        int8_t change = cusum.add(samples[j].grayScale - base.mean());
+        base.add(samples[j].grayScale);
+        if (!blue && change == CUSUM_RISE && samples[j].color == CLS_BLUE) {
+            blue = true;
+            cusum.clear();
+            struct event e = { samples[j].time, 1 };
+            found.push_back(e);
+        } else if (blue && change == CUSUM_FALL && samples[j].color != CLS_BLUE) {
+            blue = false;
+            cusum.clear();
+            struct event e = { samples[j].time, 0 };
+            found.push_back(e);
+        }
+    }
+}
+
+static struct score evaluate(const std::vector<struct event>& truth, const std::vector<struct event>& found) {
+    struct score s = { 0, 0, 0, 0, 0 };
+    std::vector<bool> used(found.size(), false);
+    for (size_t i = 0; i < truth.size(); i++) {
+        bool hit = false;
+        for (size_t j = 0; j < found.size(); j++) {
+            if (used[j] || found[j].rise != truth[i].rise) continue;
+            if (found[j].time < truth[i].time || found[j].time > truth[i].time + MATCH_WINDOW) continue;
+            uint32_t latency = found[j].time - truth[i].time;
+            s.sumLatency += latency;
+            if (latency > s.maxLatency) s.maxLatency = latency;
+            used[j] = hit = true;
+            break;
+        }
+        if (hit) s.detected++; else s.missed++;
+    }
+    for (size_t j = 0; j < found.size(); j++) {
+        if (!used[j]) s.falseAlarms++;
+    }
+    return s;
+}
+
+static void print_score(const char* name, const struct score& s, double minutes) {
+    printf("%-6s detected %3d, missed %3d, false alarms %3d (%.2f/min), latency mean %3u ms, max %3u ms\n",
+        name, s.detected, s.missed, s.falseAlarms, s.falseAlarms / minutes,
+        s.detected ? s.sumLatency / s.detected : 0, s.maxLatency);
+}
+
+static int cmd_cusum(int argc, char* argv[]) {
+    int32_t k = BL_CUSUM_DRIFT, h = BL_CUSUM_THRESHOLD;
+    int seconds = 0;
+    std::vector<struct sample> samples;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-k") == 0 && i + 1 < argc) {
+            k = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-h") == 0 && i + 1 < argc) {
+            h = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            seconds = atoi(argv[++i]);
+        } else if (!read_trace(argv[i], samples)) {
+            fprintf(stderr, "cannot read %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (seconds > 0) synthesize(seconds, samples);
+    if (samples.size() < 2) {
+        fprintf(stderr, "no samples\n");
+        return 1;
+    }
+
+    std::vector<struct event> truth, byMa, byCusum;
+    find_truth(samples, truth);
+    detect_ma(samples, byMa);
+    detect_cusum(samples, k, h, byCusum);
+    double minutes = (samples.back().time - samples.front().time) / 60000.0;
+    printf("%zu samples over %.1f s, %zu transitions\n", samples.size(), minutes * 60.0, truth.size());
+    print_score("ma", evaluate(truth, byMa), minutes);
+    print_score("cusum", evaluate(truth, byCusum), minutes);
+    return 0;
+}
+
+// a closed lap: length in mm and signed radius in mm (positive to the right, 0 for straight)
+static const struct lapSegment {
+    double length, radius;
+} lap[] = {
+    { 2000,    0 }, { M_PI * 500,  500 }, { 800,    0 },
+    { M_PI / 2 * 400, -400 }, { M_PI / 2 * 400, 400 },
+    { 1200,    0 }, { M_PI * 500,  500 }, { 2000,    0 },
+};
+
+static double gauss() {
+    double u = (rand() + 1.0) / (RAND_MAX + 2.0), v = (rand() + 1.0) / (RAND_MAX + 2.0);
+    return sqrt(-2.0 * log(u)) * cos(2.0 * M_PI * v);
+}
+
+static int cmd_heading(int argc, char* argv[]) {
+    double gyroBias = 1.7;
+    int laps = 1, weight = HDG_GYRO_WEIGHT;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) {
+            weight = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) {
+            gyroBias = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            laps = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    srand(7);
+    HeadingEstimator encOnly(0), fused(weight);
+    const double dt = SYN_PERIOD / 1000.0, tireR = TIRE_DIAMETER, tireL = TIRE_DIAMETER * HDG_TIRE_ERR;
+    const double tread = WHEEL_TREAD * HDG_TREAD_ERR;
+    double arcL = 0.0, arcR = 0.0, yaw = 0.0; // true wheel travel in mm and heading in degree
+    int32_t prevCntL = 0, prevCntR = 0;
+    double maxEnc = 0.0, maxFused = 0.0;
+    int cycles = HDG_STANDSTILL / SYN_PERIOD;
+    size_t seg = 0;
+    double along = 0.0;
+    for (int c = 0; laps > 0; c++) {
+        double rate = 0.0; // true yaw rate in degree per second
+        bool slip = false;
+        if (c >= cycles) {
+            const struct lapSegment& s = lap[seg];
+            double step = HDG_SPEED * dt;
+            double k = (s.radius == 0.0) ? 0.0 : 1.0 / s.radius;
+            rate = HDG_SPEED * k * 180.0 / M_PI;
+            double dl = step * (1.0 + k * tread / 2.0), dr = step * (1.0 - k * tread / 2.0);
+            // the encoders count what the wheel turned, slip turns it without moving the robot
+            slip = (k != 0.0) && (rand() < RAND_MAX * HDG_SLIP_RATE);
+            if (slip) {
+                if (k > 0) dr *= 1.3; else dl *= 1.3;
+            }
+            arcL += dl;
+            arcR += dr;
+            yaw += rate * dt;
+            along += step;
+            if (along >= s.length) {
+                along -= s.length;
+                if (++seg == sizeof(lap) / sizeof(*lap)) {
+                    seg = 0;
+                    laps--;
+                }
+            }
+        }
+        int32_t cntL = (int32_t)floor(arcL * 360.0 / (M_PI * tireL));
+        int32_t cntR = (int32_t)floor(arcR * 360.0 / (M_PI * tireR));
+        int16_t gyro = (int16_t)lround(rate + gyroBias + HDG_GYRO_NOISE * gauss()); // whole degrees as the sensor
+        encOnly.update(cntL - prevCntL, cntR - prevCntR, gyro, SYN_PERIOD);
+        fused.update(cntL - prevCntL, cntR - prevCntR, gyro, SYN_PERIOD);
+        prevCntL = cntL;
+        prevCntR = cntR;
+        double eEnc = encOnly.getUnwrapped() / 1000.0 - yaw, eFused = fused.getUnwrapped() / 1000.0 - yaw;
+        if (fabs(eEnc) > maxEnc) maxEnc = fabs(eEnc);
+        if (fabs(eFused) > maxFused) maxFused = fabs(eFused);
+        if (laps == 0) {
+            printf("%.1f s, true heading %.1f degree, gyro bias %.2f learned as %.2f degree/s\n",
+                c * dt, yaw, gyroBias, fused.getBias() / 1000.0);
+            printf("encoder  drift at the end %7.2f, max %7.2f degree\n", eEnc, maxEnc);
+            printf("fused    drift at the end %7.2f, max %7.2f degree\n", eFused, maxFused);
+        }
+    }
+    return 0;
+}
+
+// blue stretches along lap[]
+static const struct cfFeature landmarks[] = {
+    { 2300, 2700, CLS_BLUE, {0} }, { 5200, 5500, CLS_BLUE, {0} }, { 8700, 9300, CLS_BLUE, {0} },
+};
+
+static double elapsed_ns(const struct timespec& a, const struct timespec& b) {
+    return (b.tv_sec - a.tv_sec) * 1e9 + (b.tv_nsec - a.tv_nsec);
+}
+
+static int cmd_localize(int argc, char* argv[]) {
+    double scaleErr = LOC_SCALE_ERR, flicker = LOC_FLICKER;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+            scaleErr = atof(argv[++i]);
+        } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+            flicker = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    double length = 0.0;
+    for (size_t i = 0; i < sizeof(lap) / sizeof(*lap); i++) length += lap[i].length;
+    const int nl = sizeof(landmarks) / sizeof(*landmarks);
+    srand(7);
+    Localizer loc;
+    loc.setLandmarks(landmarks, nl, (int32_t)length);
+    const double dt = SYN_PERIOD / 1000.0;
+    double truth = 0.0, odometry = 0.0, sumNs = 0.0, maxNs = 0.0;
+    double maxOdo = 0.0, maxLoc = 0.0, sumOdo = 0.0, sumLoc = 0.0;
+    int cycles = 0, flickerLeft = 0;
+    while (truth < length) {
+        double step = HDG_SPEED * dt;
+        truth += step;
+        double delta = step * (1.0 + scaleErr);
+        if (rand() < RAND_MAX * LOC_SLIP_RATE) delta += LOC_SLIP_LEN;
+        odometry += delta;
+        uint8_t color = CLS_BLACK;
+        for (int i = 0; i < nl; i++) {
+            if (truth >= landmarks[i].start && truth < landmarks[i].end) color = CLS_BLUE;
+        }
+        // a flicker lasts one or two samples, shorter than LOC_CONFIRM
+        if (flickerLeft == 0 && rand() < RAND_MAX * flicker * dt) flickerLeft = 1 + rand() % 2;
+        if (flickerLeft > 0) {
+            flickerLeft--;
+            color = (color == CLS_BLUE) ? CLS_BLACK : CLS_BLUE;
+        }
+        struct timespec t0, t1;
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        loc.update((int32_t)(delta * 1000.0), color, 0);
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        double ns = elapsed_ns(t0, t1);
+        sumNs += ns;
+        if (ns > maxNs) maxNs = ns;
+        double eOdo = fabs(odometry - truth), eLoc = fabs(loc.getDistance() - truth);
+        sumOdo += eOdo;
+        sumLoc += eLoc;
+        if (eOdo > maxOdo) maxOdo = eOdo;
+        if (eLoc > maxLoc) maxLoc = eLoc;
+        cycles++;
+    }
+    printf("%.0f mm lap, %d landmarks, scale error %.3f, %d corrections\n", length, nl, scaleErr, loc.getCorrections());
+    printf("odometry  error at the end %7.1f, mean %7.1f, max %7.1f mm\n", odometry - truth, sumOdo / cycles, maxOdo);
+    printf("localizer error at the end %7.1f, mean %7.1f, max %7.1f mm\n", loc.getDistance() - truth, sumLoc / cycles, maxLoc);
+    printf("update() mean %.0f ns, max %.0f ns over %d cycles\n", sumNs / cycles, maxNs, cycles);
+    return 0;
+}
+
+struct mpRobot {
+    double x, y, az, vL, vR, dist; // az in radian clockwise, dist along the track of the centre
+};
+
+// moves by one step of the wheels following the PWM with a first-order lag
+static void mp_move(struct mpRobot& r, int16_t pwmL, int16_t pwmR, double motorLag) {
+    const double dt = MOT_PERIOD / 1000.0, lag = MOT_PERIOD / (motorLag + MOT_PERIOD);
+    r.vL += (pwmL * MMPS_PER_PWM - r.vL) * lag;
+    r.vR += (pwmR * MMPS_PER_PWM - r.vR) * lag;
+    double v = (r.vL + r.vR) / 2.0, w = (r.vL - r.vR) / WHEEL_TREAD;
+    r.x += v * dt * sin(r.az + w * dt / 2.0);
+    r.y += v * dt * cos(r.az + w * dt / 2.0);
+    r.az += w * dt;
+    r.dist += v * dt;
+}
+
+// heading in whole degree from 0 to 359 and distance in whole milimeter, as Observer gives them
+static int16_t mp_degree(const struct mpRobot& r) {
+    int16_t d = (int16_t)floor(r.az * 180.0 / M_PI);
+    return (d % 360 + 360) % 360;
+}
+
+// returns the time at which no more than tail was left along the route
+static int drive_route(const char* name, const struct waypoint* route, int n, int8_t mirror, double tail = 0.0) {
+    PurePursuit pp;
+    double x = 0.0, y = 0.0, az = 0.0, vL = 0.0, vR = 0.0, maxOff = 0.0;
+    const double dt = PATH_PERIOD / 1000.0, lag = dt * 1000.0 / (PATH_MOTOR_LAG + dt * 1000.0);
+    pp.start(route, n, x, y, az, mirror);
+    int t = 0, pivots = 0, toTail = -1;
+    int16_t forward, turn;
+    for (; t < PATH_TIMEOUT; t += PATH_PERIOD) {
+        if (!pp.step(x, y, az, forward, turn)) break;
+        if (toTail < 0 && pp.getRemaining() <= tail) toTail = t;
+        if (forward == 0) pivots++;
+        if (fabs(pp.getCrossTrack()) > maxOff) maxOff = fabs(pp.getCrossTrack());
+        vL += ((forward + turn) * MMPS_PER_PWM - vL) * lag;
+        vR += ((forward - turn) * MMPS_PER_PWM - vR) * lag;
+        double v = (vL + vR) / 2.0, w = (vL - vR) / WHEEL_TREAD; // clockwise
+        x += v * dt * sin(az + w * dt / 2.0);
+        y += v * dt * cos(az + w * dt / 2.0);
+        az += w * dt;
+    }
+    double ex = x - mirror * route[n - 1].x, ey = y - route[n - 1].y;
+    printf("%-13s %s %5.2f s, %4.0f ms pivoting, max %5.1f mm off the path, stopped %5.1f mm from the end\n",
+        name, (t < PATH_TIMEOUT) ? "arrived in" : "gave up at", t / 1000.0, pivots * (double)PATH_PERIOD,
+        maxOff, sqrt(ex * ex + ey * ey));
+    return (toTail < 0) ? t : toTail;
+}
+
+enum { SEG_REST, SEG_TURN, SEG_ARC, SEG_PWM, SEG_TRACE };
+
+// a step of the script on the left course, a SEG_PWM ends after ms if given, else at mm along the
+// whole script as SEG_TRACE does, which follows a line by holding its heading
+struct scriptSeg {
+    int8_t  kind;
+    int16_t pwmL, pwmR;     // PWM of the wheels, the outer one of SEG_ARC, of the turn in pwmL
+    int32_t ms, mm;
+    int16_t degree, radius; // heading to turn to or of the line, or degree of SEG_ARC
+};
+
+// black: 190 to 193 and the trace to the yellow circle, 230 and 231 up to the block spot
+static const struct scriptSeg garageScriptBlack[] = {
+    { SEG_REST,  0,  0, 900,   0,   0,  0 },
+    { SEG_TURN, 50,  0,   0,   0,  80,  0 },
+    { SEG_TURN, 50,  0,   0,   0, 105,  0 },
+    { SEG_TRACE,30, 30,   0, 350,  90,  0 },
+    { SEG_REST,  0,  0, 300,   0,   0,  0 },
+    { SEG_TURN, 30,  0,   0,   0,  12,  0 },
+    { SEG_PWM,  30, 30,   0, 620,   0,  0 },
+};
+
+// red: 200 and 201 up to the block spot
+static const struct scriptSeg garageScriptRed[] = {
+    { SEG_REST,  0,  0, 600,   0,   0,  0 },
+    { SEG_ARC,  10,  0,   0,   0,  93, 75 },
+    { SEG_PWM,  30, 30,   0, 472,   0,  0 },
+};
+
+// yellow: 210 to 212 up to the block spot
+static const struct scriptSeg garageScriptYellow[] = {
+    { SEG_PWM,  30, 25, 800,   0,   0,  0 },
+    { SEG_PWM,  30, 30,   0, 374,   0,  0 },
+};
+
+// returns the time the script took on the model of drive_route
+static int drive_script(const struct scriptSeg* script, int n) {
+    struct mpRobot r = {};
+    MotionPrimitive mp;
+    int t = 0;
+    for (int i = 0; i < n && t < PATH_TIMEOUT; i++) {
+        const struct scriptSeg& s = script[i];
+        int16_t pwmL = s.pwmL, pwmR = s.pwmR;
+        switch (s.kind) {
+            case SEG_REST: pwmL = pwmR = 0;                                         break;
+            case SEG_TURN: mp.turnTo(s.degree, s.pwmL, mp_degree(r));                break;
+            case SEG_ARC:  mp.arc(s.radius, s.degree, s.pwmL, mp_degree(r));        break;
+            default:                                                                break;
+        }
+        for (int start = t; t < PATH_TIMEOUT; t += PATH_PERIOD) {
+            if (s.kind == SEG_TURN || s.kind == SEG_ARC) {
+                if (!mp.step((int32_t)floor(r.dist), mp_degree(r), CLS_WHITE, pwmL, pwmR)) break;
+            } else if (s.ms > 0) {
+                if (t - start >= s.ms) break;
+            } else if (r.dist >= s.mm) {
+                break;
+            }
+            if (s.kind == SEG_TRACE) {
+                int16_t off = ((s.degree - mp_degree(r)) % 360 + 540) % 360 - 180;
+                pwmL = s.pwmL + MP_HOLD_GAIN * off;
+                pwmR = s.pwmR - MP_HOLD_GAIN * off;
+            }
+            mp_move(r, pwmL, pwmR, PATH_MOTOR_LAG);
+        }
+    }
+    return t;
+}
+
+static void time_garage(const char* name, const struct waypoint* route, int n, const struct scriptSeg* script, int ns, int8_t mirror) {
+    int tRoute = drive_route(name, route, n, mirror, GARAGE_TAIL_LEN);
+    int tScript = drive_script(script, ns);
+    printf("%-13s block spot in %5.2f s by the route, %5.2f s by the steps\n", "", tRoute / 1000.0, tScript / 1000.0);
+}
+
+static int cmd_path(int argc, char* argv[]) {
+    int8_t mirror = 1;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-r") == 0) {
+            mirror = -1; // the right course
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    drive_route("slalom", slalomRoute, sizeof(slalomRoute) / sizeof(*slalomRoute), mirror);
+    time_garage("garage black", garageRouteBlack, sizeof(garageRouteBlack) / sizeof(*garageRouteBlack),
+        garageScriptBlack, sizeof(garageScriptBlack) / sizeof(*garageScriptBlack), mirror);
+    time_garage("garage red", garageRouteRed, sizeof(garageRouteRed) / sizeof(*garageRouteRed),
+        garageScriptRed, sizeof(garageScriptRed) / sizeof(*garageScriptRed), mirror);
+    time_garage("garage yellow", garageRouteYellow, sizeof(garageRouteYellow) / sizeof(*garageRouteYellow),
+        garageScriptYellow, sizeof(garageScriptYellow) / sizeof(*garageScriptYellow), mirror);
+    return 0;
+}
+
+// black across the track from MOT_LINE_Y on, and along the headings 0 and MOT_LINE_DEG under a pivot
+static uint8_t mp_mat(const struct mpRobot& r, bool lines) {
+    if (!lines) return (r.y >= MOT_LINE_Y && r.y < MOT_LINE_Y + MOT_LINE_WIDTH) ? CLS_BLACK : CLS_WHITE;
+    double d = r.az * 180.0 / M_PI;
+    if (fabs(d) < MOT_LINE_WIDTH / 2 || fabs(d - MOT_LINE_DEG) < MOT_LINE_WIDTH / 2) return CLS_BLACK;
+    return CLS_WHITE;
+}
+
+static void mp_coast(struct mpRobot& r, double motorLag, int& t) {
+    while ((fabs(r.vL) > 1.0 || fabs(r.vR) > 1.0) && t < MOT_TIMEOUT) {
+        mp_move(r, 0, 0, motorLag);
+        t += MOT_PERIOD;
+    }
+}
+
+static const struct mpCase {
+    const char* name;
+    int8_t  primitive;  // MP_DRIVE, MP_TURN or MP_ARC
+    int32_t target;     // milimeter, or degree
+    int32_t radius;     // of MP_ARC
+    int8_t  pwm;
+} mpCases[] = {
+    { "drive 170 mm",       MP_DRIVE,  170,   0, 30 }, // step 23
+    { "drive 500 mm",       MP_DRIVE,  500,   0, 30 },
+    { "drive -150 mm",      MP_DRIVE, -150,   0, 20 },
+    { "turn to 25",         MP_TURN,    25,   0, 50 }, // step 192
+    { "turn to 27",         MP_TURN,    27,   0,  7 }, // step 285
+    { "turn to -65",        MP_TURN,   -65,   0, 15 }, // step 71
+    { "turn to 80",         MP_TURN,    80,   0, 50 }, // step 190
+    { "arc 75 mm by 93",    MP_ARC,     93,  75, 10 }, // step 200
+    { "arc -98 mm by 140",  MP_ARC,    140, -98, 30 }, // step 260
+};
+
+// how far the robot came to rest past the target, and the time the primitive took
+static double mp_run(const struct mpCase& c, bool closed, double motorLag, int& t) {
+    struct mpRobot r = {};
+    MotionPrimitive mp;
+    int16_t pwmL, pwmR;
+    switch (c.primitive) {
+        case MP_DRIVE: mp.drive(c.target, c.pwm, 0, 0);                      break;
+        case MP_TURN:  mp.turnTo(c.target, c.pwm, 0);                        break;
+        default:       mp.arc(c.radius, c.target, c.pwm, 0);                 break;
+    }
+    // the script drives the first PWM of the primitive all the way until the threshold is passed
+    mp.step(0, 0, CLS_WHITE, pwmL, pwmR);
+    for (t = 0; t < MOT_TIMEOUT; t += MOT_PERIOD) {
+        int32_t d = (int32_t)floor(r.dist);
+        int16_t deg = mp_degree(r);
+        if (closed) {
+            int16_t l, rr;
+            if (!mp.step(d, deg, CLS_WHITE, l, rr)) break;
+            pwmL = l;
+            pwmR = rr;
+        } else {
+            int32_t s = (c.target < 0) ? -1 : 1;
+            bool passed = (c.primitive == MP_DRIVE) ? s * d > s * c.target
+                        : (c.primitive == MP_TURN) ? s * floor(r.az * 180.0 / M_PI) > s * c.target
+                        : s * floor(r.az * 180.0 / M_PI) * ((c.radius >= 0) ? 1 : -1) > c.target;
+            if (passed) break;
+        }
+        mp_move(r, pwmL, pwmR, motorLag);
+    }
+    int took = t;
+    mp_coast(r, motorLag, t);
+    t = took;
+    double s = (c.target < 0) ? -1.0 : 1.0;
+    if (c.primitive == MP_DRIVE) return s * (r.dist - c.target);
+    double deg = r.az * 180.0 / M_PI;
+    if (c.primitive == MP_ARC && c.radius < 0) deg = -deg;
+    return s * (deg - c.target);
+}
+
+// stops on black, returns how far past its edge the robot came to rest
+static double mp_stop(bool turn, bool closed, double motorLag, int& t) {
+    struct mpRobot r = {};
+    MotionPrimitive mp;
+    int16_t pwmL, pwmR;
+    if (turn) {
+        // from on the first line to the second one, skipping the first 40 degree as step 190
+        mp.stopOnColor(CLS_BLACK, 40);
+        mp.turnTo(80, 50, 0);
+    } else {
+        mp.stopOnColor(CLS_BLACK);
+        mp.drive(500, 30, 0, 0);
+    }
+    mp.step(0, 0, CLS_WHITE, pwmL, pwmR);
+    for (t = 0; t < MOT_TIMEOUT; t += MOT_PERIOD) {
+        uint8_t color = mp_mat(r, turn);
+        if (closed) {
+            int16_t l, rr;
+            if (!mp.step((int32_t)floor(r.dist), mp_degree(r), color, l, rr)) break;
+            pwmL = l;
+            pwmR = rr;
+        } else if (color == CLS_BLACK && (turn ? r.az * 180.0 / M_PI > 40 : true)) {
+            break;
+        }
+        mp_move(r, pwmL, pwmR, motorLag);
+    }
+    int took = t;
+    mp_coast(r, motorLag, t);
+    t = took;
+    if (turn) return r.az * 180.0 / M_PI - (MOT_LINE_DEG - MOT_LINE_WIDTH / 2);
+    return r.y - MOT_LINE_Y;
+}
+
+static int cmd_motion(int argc, char* argv[]) {
+    double motorLag = PATH_MOTOR_LAG;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+            motorLag = atof(argv[++i]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    printf("%-18s %4s   %-22s %-22s\n", "", "pwm", "scripted", "primitive");
+    for (size_t i = 0; i < sizeof(mpCases) / sizeof(*mpCases); i++) {
+        int tS, tP;
+        double oS = mp_run(mpCases[i], false, motorLag, tS);
+        double oP = mp_run(mpCases[i], true, motorLag, tP);
+        printf("%-18s %4d   %+6.1f past in %5d ms   %+6.1f past in %5d ms\n",
+            mpCases[i].name, mpCases[i].pwm, oS, tS, oP, tP);
+    }
+    for (int turn = 0; turn <= 1; turn++) {
+        int tS, tP;
+        double oS = mp_stop(turn, false, motorLag, tS);
+        double oP = mp_stop(turn, true, motorLag, tP);
+        printf("%-18s %4d   %+6.1f past in %5d ms   %+6.1f past in %5d ms\n",
+            turn ? "turn onto black" : "drive onto black", turn ? 50 : 30, oS, tS, oP, tP);
+    }
+    printf("past in milimeter for the drives and in degree for the turns and arcs, at rest\n");
+    return 0;
+}
+
+// a step of the target, returns false if a limit is broken or the speed overshoots
+static bool check_step(int16_t from, int16_t to, int32_t acc, int32_t jerk) {
+    MotionProfile mp(acc, jerk);
+    mp.reset(from);
+    mp.setTarget(to);
+    int t = 0, prevAcc = 0, maxAcc = 0, maxJerk = 0;
+    bool over = false;
+    for (; !mp.isSettled() && t < 10000; t += PRF_PERIOD) {
+        int16_t v = mp.update(PRF_PERIOD);
+        int a = mp.getAcc();
+        if (abs(a) > maxAcc) maxAcc = abs(a);
+        // a step of the acceleration by jerk * PRF_PERIOD reads up to one off after truncation
+        int j = (abs(a - prevAcc) > 1) ? (abs(a - prevAcc) - 1) * 1000 / PRF_PERIOD : 0;
+        if (j > maxJerk) maxJerk = j;
+        prevAcc = a;
+        if ((to >= from && v > to) || (to < from && v < to)) over = true;
+    }
+    bool ok = mp.isSettled() && !over && maxAcc <= acc && (jerk == 0 || maxJerk <= jerk);
+    printf("%4d -> %4d %-9s settled in %4d ms, max %4d PWM/s, max %6d PWM/s^2%s  %s\n", from, to,
+        (jerk == 0) ? "trapezoid" : "S-curve", t, maxAcc, (jerk == 0) ? 0 : maxJerk, over ? ", overshot" : "", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+// sections of a lap by length in milimeter and PWM, as the speeds BlindRunner and LineTracer switch between
+static const int16_t lapSections[][2] = {
+    { 900, SPEED_NORM}, {2200, SPEED_BLIND}, { 700, SPEED_SLOW}, { 300, SPEED_RECOVER}, {1500, SPEED_NORM},
+    {2400, SPEED_BLIND}, { 600, SPEED_SLOW}, { 300, SPEED_RECOVER}, {2700, SPEED_NORM}
+};
+
+// the body takes the wheel speed up to PRF_TRACTION, beyond it the wheels spin or lock on their own
+static void drive_lap(const char* name, int32_t acc, int32_t jerk) {
+    MotionProfile mp(acc, jerk);
+    const int n = sizeof(lapSections) / sizeof(*lapSections);
+    const double dt = PRF_PERIOD / 1000.0;
+    double x = 0.0, body = 0.0, wheel = 0.0, slip = 0.0, prevA = 0.0, maxA = 0.0, maxJ = 0.0, late = 0.0;
+    int sec = 0, t = 0;
+    double end = lapSections[0][0];
+    while (sec < n && t < PATH_TIMEOUT) {
+        int16_t target = lapSections[sec][1];
+        int16_t pwm;
+        if (acc == 0) {
+            pwm = target;
+        } else {
+            mp.setTarget(target);
+            pwm = mp.update(PRF_PERIOD);
+        }
+        double drive = pwm * MMPS_PER_PWM;
+        double need = (drive - body) * 1000.0 / PATH_MOTOR_LAG;
+        double a = need;
+        if (a > PRF_TRACTION) a = PRF_TRACTION;
+        if (a < -PRF_TRACTION) a = -PRF_TRACTION;
+        if (a == need) {
+            wheel = body + a * dt;
+        } else {
+            wheel += (drive - wheel) * PRF_PERIOD / (PRF_WHEEL_LAG + PRF_PERIOD);
+        }
+        body += a * dt;
+        slip += fabs(wheel - body) * dt;
+        if (body > target * MMPS_PER_PWM + MMPS_PER_PWM) late += body * dt; // faster than the section allows
+        if (fabs(a) > maxA) maxA = fabs(a);
+        if (fabs(a - prevA) / dt > maxJ) maxJ = fabs(a - prevA) / dt;
+        prevA = a;
+        x += body * dt;
+        t += PRF_PERIOD;
+        if (x >= end && ++sec < n) end += lapSections[sec][0];
+    }
+    printf("%-9s lap %5.2f s, slipped %5.1f mm, %5.0f mm over the section speed, max %5.0f mm/s^2, max jerk %6.0f mm/s^3\n",
+        name, t / 1000.0, slip, late, maxA, maxJ);
+}
+
+static int cmd_profile(int argc, char* argv[]) {
+    int32_t acc = PRF_ACC, jerk = PRF_JERK;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-a") == 0 && i + 1 < argc) {
+            acc = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+            jerk = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    const int16_t steps[][2] = {
+        {0, SPEED_NORM}, {SPEED_BLIND, SPEED_SLOW}, {SPEED_SLOW, SPEED_RECOVER}, {SPEED_NORM, SPEED_NORM + 1},
+        {SPEED_NORM, -SPEED_NORM}, {-20, 0}
+    };
+    bool ok = true;
+    for (unsigned i = 0; i < sizeof(steps) / sizeof(*steps); i++) {
+        ok = check_step(steps[i][0], steps[i][1], acc, 0) && ok;
+        ok = check_step(steps[i][0], steps[i][1], acc, jerk) && ok;
+    }
+    // a ramp of ChallengeRunner, a PWM every 25 cycles for a second
+    MotionProfile ramp(acc);
+    ramp.reset(43);
+    ramp.setRate(1, 25 * PRF_PERIOD);
+    ramp.setTarget(-100);
+    for (int t = 0; t < 1000; t += PRF_PERIOD) ramp.update(PRF_PERIOD);
+    printf("ramp of a PWM every 25 cycles from 43 for 1 s: %d  %s\n", ramp.get(), (ramp.get() == 33) ? "ok" : "FAILED");
+    ok = (ramp.get() == 33) && ok;
+
+    drive_lap("step", 0, 0);
+    drive_lap("trapezoid", acc, 0);
+    drive_lap("S-curve", acc, jerk);
+    return ok ? 0 : 1;
+}
+
+// returns the mean speed over the last second, and the time to get within 5 % of the target for good
+static double spin_wheel(int16_t target, int32_t mv, int16_t load, bool closed, int& settle) {
+    VelocityController vc(PRF_PERIOD);
+    vc.reset(0);
+    vc.setTarget(target);
+    double w = 0.0, pos = 0.0, sum = 0.0;
+    int n = 0;
+    settle = -1;
+    for (int t = 0; t < VEL_RUN; t += PRF_PERIOD) {
+        int32_t cnt = (int32_t)floor(pos * 360.0 / (M_PI * TIRE_DIAMETER));
+        int16_t pwm = closed ? vc.update(cnt, mv) : target / MMPS_PER_PWM;
+        double drive = (double)pwm * MMPS_PER_PWM * mv / MOT_VBAT - load;
+        w += (drive - w) * PRF_PERIOD / (PATH_MOTOR_LAG + PRF_PERIOD);
+        pos += w * PRF_PERIOD / 1000.0;
+        if (fabs(w - target) > target * 0.05) {
+            settle = -1;
+        } else if (settle < 0) {
+            settle = t;
+        }
+        if (t >= VEL_RUN - 1000) {
+            sum += w;
+            n++;
+        }
+    }
+    return sum / n;
+}
+
+static int cmd_velocity(int argc, char* argv[]) {
+    int16_t target = SPEED_NORM * MMPS_PER_PWM;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            target = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    const int32_t voltages[] = { 7000, MOT_VBAT, 8400 };
+    const int16_t loads[] = { 0, VEL_CLIMB };
+    printf("target %d mm/s            open loop                  closed loop\n", target);
+    for (unsigned l = 0; l < sizeof(loads) / sizeof(*loads); l++) {
+        for (unsigned v = 0; v < sizeof(voltages) / sizeof(*voltages); v++) {
+            int so, sc;
+            double open = spin_wheel(target, voltages[v], loads[l], false, so);
+            double closed = spin_wheel(target, voltages[v], loads[l], true, sc);
+            char ts[2][16];
+            if (so < 0) strcpy(ts[0], "never"); else sprintf(ts[0], "%d ms", so);
+            if (sc < 0) strcpy(ts[1], "never"); else sprintf(ts[1], "%d ms", sc);
+            printf("%4d mV %-6s  %5.0f mm/s (%+5.1f %%) %7s  %5.0f mm/s (%+5.1f %%) %7s\n",
+                voltages[v], loads[l] ? "climb" : "flat", open, 100.0 * (open - target) / target, ts[0],
+                closed, 100.0 * (closed - target) / target, ts[1]);
+        }
+    }
+    return 0;
+}
+
+static int cmd_sysid(int argc, char* argv[]) {
+    int16_t turnAmp = 5;
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) {
+            turnAmp = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    // the right wheel a little weaker and slower than the left one
+    const struct motorModel truth[2] = { { 8.6F, 110, 4 }, { 8.1F, 130, 6 } };
+    const int16_t truthDelay = 12; // ms of dead time of both
+    const int16_t period = SYSID_DECIM * PRF_PERIOD;
+    MotorIdentifier* ident[2] = { new MotorIdentifier(period), new MotorIdentifier(period) };
+    double w[2] = { 0.0, 0.0 }, pos[2] = { 0.0, 0.0 };
+    int32_t prevCnt[2] = { 0, 0 }, sum[2] = { 0, 0 };
+    int16_t queue[2][16] = { { 0 } }; // PWM waiting out the dead time, a cycle per entry
+    int16_t forward = 0, turn = 0;
+    srand(1);
+    clock_t c0 = clock();
+    int updates = 0;
+    for (int tick = 0; tick * PRF_PERIOD < SYSID_TIME; ) {
+        if (tick % SYSID_DECIM == 0) {
+            forward = ident[0]->excite();
+            turn = rand() % (2 * turnAmp + 1) - turnAmp;
+        }
+        int16_t pwm[2] = { (int16_t)(forward - turn), (int16_t)(forward + turn) };
+        for (int k = 0; k < 2; k++) {
+            int lag = truthDelay / PRF_PERIOD;
+            for (int i = lag; i > 0; i--) queue[k][i] = queue[k][i - 1];
+            queue[k][0] = pwm[k];
+            int16_t u = queue[k][lag];
+            double drive = (u > truth[k].dead) ? truth[k].gain * (u - truth[k].dead) : 0.0;
+            w[k] += (drive - w[k]) * (1.0 - exp(-(double)PRF_PERIOD / truth[k].tau));
+            pos[k] += w[k] * PRF_PERIOD / 1000.0;
+            sum[k] += pwm[k];
+        }
+        if (++tick % SYSID_DECIM == 0) {
+            for (int k = 0; k < 2; k++) {
+                int32_t cnt = (int32_t)floor(pos[k] * 360.0 / (M_PI * TIRE_DIAMETER));
+                ident[k]->update(sum[k] / SYSID_DECIM, (cnt - prevCnt[k]) * MM_PER_CNT_X1000 / period);
+                prevCnt[k] = cnt;
+                sum[k] = 0;
+            }
+            updates += 2;
+        }
+    }
+    double us = 1e6 * (clock() - c0) / CLOCKS_PER_SEC / updates;
+    const char* name[2] = { "left", "right" };
+    for (int k = 0; k < 2; k++) {
+        struct motorModel m;
+        if (!ident[k]->solve(m)) {
+            printf("%-5s no stable model found\n", name[k]);
+            continue;
+        }
+        printf("%-5s gain %5.2f (%5.2f) mm/s per PWM, tau %4d (%4d) ms, dead %3d (%3d) PWM\n",
+            name[k], m.gain, truth[k].gain, m.tau, truth[k].tau, m.dead, truth[k].dead);
+    }
+    printf("dead time (%d ms) unresolved at a sample of %d ms\n", truthDelay, period);
+    printf("%d samples per wheel, %.2f us per update including the plant, true values in brackets\n",
+        ident[0]->getSamples(), us);
+    delete ident[0];
+    delete ident[1];
+    return 0;
+}
+
+// divisor and phase of each acquisition in the order of the SNS_ ids of Observer
+static void schedule(const char* name, const uint8_t plan[][2], const uint32_t* cost, int n) {
+    SensorScheduler sched;
+    for (int i = 0; i < n; i++) sched.add(plan[i][0], plan[i][1]);
+    for (int t = 0; t < SCH_RUN; t += SYN_PERIOD) {
+        sched.startTick();
+        for (int i = 0; i < n; i++) {
+            if (sched.isDue(i)) sched.done(i, cost[i]);
+        }
+    }
+    sched.startTick();
+    uint32_t ticks = sched.getTicks();
+    printf("%-22s %4u %4u ", name, sched.getMeanCost(), sched.getMaxCost());
+    for (int b = 0; b < SCH_COST_BINS; b++) printf(" %5.1f", 100.0 * sched.getHistogram(b) / ticks);
+    printf("\n");
+}
+
+static int cmd_sched(int argc, char* argv[]) {
+    uint32_t cost[6] = { SCH_COST_COLOR, SCH_COST_GYRO, SCH_COST_WHEELS, SCH_COST_SONAR, SCH_COST_TOUCH, SCH_COST_BUTTON };
+    for (int i = 0; i < argc; i++) {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%u,%u,%u,%u,%u,%u", &cost[0], &cost[1], &cost[2], &cost[3], &cost[4], &cost[5]) != 6) {
+                fprintf(stderr, "-c takes six costs separated by commas\n");
+                return 1;
+            }
+        } else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    const uint8_t every[6][2]  = { {1, 0}, {1, 0}, {1, 0}, {1, 0}, {1, 0}, {1, 0} };
+    const uint8_t before[6][2] = { {1, 0}, {1, 0}, {1, 0}, {SCH_SONAR_DIV, SCH_SONAR_DIV - 1}, {1, 0}, {1, 0} };
+    const uint8_t nophase[6][2] = { {1, 0}, {1, 0}, {1, 0}, {SCH_SONAR_DIV, 0}, {SCH_TOUCH_DIV, 0}, {SCH_BUTTON_DIV, 0} };
+    const uint8_t phased[6][2] = { {1, 0}, {1, 0}, {1, 0}, {SCH_SONAR_DIV, SCH_SONAR_PHASE},
+                                   {SCH_TOUCH_DIV, SCH_TOUCH_PHASE}, {SCH_BUTTON_DIV, SCH_BUTTON_PHASE} };
+    printf("us per cycle           mean  max  %% of cycles from 0 us by %d us\n", SCH_COST_BIN);
+    schedule("every cycle", every, cost, 6);
+    schedule("sonar at its pace", before, cost, 6);
+    schedule("multi-rate, no phases", nophase, cost, 6);
+    schedule("multi-rate", phased, cost, 6);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc >= 2 && strcmp(argv[1], "cusum") == 0) return cmd_cusum(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "heading") == 0) return cmd_heading(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "localize") == 0) return cmd_localize(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "path") == 0) return cmd_path(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "motion") == 0) return cmd_motion(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "profile") == 0) return cmd_profile(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "velocity") == 0) return cmd_velocity(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "sysid") == 0) return cmd_sysid(argc - 2, argv + 2);
+    if (argc >= 2 && strcmp(argv[1], "sched") == 0) return cmd_sched(argc - 2, argv + 2);
+    fprintf(stderr, "usage: %s cusum [-k drift] [-h threshold] [-s seconds] [trace.csv ...]\n", argv[0]);
+    fprintf(stderr, "       %s heading [-w gyro weight] [-b bias] [-l laps]\n", argv[0]);
+    fprintf(stderr, "       %s localize [-e scale error] [-f flickers per second]\n", argv[0]);
+    fprintf(stderr, "       %s path [-r]\n", argv[0]);
+    fprintf(stderr, "       %s profile [-a acceleration] [-j jerk]\n", argv[0]);
+    fprintf(stderr, "       %s velocity [-s mm/s]\n", argv[0]);
+    fprintf(stderr, "       %s sysid [-t turn amplitude]\n", argv[0]);
+    fprintf(stderr, "       %s sched [-c color,gyro,wheels,sonar,touch,button]\n", argv[0]);
+    return 1;
+}
@@ -0,0 +1,86 @@
+//
+//  tlm_receiver.cpp
+//  aflac2020
+//
+//  Receives the binary telemetry of TelemetryStreamer and writes it as plain CSV.
+//  The input is the Bluetooth serial device, e.g. /dev/rfcomm0, the pty of bt_standin -t
+//  or a file captured from either. Acks of the command channel in the same stream are skipped.
+//
+//  build: g++ -std=gnu++11 -DMAKE_HOST -I.. -o tlm_receiver tlm_receiver.cpp
+//             ../TelemetryStreamer.cpp ../CourseFile.cpp
+//  usage: tlm_receiver DEVICE|FILE [out.csv]
+//
+//  Copyright © 2020 Ahiruchan Koubou. All rights reserved.
+//
+
+#include "TelemetryStreamer.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <termios.h>
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s DEVICE|FILE [out.csv]\n", argv[0]);
+        return 2;
+    }
+    int fd = open(argv[1], O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    struct termios t;
+    if (tcgetattr(fd, &t) == 0) {
+        cfmakeraw(&t);
+        tcsetattr(fd, TCSANOW, &t);
+    }
+    FILE* out = (argc >= 3) ? fopen(argv[2], "w") : stdout;
+    if (out == NULL) {
+        perror(argv[2]);
+        return 1;
+    }
+    fprintf(out, "time,distance,azimuth,locX,locY,grayScale,turn,pwmL,pwmR,state,stepNo,r,g,b,color\n");
+
+    uint8_t  buf[TLM_MTU * 2];
+    int      len = 0, expected = -1;
+    uint32_t frames = 0, records = 0, broken = 0, lost = 0;
+    ssize_t  n;
+    while ((n = read(fd, buf + len, sizeof(buf) - len)) > 0) {
+        len += n;
+        int pos = 0;
+        while (pos < len) {
+            if (buf[pos] != TLM_SYNC) {
+                pos++;
+                continue;
+            }
+            int r = tlm_verify(buf + pos, len - pos);
+            if (r == 0) break; // wait for the rest of the frame
+            if (r < 0) {
+                broken++;
+                pos++;
+                continue;
+            }
+            const struct tlmHeader* h = (const struct tlmHeader*)(buf + pos);
+            if (expected >= 0 && h->seq != expected) lost += (uint8_t)(h->seq - expected);
+            expected = (uint8_t)(h->seq + 1);
+            if (h->dropped > 0) fprintf(stderr, "frame %u: %u records dropped on the robot\n", h->seq, h->dropped);
+            const struct tlmRecord* rec = (const struct tlmRecord*)(buf + pos + sizeof(*h));
+            for (int i = 0; i < h->count; i++, rec++) {
+                fprintf(out, "%u,%d,%d,%d,%d,%d,%d,%d,%d,%u,%d,%u,%u,%u,%u\n", rec->time, rec->distance, rec->azimuth,
+                        rec->locX, rec->locY, rec->grayScale, rec->turn, rec->pwmL, rec->pwmR, rec->state, rec->stepNo,
+                        rec->r, rec->g, rec->b, rec->color);
+            }
+            fflush(out);
+            frames++;
+            records += h->count;
+            pos += r;
+        }
+        if (len - pos == (int)sizeof(buf)) pos = len; // cannot happen with a valid stream, resync
+        memmove(buf, buf + pos, len - pos);
+        len -= pos;
+    }
+    fprintf(stderr, "%u frames, %u records, %u broken frames, %u frames lost\n", frames, records, broken, lost);
+    if (out != stdout) fclose(out);
+    return 0;
+}
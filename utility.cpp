@@ -8,6 +8,7 @@
 
 #include "app.h"
 #include "utility.hpp"
+#include <string.h>
 
 void rgb_to_hsv(rgb_raw_t rgb, hsv_raw_t& hsv) {
     uint16_t max, min;
@@ -54,6 +55,7 @@ PIDcalculator::PIDcalculator(double p, double i, double d, int16_t t, int16_t mi
     minimum = min;
     maximum = max;
     traceCnt = 0;
+    integral = 0.0;
 }
 
 int16_t PIDcalculator::math_limit(int16_t input, int16_t min, int16_t max) {
@@ -90,11 +92,141 @@ int16_t PIDcalculator::compute(int16_t sensor, int16_t target) {
     return math_limit(p + i + d, minimum, maximum);
 }
 
+void PIDcalculator::setGains(double p, double i, double d) {
+    kp = p;
+    ki = i;
+    kd = d;
+    integral = 0.0;
+    diff[1] = INT16_MAX; // restart differentiation with the new gains
+}
+
+void PIDcalculator::setLimits(int16_t min, int16_t max) {
+    minimum = min;
+    maximum = max;
+}
+
+// read gains saved by save(), lines other than kp, ki and kd are ignored
+bool PIDcalculator::load(const char* filename, double& p, double& i, double& d) {
+    FILE* fp = fopen(filename, "r");
+    if (fp == NULL) {
+        _debug(syslog(LOG_NOTICE, "%08u, PIDcalculator::load(): %s not found", clock->now(), filename));
+        return false;
+    }
+    double value;
+    char buf[64], name[16];
+    while (fgets(buf, sizeof(buf), fp) != NULL) {
+        if (sscanf(buf, "%15[^,],%lf", name, &value) != 2) continue;
+        if (strcmp(name, "kp") == 0) {
+            p = value;
+        } else if (strcmp(name, "ki") == 0) {
+            i = value;
+        } else if (strcmp(name, "kd") == 0) {
+            d = value;
+        }
+    }
+    fclose(fp);
+    _debug(syslog(LOG_NOTICE, "%08u, PIDcalculator::load(): kp = %lf, ki = %lf, kd = %lf", clock->now(), p, i, d));
+    return true;
+}
+
+bool PIDcalculator::save(const char* filename) {
+    FILE* fp = fopen(filename, "w");
+    if (fp == NULL) {
+        _debug(syslog(LOG_NOTICE, "%08u, PIDcalculator::save(): cannot open %s", clock->now(), filename));
+        return false;
+    }
+    fprintf(fp, "name,value\n");
+    fprintf(fp, "kp,%.10lf\n", kp);
+    fprintf(fp, "ki,%.10lf\n", ki);
+    fprintf(fp, "kd,%.10lf\n", kd);
+    fclose(fp);
+    return true;
+}
+
+PIDcalculator::~PIDcalculator() {
+}
+
+// Relay feedback experiment (Astrom-Hagglund):
+// the relay with hysteresis drives the loop into a limit cycle whose amplitude a and period Tu
+// give the ultimate gain Ku = 4d / (pi * a) for the relay amplitude d
+RelayTuner::RelayTuner(int16_t amp, int16_t hyst, int16_t cyc, int16_t t) {
+    amplitude  = amp;
+    hysteresis = hyst;
+    cycles     = cyc;
+    deltaT     = t;
+    reset();
+}
+
+void RelayTuner::reset() {
+    relayOut   = 1;
+    tick       = 0;
+    lastRise   = -1;
+    nPeriods   = 0;
+    peakMax    = INT16_MIN;
+    peakMin    = INT16_MAX;
+    sumAmp     = 0.0;
+    sumPeriod  = 0.0;
+}
+
+int16_t RelayTuner::compute(int16_t sensor, int16_t target) {
+    int16_t e = sensor - target;
+    tick++;
+    if (e > peakMax) peakMax = e;
+    if (e < peakMin) peakMin = e;
+
+    if (relayOut < 0 && e > hysteresis) {
+        relayOut = 1;
+        // one full oscillation completes at every rising switch,
+        // the first one (lastRise == 0) is the transient from the initial position
+        if (lastRise > 0 && !isDone()) {
+            sumPeriod += tick - lastRise;
+            sumAmp    += (peakMax - peakMin) / 2.0;
+            nPeriods++;
+        }
+        lastRise = tick;
+        peakMax = peakMin = e;
+    } else if (relayOut > 0 && e < -hysteresis) {
+        relayOut = -1;
+        if (lastRise < 0) lastRise = 0;
+    }
+    return relayOut * amplitude;
+}
+
+bool RelayTuner::isDone() {
+    return nPeriods >= cycles;
+}
+
+double RelayTuner::getKu() {
+    if (nPeriods == 0 || sumAmp == 0.0) return 0.0;
+    return 4.0 * amplitude / (M_PI * sumAmp / nPeriods);
+}
+
+// ultimate period in miliseconds, the time base PIDcalculator integrates with
+double RelayTuner::getTu() {
+    if (nPeriods == 0) return 0.0;
+    return sumPeriod / nPeriods * deltaT / 1000.0;
+}
+
+void RelayTuner::getGains(int8_t rule, double& p, double& i, double& d) {
+    double ku = getKu(), tu = getTu(), ti, td;
+    if (rule == AT_RULE_TL) {
+        p  = ku / 2.2;
+        ti = tu * 2.2;
+        td = tu / 6.3;
+    } else {
+        p  = ku * 0.6;
+        ti = tu / 2.0;
+        td = tu / 8.0;
+    }
+    i = (ti > 0.0) ? p / ti : 0.0;
+    d = p * td;
+}
+
+RelayTuner::~RelayTuner() {
+}
+
 OutlierTester::OutlierTester(uint32_t skipCount, uint32_t initCount) {
     cnt = 0L;
-    n   = 0L;
-    sumSQ = 0.0;
-    sum   = 0.0;
     skipCnt = skipCount;
     initCnt = initCount;
     _debug(syslog(LOG_NOTICE, "%08u, OutlierTester::OutlierTester(): skipCnt = %lu, initCnt = %lu", 0, skipCnt, initCnt));
@@ -104,16 +236,13 @@ int8_t OutlierTester::test(double sample) { // sample is an outlier when true is
     if (++cnt <= skipCnt) { // skip initial samples
         return NOT_OUTLIER;
     } else if (cnt <= initCnt) { // do not test until variance gets stable enough
-        n++;
-        sumSQ += (sample * sample);
-        sum   += sample;
+        stats.add(sample);
         return NOT_OUTLIER;
     }
-    double average  = sum / n;
-    double variance = (sumSQ / n) - (average * average);
-    double diff     = sample - average;
+    double variance = stats.variance();
+    double diff     = sample - stats.mean();
     double diffSQ   = diff * diff;
-    //cout << " n=" << n << " a=" << average << " v=" << variance << " ds=" << deltaSQ;
+    //cout << " n=" << stats.count() << " a=" << stats.mean() << " v=" << variance << " ds=" << diffSQ;
     if ( diffSQ > 2 * 2 * variance ) { // diff > 2 * Sigma then outlier
         // sample is an outlier
         if (diff >= 0) {
@@ -122,13 +251,27 @@ int8_t OutlierTester::test(double sample) { // sample is an outlier when true is
             return NEG_OUTLIER;
         }
     } else {
-        n++;
-        sumSQ += (sample * sample);
-        sum   += sample;
+        stats.add(sample);
         return NOT_OUTLIER; // sample is NOT an outlier
     }
 }
 
 int own_abs(int num){
     return (num > 0) ? num : -num;
+}
+
+// integer square root without floating point, rounded down
+uint32_t own_isqrt(uint32_t num){
+    uint32_t res = 0, bit = 1UL << 30;
+    while (bit > num) bit >>= 2;
+    while (bit != 0) {
+        if (num >= res + bit) {
+            num -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+    return res;
 }
\ No newline at end of file
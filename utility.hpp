@@ -13,7 +13,12 @@
 #define POS_OUTLIER          1
 #define NEG_OUTLIER          2
 
+#define CUSUM_NONE           0
+#define CUSUM_RISE           1
+#define CUSUM_FALL           2
+
 #include "aflac_common.hpp"
+#include <limits>
 
 template<typename T, int CAPACITY> class MovingAverage {
 private:
@@ -71,6 +76,435 @@ T MovingAverage<T, CAPACITY>::get() {
     }
 }
 
+/*
+ * Streaming statistics, all of fixed size and free of allocation.
+ * T is the type of the samples and A the accumulator, wide enough for the sums of squares.
+ * With an integer A the sums are kept exactly, which cannot lose precision as long as they
+ * do not overflow; with a floating point A the mean and the squared deviations are updated
+ * by Welford's method instead of the sums, which would cancel catastrophically.
+ * Samples in fixed point can be fed as integers of the same scale.
+ */
+// variance of the population from the exact sums, sum^2 / n is split by the quotient so as not to overflow
+template<typename A> inline A stats_variance(A n, A sum, A sumSQ) {
+    A q = sum / n;
+    A r = sum - q * n;
+    return (sumSQ - q * sum - q * r - r * r / n) / n;
+}
+
+template<typename T, typename A = T> class RunningStats {
+private:
+    uint32_t n;
+    A mu, m2; // integer A: sum and sum of squares, floating point A: mean and sum of squared deviations
+public:
+    RunningStats();
+    void clear();
+    void add(T sample);
+    uint32_t count();
+    T mean();
+    A variance(); // of the population
+};
+
+template<typename T, typename A>
+RunningStats<T, A>::RunningStats() {
+    clear();
+}
+
+template<typename T, typename A>
+void RunningStats<T, A>::clear() {
+    n = 0;
+    mu = 0;
+    m2 = 0;
+}
+
+template<typename T, typename A>
+void RunningStats<T, A>::add(T sample) {
+    A x = sample;
+    n++;
+    if (std::numeric_limits<A>::is_integer) {
+        mu += x;
+        m2 += x * x;
+    } else {
+        A delta = x - mu;
+        mu += delta / n;
+        m2 += delta * (x - mu);
+    }
+}
+
+template<typename T, typename A>
+uint32_t RunningStats<T, A>::count() {
+    return n;
+}
+
+template<typename T, typename A>
+T RunningStats<T, A>::mean() {
+    if (std::numeric_limits<A>::is_integer) {
+        return (n == 0) ? 0 : mu / (A)n;
+    } else {
+        return mu;
+    }
+}
+
+template<typename T, typename A>
+A RunningStats<T, A>::variance() {
+    if (n == 0) return 0;
+    if (std::numeric_limits<A>::is_integer) {
+        return stats_variance((A)n, mu, m2);
+    } else {
+        return m2 / n;
+    }
+}
+
+// RunningStats over the last CAPACITY samples
+template<typename T, int CAPACITY, typename A = T> class WindowStats {
+private:
+    T elements[CAPACITY];
+    int index;
+    bool filled;
+    A mu, m2; // as RunningStats
+public:
+    WindowStats();
+    void clear();
+    T add(T sample); // returns the mean including sample
+    int count();
+    T mean();
+    A variance(); // of the samples in the window
+};
+
+template<typename T, int CAPACITY, typename A>
+WindowStats<T, CAPACITY, A>::WindowStats() {
+    assert (CAPACITY > 0);
+    clear();
+}
+
+template<typename T, int CAPACITY, typename A>
+void WindowStats<T, CAPACITY, A>::clear() {
+    index = 0;
+    filled = false;
+    mu = 0;
+    m2 = 0;
+}
+
+template<typename T, int CAPACITY, typename A>
+T WindowStats<T, CAPACITY, A>::add(T sample) {
+    if (index == CAPACITY) {
+        index = 0;
+        filled = true;
+    }
+    A x = sample;
+    if (filled) {
+        A old = elements[index];
+        if (std::numeric_limits<A>::is_integer) {
+            mu += x - old;
+            m2 += x * x - old * old;
+        } else {
+            A prevMu = mu;
+            mu += (x - old) / CAPACITY;
+            m2 += (x - old) * (x - mu + old - prevMu);
+            if (m2 < 0) m2 = 0; // rounding
+        }
+    } else {
+        if (std::numeric_limits<A>::is_integer) {
+            mu += x;
+            m2 += x * x;
+        } else {
+            A delta = x - mu;
+            mu += delta / (index + 1);
+            m2 += delta * (x - mu);
+        }
+    }
+    elements[index++] = sample;
+    return mean();
+}
+
+template<typename T, int CAPACITY, typename A>
+int WindowStats<T, CAPACITY, A>::count() {
+    return filled ? CAPACITY : index;
+}
+
+template<typename T, int CAPACITY, typename A>
+T WindowStats<T, CAPACITY, A>::mean() {
+    int n = count();
+    if (std::numeric_limits<A>::is_integer) {
+        return (n == 0) ? 0 : mu / (A)n;
+    } else {
+        return mu;
+    }
+}
+
+template<typename T, int CAPACITY, typename A>
+A WindowStats<T, CAPACITY, A>::variance() {
+    int n = count();
+    if (n == 0) return 0;
+    if (std::numeric_limits<A>::is_integer) {
+        return stats_variance((A)n, mu, m2);
+    } else {
+        return m2 / n;
+    }
+}
+
+// minimum and maximum of the last CAPACITY samples by monotonic deques, amortized O(1) per sample
+template<typename T, int CAPACITY> class WindowMinMax {
+private:
+    struct entry {
+        T        value;
+        uint32_t seq;
+    };
+    struct deque {
+        struct entry e[CAPACITY];
+        int head, size;
+    } lo, hi; // values ascending in lo and descending in hi from the head
+    uint32_t seq;
+
+    static void push(struct deque& d, T value, uint32_t seq, bool ascending);
+    static void expire(struct deque& d, uint32_t seq);
+public:
+    WindowMinMax();
+    void clear();
+    void add(T sample);
+    T min();
+    T max();
+};
+
+template<typename T, int CAPACITY>
+WindowMinMax<T, CAPACITY>::WindowMinMax() {
+    assert (CAPACITY > 0);
+    clear();
+}
+
+template<typename T, int CAPACITY>
+void WindowMinMax<T, CAPACITY>::clear() {
+    lo.head = lo.size = 0;
+    hi.head = hi.size = 0;
+    seq = 0;
+}
+
+template<typename T, int CAPACITY>
+void WindowMinMax<T, CAPACITY>::push(struct deque& d, T value, uint32_t seq, bool ascending) {
+    // a sample that can never be the extreme again as long as the new one is in the window is dropped
+    while (d.size > 0) {
+        const struct entry& last = d.e[(d.head + d.size - 1) % CAPACITY];
+        if (ascending ? (last.value < value) : (last.value > value)) break;
+        d.size--;
+    }
+    struct entry& e = d.e[(d.head + d.size++) % CAPACITY];
+    e.value = value;
+    e.seq = seq;
+}
+
+template<typename T, int CAPACITY>
+void WindowMinMax<T, CAPACITY>::expire(struct deque& d, uint32_t seq) {
+    while (d.size > 0 && seq - d.e[d.head].seq >= (uint32_t)CAPACITY) {
+        d.head = (d.head + 1) % CAPACITY;
+        d.size--;
+    }
+}
+
+template<typename T, int CAPACITY>
+void WindowMinMax<T, CAPACITY>::add(T sample) {
+    expire(lo, seq);
+    expire(hi, seq);
+    push(lo, sample, seq, true);
+    push(hi, sample, seq, false);
+    seq++;
+}
+
+template<typename T, int CAPACITY>
+T WindowMinMax<T, CAPACITY>::min() {
+    return (lo.size == 0) ? 0 : lo.e[lo.head].value;
+}
+
+template<typename T, int CAPACITY>
+T WindowMinMax<T, CAPACITY>::max() {
+    return (hi.size == 0) ? 0 : hi.e[hi.head].value;
+}
+
+// exponential moving average and variance with the weight NUM/DEN given to a new sample
+template<typename T, int NUM, int DEN, typename A = T> class ExpStats {
+private:
+    bool started;
+    A mu, var;
+public:
+    ExpStats();
+    void clear();
+    T add(T sample); // returns the mean including sample
+    T mean();
+    A variance();
+};
+
+template<typename T, int NUM, int DEN, typename A>
+ExpStats<T, NUM, DEN, A>::ExpStats() {
+    assert (NUM > 0 && NUM <= DEN);
+    clear();
+}
+
+template<typename T, int NUM, int DEN, typename A>
+void ExpStats<T, NUM, DEN, A>::clear() {
+    started = false;
+    mu = 0;
+    var = 0;
+}
+
+template<typename T, int NUM, int DEN, typename A>
+T ExpStats<T, NUM, DEN, A>::add(T sample) {
+    A x = sample;
+    if (!started) {
+        started = true;
+        mu = x;
+        var = 0;
+    } else {
+        A delta = x - mu;
+        A incr = delta * NUM / DEN;
+        mu += incr;
+        var = (var + delta * incr) * (DEN - NUM) / DEN;
+    }
+    return mu;
+}
+
+template<typename T, int NUM, int DEN, typename A>
+T ExpStats<T, NUM, DEN, A>::mean() {
+    return mu;
+}
+
+template<typename T, int NUM, int DEN, typename A>
+A ExpStats<T, NUM, DEN, A>::variance() {
+    return var;
+}
+
+/*
+ * Running median of the last CAPACITY samples, kept sorted to find the expiring sample
+ * and the place of the new one by binary search.
+ * A sample equal to dropout is held over by the last median for up to hold consecutive
+ * samples, after that it is taken as a reading like any other.
+ */
+template<typename T, int CAPACITY> class MedianFilter {
+private:
+    T window[CAPACITY]; // in the order of arrival
+    T sorted[CAPACITY];
+    int index, size, dropouts, hold;
+    T dropout, median;
+
+    int search(T value, bool after); // first position not less than value, or greater than value if after
+public:
+    MedianFilter(T initial, T dropoutValue, int holdCount);
+    void clear(T initial);
+    T add(T sample); // returns the median including sample
+    T get();
+};
+
+template<typename T, int CAPACITY>
+MedianFilter<T, CAPACITY>::MedianFilter(T initial, T dropoutValue, int holdCount) {
+    assert (CAPACITY > 0);
+    dropout = dropoutValue;
+    hold = holdCount;
+    clear(initial);
+}
+
+template<typename T, int CAPACITY>
+void MedianFilter<T, CAPACITY>::clear(T initial) {
+    index = 0;
+    size = 0;
+    dropouts = 0;
+    median = initial;
+}
+
+template<typename T, int CAPACITY>
+int MedianFilter<T, CAPACITY>::search(T value, bool after) {
+    int lo = 0, hi = size;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (sorted[mid] < value || (after && sorted[mid] == value)) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+template<typename T, int CAPACITY>
+T MedianFilter<T, CAPACITY>::add(T sample) {
+    if (sample == dropout) {
+        if (++dropouts <= hold) return median;
+    } else {
+        dropouts = 0;
+    }
+    if (size == CAPACITY) {
+        int pos = search(window[index], false);
+        for (int i = pos; i < size - 1; i++) sorted[i] = sorted[i + 1];
+        size--;
+    }
+    int pos = search(sample, true);
+    for (int i = size; i > pos; i--) sorted[i] = sorted[i - 1];
+    sorted[pos] = sample;
+    size++;
+    window[index] = sample;
+    index = (index + 1) % CAPACITY;
+    median = sorted[size / 2];
+    return median;
+}
+
+template<typename T, int CAPACITY>
+T MedianFilter<T, CAPACITY>::get() {
+    return median;
+}
+
+/*
+ * Two-sided CUSUM of the deviations from a reference level fed by add(), to detect a change
+ * of level with integer arithmetic only. Deviations within +-drift per sample are taken as noise.
+ * add() keeps reporting a change for as long as its sum stays beyond the threshold,
+ * which lets the caller confirm it by other means; clear() once it has been acted upon.
+ */
+template<typename T> class CusumDetector {
+private:
+    T drift, threshold;
+    T gPos, gNeg;
+public:
+    CusumDetector(T k, T h);
+    void clear();
+    int8_t add(T deviation);
+    T getRise();
+    T getFall();
+};
+
+template<typename T>
+CusumDetector<T>::CusumDetector(T k, T h) {
+    assert (h > 0);
+    drift = k;
+    threshold = h;
+    clear();
+}
+
+template<typename T>
+void CusumDetector<T>::clear() {
+    gPos = 0;
+    gNeg = 0;
+}
+
+template<typename T>
+int8_t CusumDetector<T>::add(T deviation) {
+    gPos = gPos + deviation - drift;
+    if (gPos < 0) gPos = 0;
+    gNeg = gNeg - deviation - drift;
+    if (gNeg < 0) gNeg = 0;
+    if (gPos > threshold) {
+        return CUSUM_RISE;
+    } else if (gNeg > threshold) {
+        return CUSUM_FALL;
+    } else {
+        return CUSUM_NONE;
+    }
+}
+
+template<typename T>
+T CusumDetector<T>::getRise() {
+    return gPos;
+}
+
+template<typename T>
+T CusumDetector<T>::getFall() {
+    return gNeg;
+}
+
 template<int ORDER> class FIR_Direct {
 private:
     const double *const hm;
@@ -126,13 +560,39 @@ private:
 public:
     PIDcalculator(double p, double i, double d, int16_t t, int16_t min, int16_t max);
     int16_t compute(int16_t sensor, int16_t target);
+    void setGains(double p, double i, double d);
+    void setLimits(int16_t min, int16_t max);
+    static bool load(const char* filename, double& p, double& i, double& d);
+    bool save(const char* filename);
     ~PIDcalculator();
 };
 
+// tuning rules applicable to the ultimate gain and period
+#define AT_RULE_ZN           0  // Ziegler-Nichols
+#define AT_RULE_TL           1  // Tyreus-Luyben
+
+class RelayTuner {
+private:
+    int16_t amplitude, hysteresis, cycles, deltaT, nPeriods;
+    int16_t peakMax, peakMin;
+    int8_t  relayOut;
+    int32_t tick, lastRise;
+    double  sumAmp, sumPeriod;
+public:
+    RelayTuner(int16_t amp, int16_t hyst, int16_t cyc, int16_t t);
+    void reset();   // start the experiment over
+    int16_t compute(int16_t sensor, int16_t target);
+    bool isDone();
+    double getKu();
+    double getTu();
+    void getGains(int8_t rule, double& p, double& i, double& d);
+    ~RelayTuner();
+};
+
 class OutlierTester {
 private:
-    double sum, sumSQ;
-    uint32_t cnt, n, skipCnt, initCnt;
+    RunningStats<double> stats;
+    uint32_t cnt, skipCnt, initCnt;
 public:
     OutlierTester(uint32_t skipCount, uint32_t initCount);
     int8_t test(double sample);
@@ -140,5 +600,6 @@ public:
 };
 
 int own_abs(int num);
+uint32_t own_isqrt(uint32_t num);
 
 #endif /* utility_hpp */